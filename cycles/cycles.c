@@ -0,0 +1,449 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "sim_avr.h"
+#include "sim_elf.h"
+#include "sim_io.h"
+#include "sim_irq.h"
+#include "avr_uart.h"
+#include "avr_spi.h"
+#include "avr_ioport.h"
+
+#include "smf.h"
+#include "raw.h"
+
+// runs the real firmware image in simavr, plays a MIDI script to its UART
+// and counts the CPU cycles of the hot paths - see the usage below
+
+#define CYCLES_MCU			"atmega8"
+#define CYCLES_F_CPU		(16000000UL)
+#define CYCLES_BAUD			(31250UL)
+// start bit, 8 data bits and stop bit
+#define CYCLES_PER_BYTE		((10*CYCLES_F_CPU)/CYCLES_BAUD)
+#define CYCLES_PER_US		(CYCLES_F_CPU/1000000UL)
+// 19 vectors of a single word (rjmp) each on the ATmega8
+#define CYCLES_VECTOR_TABLE_END	(19*2)
+
+#define CYCLES_MAX_FUNCTIONS	(32)
+#define CYCLES_MAX_FRAMES		(16)
+#define CYCLES_NAME_LENGTH		(64)
+// longer than the 100ms between two panel reads
+#define CYCLES_DEFAULT_TAIL_MS	(250)
+
+// the panel as the shift registers return it (see main.c)
+#define CYCLES_PANEL_MODE_BIT0		(0x20)
+#define CYCLES_PANEL_LFO_CLOCK_ENABLE	(0x80)
+#define CYCLES_NUM_SHIFTIN_REG		(2)
+// chip select of the shift registers: PD6, the button: PC0
+#define CYCLES_SR_CE_PORT	('D')
+#define CYCLES_SR_CE_PIN	(6)
+#define CYCLES_BUTTON_PORT	('C')
+#define CYCLES_BUTTON_PIN	(0)
+
+// interrupt vector names of the ATmega8 - the ISRs show up as __vector_<n>
+const char* cycles_vector_name[] = {
+	"RESET", "INT0_vect", "INT1_vect", "TIMER2_COMP_vect", "TIMER2_OVF_vect",
+	"TIMER1_CAPT_vect", "TIMER1_COMPA_vect", "TIMER1_COMPB_vect",
+	"TIMER1_OVF_vect", "TIMER0_OVF_vect", "SPI_STC_vect", "USART_RXC_vect",
+	"USART_UDRE_vect", "USART_TXC_vect", "ADC_vect", "EE_RDY_vect",
+	"ANA_COMP_vect", "TWI_vect", "SPM_RDY_vect"
+};
+#define CYCLES_NUM_VECTORS	(sizeof(cycles_vector_name)/sizeof(cycles_vector_name[0]))
+
+typedef struct {
+	char name[CYCLES_NAME_LENGTH];
+	uint32_t address;
+	bool isr;
+	uint32_t budget;
+	uint32_t calls;
+	uint64_t sum;
+	uint32_t max;
+	// when the longest call started
+	avr_cycle_count_t max_at;
+} cycles_function_t;
+
+// a call of a measured function still running
+typedef struct {
+	cycles_function_t* function;
+	avr_cycle_count_t start;
+	// cycles spent in the interrupts cutting in
+	avr_cycle_count_t interrupted;
+	uint16_t return_sp;
+	uint32_t return_pc;
+} cycles_frame_t;
+
+// a byte waiting to be sent to the UART
+typedef struct {
+	avr_cycle_count_t time;
+	uint8_t byte;
+} cycles_byte_t;
+
+typedef struct {
+	avr_t* avr;
+	cycles_function_t function[CYCLES_MAX_FUNCTIONS];
+	uint8_t num_functions;
+	// the measured function starting at each word of the flash, 0 for none
+	cycles_function_t** function_at;
+	uint32_t flash_words;
+	cycles_frame_t frame[CYCLES_MAX_FRAMES];
+	uint8_t num_frames;
+	cycles_byte_t* byte;
+	uint32_t num_bytes;
+	uint32_t bytes_size;
+	avr_cycle_count_t wire_free;
+	avr_irq_t* uart_in;
+	avr_irq_t* spi_in;
+	uint8_t panel[CYCLES_NUM_SHIFTIN_REG];
+	uint8_t panel_pos;
+	bool panel_selected;
+} cycles_t;
+
+cycles_t cycles;
+
+//
+// the budgets and the symbols they refer to
+//
+
+cycles_function_t* cycles_find(const char* name) {
+	uint8_t i=0;
+	for(;i<cycles.num_functions;i++) {
+		if(strcmp(cycles.function[i].name, name) == 0) {
+			return cycles.function+i;
+		}
+	}
+	return 0;
+}
+
+// lines of a function or interrupt vector name followed by its budget in
+// cycles, # starts a comment
+bool cycles_read_budgets(const char* path) {
+	FILE* f = fopen(path, "r");
+	char line[256];
+	uint32_t n = 0;
+	if(!f) {
+		perror(path);
+		return false;
+	}
+	while(fgets(line, sizeof(line), f)) {
+		char name[CYCLES_NAME_LENGTH];
+		unsigned long budget;
+		n++;
+		if(strchr(line, '#')) {
+			*strchr(line, '#') = '\0';
+		}
+		if(strspn(line, " \t\r\n") == strlen(line)) {
+			continue;
+		}
+		if(sscanf(line, "%63s %lu", name, &budget) != 2 || cycles.num_functions == CYCLES_MAX_FUNCTIONS) {
+			fprintf(stderr, "%s:%u: expected a name and a number of cycles\n", path, n);
+			fclose(f);
+			return false;
+		}
+		cycles_function_t* fn = cycles.function+cycles.num_functions++;
+		memset(fn, 0, sizeof(*fn));
+		strcpy(fn->name, name);
+		fn->budget = budget;
+		fn->isr = strstr(name, "_vect") != 0;
+	}
+	fclose(f);
+	return true;
+}
+
+// the avr-nm -n output the firmware Makefile leaves in main.sym
+bool cycles_read_symbols(const char* path) {
+	FILE* f = fopen(path, "r");
+	char line[256];
+	uint8_t i=0;
+	if(!f) {
+		perror(path);
+		return false;
+	}
+	while(fgets(line, sizeof(line), f)) {
+		unsigned long address;
+		char type;
+		char name[CYCLES_NAME_LENGTH];
+		unsigned vector;
+		if(sscanf(line, "%lx %c %63s", &address, &type, name) != 3 || (type != 'T' && type != 't')) {
+			continue;
+		}
+		if(sscanf(name, "__vector_%u", &vector) == 1 && vector < CYCLES_NUM_VECTORS) {
+			strcpy(name, cycles_vector_name[vector]);
+		}
+		cycles_function_t* fn = cycles_find(name);
+		if(fn) {
+			fn->address = address;
+		}
+	}
+	fclose(f);
+	for(;i<cycles.num_functions;i++) {
+		cycles_function_t* fn = cycles.function+i;
+		if(fn->address == 0 || fn->address/2 >= cycles.flash_words) {
+			fprintf(stderr, "%s: no %s in the firmware\n", path, fn->name);
+			return false;
+		}
+		cycles.function_at[fn->address/2] = fn;
+	}
+	return true;
+}
+
+//
+// the MIDI script
+//
+
+void cycles_message(uint64_t time_us, const uint8_t* bytes, uint32_t length, void* context) {
+	uint32_t i=0;
+	avr_cycle_count_t time = time_us*CYCLES_PER_US;
+	for(;i<length;i++) {
+		if(cycles.num_bytes == cycles.bytes_size) {
+			cycles.bytes_size = cycles.bytes_size ? cycles.bytes_size*2 : 4096;
+			cycles.byte = realloc(cycles.byte, cycles.bytes_size*sizeof(cycles_byte_t));
+			if(!cycles.byte) {
+				fprintf(stderr, "out of memory\n");
+				exit(2);
+			}
+		}
+		// one byte after the other on the wire
+		if(time < cycles.wire_free) {
+			time = cycles.wire_free;
+		}
+		cycles.byte[cycles.num_bytes].time = time;
+		cycles.byte[cycles.num_bytes].byte = bytes[i];
+		cycles.num_bytes++;
+		cycles.wire_free = time+CYCLES_PER_BYTE;
+	}
+}
+
+//
+// the parts of the board around the controller
+//
+
+void cycles_sr_select(struct avr_irq_t* irq, uint32_t value, void* param) {
+	cycles.panel_selected = !value;
+	cycles.panel_pos = 0;
+}
+
+// the shift registers answer while selected, the DAC never does
+void cycles_spi_out(struct avr_irq_t* irq, uint32_t value, void* param) {
+	uint8_t reply = 0;
+	if(cycles.panel_selected && cycles.panel_pos < CYCLES_NUM_SHIFTIN_REG) {
+		reply = cycles.panel[cycles.panel_pos++];
+	}
+	avr_raise_irq(cycles.spi_in, reply);
+}
+
+//
+// measuring
+//
+
+uint16_t cycles_sp(void) {
+	return cycles.avr->data[R_SPL] | (cycles.avr->data[R_SPH]<<8);
+}
+
+void cycles_enter(cycles_function_t* fn, avr_cycle_count_t start) {
+	uint8_t* data = cycles.avr->data;
+	uint16_t sp = cycles_sp();
+	cycles_frame_t* frame;
+	if(cycles.num_frames == CYCLES_MAX_FRAMES) {
+		fprintf(stderr, "%s: calls nested too deep\n", fn->name);
+		exit(2);
+	}
+	frame = cycles.frame+cycles.num_frames++;
+	frame->function = fn;
+	frame->start = start;
+	frame->interrupted = 0;
+	// the return address sits right on top of the stack - high byte first
+	frame->return_sp = sp+2;
+	frame->return_pc = ((data[sp+1]<<8) | data[sp+2])*2;
+}
+
+void cycles_leave(avr_cycle_count_t now) {
+	cycles_frame_t* frame = cycles.frame+(--cycles.num_frames);
+	cycles_function_t* fn = frame->function;
+	avr_cycle_count_t total = now - frame->start;
+	uint32_t spent = total - frame->interrupted;
+	// interrupts are not counted for the code they cut in on - nor for the
+	// functions further up that code got called from
+	if(cycles.num_frames) {
+		cycles.frame[cycles.num_frames-1].interrupted += fn->isr ? total : frame->interrupted;
+	}
+	fn->calls++;
+	fn->sum += spent;
+	if(spent > fn->max) {
+		fn->max = spent;
+		fn->max_at = frame->start;
+	}
+}
+
+// runs the firmware up to end with the script starting at offset
+void cycles_run(avr_cycle_count_t offset, avr_cycle_count_t end) {
+	avr_t* avr = cycles.avr;
+	uint32_t next_byte = 0;
+	uint32_t last_pc = ~0;
+	// where the last jump into the vector table happened
+	avr_cycle_count_t vector_cycle = 0;
+	while(avr->cycle < end) {
+		uint32_t pc = avr->pc;
+		if(pc != last_pc) {
+			if(pc < CYCLES_VECTOR_TABLE_END) {
+				vector_cycle = avr->cycle;
+			}
+			while(cycles.num_frames) {
+				cycles_frame_t* top = cycles.frame+cycles.num_frames-1;
+				if(pc == top->return_pc && cycles_sp() == top->return_sp) {
+					cycles_leave(avr->cycle);
+				} else if(cycles_sp() > top->return_sp) {
+					// gone without returning - nothing sensible to count
+					cycles.num_frames--;
+				} else {
+					break;
+				}
+			}
+			cycles_function_t* fn = pc/2 < cycles.flash_words ? cycles.function_at[pc/2] : 0;
+			if(fn) {
+				cycles_enter(fn, fn->isr ? vector_cycle : avr->cycle);
+			}
+			last_pc = pc;
+		}
+		while(next_byte < cycles.num_bytes && offset+cycles.byte[next_byte].time <= avr->cycle) {
+			avr_raise_irq(cycles.uart_in, cycles.byte[next_byte++].byte);
+		}
+		int state = avr_run(avr);
+		if(state == cpu_Done || state == cpu_Crashed) {
+			fprintf(stderr, "the firmware %s at pc 0x%04x after %llu cycles\n",
+					state == cpu_Done ? "stopped" : "crashed", avr->pc, (unsigned long long)avr->cycle);
+			exit(2);
+		}
+	}
+}
+
+// prints the results and counts the functions over budget
+uint8_t cycles_report(void) {
+	uint8_t failed = 0;
+	uint8_t i=0;
+	printf("# name calls mean max budget max_at_us verdict\n");
+	for(;i<cycles.num_functions;i++) {
+		cycles_function_t* fn = cycles.function+i;
+		const char* verdict = "ok";
+		if(fn->calls == 0) {
+			// inlined or not exercised by the script - either way not measured
+			verdict = "NOT_REACHED";
+			failed++;
+		} else if(fn->max > fn->budget) {
+			verdict = "OVER_BUDGET";
+			failed++;
+		}
+		printf("%s %u %.1f %u %u %llu %s\n", fn->name, fn->calls,
+				fn->calls ? (double)fn->sum/fn->calls : 0.0, fn->max, fn->budget,
+				(unsigned long long)(fn->max_at/CYCLES_PER_US), verdict);
+	}
+	return failed;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,
+			"usage: %s [-c channel] [-l] [-t ms] -b budgets firmware.elf firmware.sym script\n"
+			"Runs the firmware in simavr as an %s at %lu Hz, plays the script (a\n"
+			"Standard MIDI File or raw MIDI as taken by sim/replay) to its MIDI in -\n"
+			"once in polyphonic and once in unison mode - and prints the cycles taken\n"
+			"by every function and interrupt in the budgets file. Fails if any of them\n"
+			"ever took longer than its budget or never got called at all.\n"
+			"  -b budgets  lines of a function or vector name (like USART_RXC_vect)\n"
+			"              and its budget in cycles\n"
+			"  -c channel  MIDI channel set on the panel, 1 to 16 (default 1)\n"
+			"  -l          LFOs and clocks on the aux outputs\n"
+			"  -t ms       keep running this long after the last byte (default %u)\n",
+			name, CYCLES_MCU, CYCLES_F_CPU, CYCLES_DEFAULT_TAIL_MS);
+}
+
+int main(int argc, char** argv) {
+	elf_firmware_t firmware;
+	const char* budgets = 0;
+	uint8_t channel = 0;
+	bool lfo_clock_out = false;
+	unsigned long tail_ms = CYCLES_DEFAULT_TAIL_MS;
+	size_t size;
+	uint32_t flags = 0;
+	int opt;
+	while((opt = getopt(argc, argv, "b:c:lt:h")) != -1) {
+		switch(opt) {
+			case 'b':
+				budgets = optarg;
+				break;
+			case 'c':
+				channel = atoi(optarg)-1;
+				if(channel > 15) {
+					usage(argv[0]);
+					return 2;
+				}
+				break;
+			case 'l':
+				lfo_clock_out = true;
+				break;
+			case 't':
+				tail_ms = strtoul(optarg, 0, 10);
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+	if(!budgets || optind != argc-3) {
+		usage(argv[0]);
+		return 2;
+	}
+
+	memset(&cycles, 0, sizeof(cycles));
+	memset(&firmware, 0, sizeof(firmware));
+	if(elf_read_firmware(argv[optind], &firmware)) {
+		fprintf(stderr, "%s: no firmware\n", argv[optind]);
+		return 2;
+	}
+	cycles.avr = avr_make_mcu_by_name(CYCLES_MCU);
+	if(!cycles.avr) {
+		fprintf(stderr, "simavr knows no %s\n", CYCLES_MCU);
+		return 2;
+	}
+	avr_init(cycles.avr);
+	avr_load_firmware(cycles.avr, &firmware);
+	cycles.avr->frequency = CYCLES_F_CPU;
+
+	cycles.flash_words = (cycles.avr->flashend+1)/2;
+	cycles.function_at = calloc(cycles.flash_words, sizeof(cycles_function_t*));
+	if(!cycles_read_budgets(budgets) || !cycles_read_symbols(argv[optind+1])) {
+		return 2;
+	}
+
+	char* data = raw_load(argv[optind+2], &size);
+	if(!data) {
+		return 2;
+	}
+	bool ok = smf_detect((uint8_t*)data, size) ? smf_read((uint8_t*)data, size, cycles_message, 0) : raw_read(data, cycles_message, 0);
+	free(data);
+	if(!ok) {
+		fprintf(stderr, "%s: broken script\n", argv[optind+2]);
+		return 2;
+	}
+
+	// MIDI in - the bytes are not meant for the console
+	cycles.uart_in = avr_io_getirq(cycles.avr, AVR_IOCTL_UART_GETIRQ('0'), UART_IRQ_INPUT);
+	avr_ioctl(cycles.avr, AVR_IOCTL_UART_GET_FLAGS('0'), &flags);
+	flags &= ~AVR_UART_FLAG_STDIO;
+	avr_ioctl(cycles.avr, AVR_IOCTL_UART_SET_FLAGS('0'), &flags);
+	// the panel behind the shift registers
+	cycles.panel[0] = channel | CYCLES_PANEL_MODE_BIT0 | (lfo_clock_out ? CYCLES_PANEL_LFO_CLOCK_ENABLE : 0);
+	cycles.spi_in = avr_io_getirq(cycles.avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_INPUT);
+	avr_irq_register_notify(avr_io_getirq(cycles.avr, AVR_IOCTL_SPI_GETIRQ(0), SPI_IRQ_OUTPUT), cycles_spi_out, 0);
+	avr_irq_register_notify(avr_io_getirq(cycles.avr, AVR_IOCTL_IOPORT_GETIRQ(CYCLES_SR_CE_PORT), CYCLES_SR_CE_PIN), cycles_sr_select, 0);
+	// the button is not pressed
+	avr_raise_irq(avr_io_getirq(cycles.avr, AVR_IOCTL_IOPORT_GETIRQ(CYCLES_BUTTON_PORT), CYCLES_BUTTON_PIN), 1);
+
+	avr_cycle_count_t tail = tail_ms*1000*CYCLES_PER_US;
+	cycles_run(0, cycles.wire_free+tail);
+	// flip the mode switch and play it all again once the panel got read
+	cycles.panel[0] &= ~CYCLES_PANEL_MODE_BIT0;
+	avr_cycle_count_t offset = cycles.avr->cycle+tail;
+	cycles_run(offset, offset+cycles.wire_free+tail);
+	return cycles_report() ? 1 : 0;
+}
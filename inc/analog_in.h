@@ -1,8 +1,53 @@
 #ifndef _ANALOG_IN_H_
 #define _ANALOG_IN_H_
 #include <stdint.h>
+#include <stdbool.h>
 
+// one bit per ADC channel to scan - the pots are on ADC2 to ADC5
+#ifndef ANALOG_IN_CHANNELS
+#pragma message "ANALOG_IN_CHANNELS not defined - defaulting to 0x3c"
+#define ANALOG_IN_CHANNELS	(0x3c)
+#endif
+#define ANALOG_IN_BIT(channel)	(1<<(channel))
+#define NUM_ANALOG_IN_CHANNELS	(8)
+
+// conversions averaged into a single value (the one right after switching
+// channels is thrown away on top of those) - 1, 2, 4, 8, 16, 32 or 64
+#define ANALOG_IN_OVERSAMPLING	(8)
+// a value needs to move this far before it counts as changed
+#define ANALOG_IN_HYSTERESIS	(4)
+#define ANALOG_IN_MAX			(1023)
+
+/**
+ * \brief Function to initalize the ADC
+ * \description This function sets up the ADC for interrupt driven
+ * conversions and scans all ANALOG_IN_CHANNELS once. Interrupts need to be
+ * enabled for the scan to run.
+ */
 void init_analogin(void);
+
+/**
+ * \brief Function to start a scan of all ANALOG_IN_CHANNELS
+ * \description This function returns right away, the channels get converted
+ * one after another by the ADC interrupt. Nothing happens if there is a
+ * scan running already.
+ */
+void analog_in_start_scan(void);
+
+/**
+ * \brief Function to get the latest value of a channel
+ * \description This function never waits for the ADC. The value only
+ * follows the input once it moved by more than ANALOG_IN_HYSTERESIS.
+ * \param in channel the ADC channel
+ * \return the value from 0 to ANALOG_IN_MAX
+ */
 uint16_t analog_read(uint8_t channel);
 
+/**
+ * \brief Function to get the channels which changed their value
+ * \description The changes get cleared by this call.
+ * \return ANALOG_IN_BIT of each changed channel
+ */
+uint8_t analog_in_changes(void);
+
 #endif
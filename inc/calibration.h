@@ -0,0 +1,74 @@
+#ifndef _CALIBRATION_H_
+#define _CALIBRATION_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef NUM_PLAY_NOTES
+#pragma message "NUM_PLAY_NOTES not defined - defaulting to 4"
+#define NUM_PLAY_NOTES	(4)
+#endif
+
+// the DAC value of each C from C1 (note 12) up to C11 (note 132)
+#define NUM_CALIBRATION_POINTS	(11)
+// bytes of a calibration in the EEPROM - each difference as int16 little endian
+#define CALIBRATION_PACKED_SIZE	(NUM_PLAY_NOTES*NUM_CALIBRATION_POINTS*2)
+
+typedef struct calibration_t calibration_t;
+
+/**
+ * The tuning of each voice is kept as the difference of each point to the
+ * default tuning - half the size of the DAC values themselves (those need
+ * 17 bits). The default tuning is in flash.
+ */
+struct calibration_t {
+	int16_t delta[NUM_PLAY_NOTES][NUM_CALIBRATION_POINTS];
+};
+
+/**
+ * \brief the default DAC value of each calibration point
+ */
+extern const uint32_t calibration_default[NUM_CALIBRATION_POINTS];
+
+/**
+ * \brief Function to reset a calibration to the default tuning
+ * \param in c the calibration
+ */
+void calibration_init(calibration_t* c);
+
+/**
+ * \brief Function to get the DAC value of a calibration point
+ * \param in c the calibration
+ * \param in voice the voice
+ * \param in point the calibration point
+ * \return the DAC value
+ */
+uint32_t calibration_voltage(const calibration_t* c, uint8_t voice, uint8_t point);
+
+/**
+ * \brief Function to tune a calibration point up or down
+ * \description The difference to the default sticks at its limits instead
+ * of wrapping around.
+ * \param in c the calibration
+ * \param in voice the voice
+ * \param in point the calibration point
+ * \param in step the change of the DAC value
+ */
+void calibration_adjust(calibration_t* c, uint8_t voice, uint8_t point, int16_t step);
+
+/**
+ * \brief Function to get a single byte of the packed calibration
+ * \param in c the calibration
+ * \param in position the byte from 0 to CALIBRATION_PACKED_SIZE-1
+ * \return the byte
+ */
+uint8_t calibration_get_byte(const calibration_t* c, uint16_t position);
+
+/**
+ * \brief Function to put back a single byte of the packed calibration
+ * \param in c the calibration
+ * \param in position the byte from 0 to CALIBRATION_PACKED_SIZE-1
+ * \param in byte the byte
+ */
+void calibration_put_byte(calibration_t* c, uint16_t position, uint8_t byte);
+
+#endif
@@ -4,11 +4,50 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+// each MIDI CLOCK_SIGNAL (24 per quarter note) gets split up into
+// CLOCK_MULTIPLIER sub-clocks - 4 makes 96 sub-clocks per quarter note
+#define CLOCK_MULTIPLIER		(4)
+#define NUM_CLOCK_TRIGGER_MODES	(16)
+
+// length of a single trigger pulse on the clock outputs
+#ifndef CLOCK_TRIGGER_PULSE_US
+#pragma message "CLOCK_TRIGGER_PULSE_US not defined - defaulting to 5000"
+#define CLOCK_TRIGGER_PULSE_US	(5000)
+#endif
+
 typedef struct clock_trigger_t clock_trigger_t;
 
 struct clock_trigger_t {
 	uint8_t mode;
-	uint8_t active_countdown;
+	bool active;
+	uint32_t off_time;
 };
 
+/**
+ * \brief the trigger divisions in sub-clocks for each mode
+ * \description 96 sub-clocks make a quarter note. Going from 2 bars down to
+ * 96 pulses per quarter note, including dotted and triplet divisions.
+ * The table is in flash - read it with pgm_read_word.
+ */
+extern const uint16_t clock_trigger_division[NUM_CLOCK_TRIGGER_MODES];
+
+/**
+ * \brief Function to check whether a trigger fires on a sub-clock
+ * \param in t the clock trigger (its mode selects the division)
+ * \param in subclock_counter the sub-clock that is about to be played
+ * \return wether or not a new trigger pulse starts on this sub-clock
+ */
+bool clock_trigger_fires(clock_trigger_t* t, uint32_t subclock_counter);
+
+/**
+ * \brief Function to get the length of the next trigger pulse
+ * \description The pulse is limited to half the time between two triggers
+ * of this output so fast divisions still give separate pulses.
+ * \param in t the clock trigger
+ * \param in subclock_interval the measured time between two sub-clocks
+ * \param in pulse_width the desired pulse width (same unit as the interval)
+ * \return the pulse width to use
+ */
+uint32_t clock_trigger_pulse_width(clock_trigger_t* t, uint32_t subclock_interval, uint32_t pulse_width);
+
 #endif
@@ -0,0 +1,73 @@
+#ifndef _EEPROM_STORE_H_
+#define _EEPROM_STORE_H_
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * The EEPROM is split up into as many slots as there is space for a record.
+ * Each record belongs to an id (e.g. a preset) and a save goes into the
+ * slot holding the oldest record which has been replaced by a newer one
+ * already - so the writes are spread over the whole EEPROM and the last
+ * good record of an id survives a power loss half way through. There has
+ * to be at least one more slot than ids for that. A record looks like this:
+ *
+ *   <version> <sequence, 4 bytes little endian> <id> <data...> <crc16 low> <crc16 high>
+ *
+ * The crc16 covers everything from the version up to the last data byte,
+ * the sequence counts up on each save to tell the newest record. It is
+ * 32 bits wide so it never wraps around and records of different ids can
+ * be compared by it.
+ */
+#define EEPROM_STORE_HEADER_SIZE	(6)
+#define EEPROM_STORE_RECORD_SIZE(size)	(EEPROM_STORE_HEADER_SIZE+(size)+2)
+#define EEPROM_STORE_MAX_SLOTS		(8)
+#define EEPROM_STORE_NO_ID			(0xff)
+
+/**
+ * The data is kept in RAM in whatever way suits its users best - these
+ * functions turn it into the bytes stored in the EEPROM and back again.
+ */
+typedef uint8_t (*eeprom_store_get_t)(const void* data, uint16_t position);
+typedef void (*eeprom_store_put_t)(void* data, uint16_t position, uint8_t byte);
+
+/**
+ * \brief Function to set up the store
+ * \description This function looks up all valid records in the EEPROM
+ * and forgets about any save still running. Only call it with interrupts
+ * disabled.
+ * \param in version the format of the data - records of any other version are ignored
+ * \param in size the size of the stored data in bytes
+ * \param in get function to get a single byte to store from the data
+ * \param in put function to put a single stored byte back into the data
+ * \return the number of slots
+ */
+uint8_t eeprom_store_init(uint8_t version, uint16_t size, eeprom_store_get_t get, eeprom_store_put_t put);
+
+/**
+ * \brief Function to read the newest valid record of an id
+ * \description This function waits for a running save to be finished -
+ * check eeprom_store_busy first to never wait.
+ * \param in id the id of the record
+ * \param out data the data of the record - untouched if there is none
+ * \return wether or not there has been a valid record
+ */
+bool eeprom_store_load(uint8_t id, void* data);
+
+/**
+ * \brief Function to save a record in the background
+ * \description This function returns right away, the EE_READY interrupt
+ * writes one byte after another (bytes already holding the right value are
+ * skipped). Calling it again while still busy saves the given data right
+ * after the running save. Leave the data alone until the save is done.
+ * \param in id the id of the record
+ * \param in data the data to save
+ */
+void eeprom_store_save(uint8_t id, const void* data);
+
+/**
+ * \brief Function to check for a running save
+ * \return wether or not there is a save running
+ */
+bool eeprom_store_busy(void);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef _ENVELOPE_H_
+#define _ENVELOPE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// one envelope per voice
+#define NUM_ENVELOPES	(NUM_PLAY_NOTES)
+#if NUM_ENVELOPES > 8
+#error "NUM_ENVELOPES must not exceed 8 - the gates are kept in a single byte"
+#endif
+
+#define ENVELOPE_IDLE		(0)
+#define ENVELOPE_ATTACK		(1)
+#define ENVELOPE_DECAY		(2)
+#define ENVELOPE_SUSTAIN	(3)
+#define ENVELOPE_RELEASE	(4)
+
+// levels are kept in 1/256 of a DAC step to allow for slow stages
+#define ENVELOPE_MAX		(0xffff00UL)
+
+typedef struct envelope_bank_t envelope_bank_t;
+
+/**
+ * All envelopes share a single set of stage parameters. The rates are the
+ * level change per tick, so advancing a stage is a single add (or subtract)
+ * and compare - all the divisions are done when a parameter gets set.
+ */
+struct envelope_bank_t {
+	uint32_t level[NUM_ENVELOPES];
+	uint8_t stage[NUM_ENVELOPES];
+	// the gates seen on the last call of envelope_set_gates
+	uint8_t gate;
+	// all envelopes follow the gate of any voice instead of their own
+	bool shared;
+	uint32_t attack_rate;
+	uint32_t decay_rate;
+	uint32_t sustain_level;
+	uint32_t release_rate;
+};
+
+/**
+ * \brief Function to initialize the envelopes
+ * \description All envelopes are idle at 0. The stages default to a short
+ * attack and release at full sustain - a plain gate with soft edges.
+ * \param in bank the envelopes
+ */
+void envelope_bank_init(envelope_bank_t* bank);
+
+/**
+ * \brief Function to set the length of the attack stage
+ * \param in bank the envelopes
+ * \param in ticks the number of ticks going from 0 to full level (at least 1)
+ */
+void envelope_set_attack(envelope_bank_t* bank, uint16_t ticks);
+
+/**
+ * \brief Function to set the length of the decay stage
+ * \param in bank the envelopes
+ * \param in ticks the number of ticks going from full level to 0 (at least 1)
+ */
+void envelope_set_decay(envelope_bank_t* bank, uint16_t ticks);
+
+/**
+ * \brief Function to set the sustain level
+ * \param in bank the envelopes
+ * \param in level the sustain level from 0 to 0xffff
+ */
+void envelope_set_sustain(envelope_bank_t* bank, uint16_t level);
+
+/**
+ * \brief Function to set the length of the release stage
+ * \param in bank the envelopes
+ * \param in ticks the number of ticks going from full level to 0 (at least 1)
+ */
+void envelope_set_release(envelope_bank_t* bank, uint16_t ticks);
+
+/**
+ * \brief Function to pass the current voice gates to the envelopes
+ * \description Only the transitions matter: a rising gate starts the attack
+ * from the current level, a falling gate starts the release.
+ * \param in bank the envelopes
+ * \param in gates one bit per voice, set while the voice is playing
+ */
+void envelope_set_gates(envelope_bank_t* bank, uint8_t gates);
+
+/**
+ * \brief Function to move all envelopes on by a single tick
+ * \param in bank the envelopes
+ */
+void envelope_bank_tick(envelope_bank_t* bank);
+
+/**
+ * \brief Function to get the current output of an envelope
+ * \param in bank the envelopes
+ * \param in n the envelope
+ * \return the envelope level ready for the DAC
+ */
+uint16_t envelope_value(envelope_bank_t* bank, uint8_t n);
+
+#ifndef __AVR__
+/**
+ * \brief Function to render many ticks of all envelopes at once on the host
+ * \description Gives exactly the same samples and leaves the bank in exactly
+ * the same state as length times envelope_bank_tick followed by
+ * envelope_value. Each stage is a straight line until it ends, so the block
+ * is filled stage by stage with loops the compiler can vectorize.
+ * \param in bank the envelopes
+ * \param out out the samples of envelope n at out[n*length] to out[n*length+length-1]
+ * \param in length the number of samples per envelope
+ */
+void envelope_bank_render_block(envelope_bank_t* bank, uint16_t* out, uint16_t length);
+#endif
+
+#endif
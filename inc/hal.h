@@ -0,0 +1,25 @@
+#ifndef _HAL_H_
+#define _HAL_H_
+
+/**
+ * The firmware touches the hardware in two ways: through the drivers
+ * (dac8568c, sr74hc165, uart, analog_in, eeprom_store, timebase, spi) and
+ * directly through a few GPIO and timer registers plus cli/sei and ISR.
+ * Include this header instead of <avr/io.h> and <avr/interrupt.h> wherever
+ * the latter is done outside of a driver.
+ *
+ * On the AVR this is just the avr-libc headers and the drivers in src/.
+ * Everywhere else (host tests, simulation) the registers are plain
+ * variables and the drivers are replaced by the mocks in hal_host.c - see
+ * hal_host.h. HAL_HOST is defined for the latter. eeprom_store, analog_in
+ * and stack_monitor are the exceptions: they run on the host as well, on
+ * the EEPROM bytes, ADC inputs and RAM mocked there.
+ */
+#ifdef __AVR__
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#else
+#include "hal_host.h"
+#endif
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef _HAL_HOST_H_
+#define _HAL_HOST_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "timebase.h"
+
+#define HAL_HOST
+
+// the registers used outside of the drivers - nothing happens on writing them
+extern volatile uint8_t PORTB, DDRB, PINB;
+extern volatile uint8_t PORTC, DDRC, PINC;
+extern volatile uint8_t PORTD, DDRD, PIND;
+extern volatile uint8_t TIMSK, TIFR, SREG;
+extern volatile uint16_t OCR1A, OCR1B;
+extern volatile uint8_t EECR;
+extern volatile uint8_t ADMUX, ADCSRA;
+
+#define PB0		(0)
+#define PB1		(1)
+#define PB2		(2)
+#define PB3		(3)
+#define PB4		(4)
+#define PB5		(5)
+#define PC0		(0)
+#define PC1		(1)
+#define PC2		(2)
+#define PC3		(3)
+#define PC4		(4)
+#define PC5		(5)
+#define PD0		(0)
+#define PD1		(1)
+#define PD2		(2)
+#define PD3		(3)
+#define PD4		(4)
+#define PD5		(5)
+#define PD6		(6)
+#define PD7		(7)
+#define OCIE1A	(4)
+#define OCIE1B	(3)
+#define OCF1A	(4)
+#define OCF1B	(3)
+#define EERIE	(3)
+#define REFS0	(6)
+#define ADEN	(7)
+#define ADSC	(6)
+#define ADIE	(3)
+#define ADPS2	(2)
+#define ADPS1	(1)
+#define ADPS0	(0)
+#define SREG_I	(7)
+
+// same memories as the ATmega8
+#define E2END	(0x1FF)
+#define RAMEND	(0x45F)
+
+#define cli()	(SREG &= ~(1<<SREG_I))
+#define sei()	(SREG |= (1<<SREG_I))
+// the interrupts become plain functions - call them to have them fire
+#define ISR(vector)	void vector(void)
+void USART_RXC_vect(void);
+void TIMER1_COMPA_vect(void);
+void TIMER1_COMPB_vect(void);
+void EE_RDY_vect(void);
+void ADC_vect(void);
+
+// the avr-libc functions used by eeprom_store - working on hal_host_eeprom
+uint8_t eeprom_read_byte(const uint8_t* address);
+void eeprom_update_byte(uint8_t* address, uint8_t value);
+uint16_t _crc16_update(uint16_t crc, uint8_t a);
+
+#define HAL_HOST_NUM_DAC_CHANNELS	(8)
+#define HAL_HOST_NUM_SHIFTIN_REG	(4)
+
+/**
+ * The state of the mocked hardware - set the inputs, check the outputs.
+ */
+// the current time for timebase_now
+extern timebase_t hal_host_time;
+// the last value written to each DAC channel
+extern uint16_t hal_host_dac[HAL_HOST_NUM_DAC_CHANNELS];
+// the switches read by sr74hc165_read
+extern uint8_t hal_host_panel[HAL_HOST_NUM_SHIFTIN_REG];
+// the voltages at the ADC inputs - set them with hal_host_set_analog_in
+extern uint16_t hal_host_analog_in[8];
+// the result of the conversion running - of the channel selected in ADMUX
+#define ADCW	(hal_host_analog_in[ADMUX & 0x07])
+// the byte uart_getc returns - set it before calling USART_RXC_vect
+extern uint8_t hal_host_uart_rx;
+// the EEPROM - a save runs as long as EE_RDY_vect gets called
+extern uint8_t hal_host_eeprom[E2END+1];
+// the RAM seen by stack_monitor, from address 0 to RAMEND - the variables
+// end at hal_host_ram_end and the stack pointer is at hal_host_sp, set
+// them with hal_host_set_stack
+extern uint8_t hal_host_ram[RAMEND+1];
+extern uint16_t hal_host_ram_end;
+extern uint16_t hal_host_sp;
+// the linker symbols and the stack pointer used by stack_monitor
+#define __data_start	(hal_host_ram[0x60])
+#define _end			(hal_host_ram[hal_host_ram_end])
+#define __stack			(hal_host_ram[RAMEND])
+#define SP				(hal_host_ram+hal_host_sp)
+
+// called on every DAC write and on every byte sent by the UART - may be 0
+typedef void (*hal_host_dac_hook_t)(uint8_t channel, uint16_t value);
+typedef void (*hal_host_uart_hook_t)(uint8_t byte);
+extern hal_host_dac_hook_t hal_host_dac_hook;
+extern hal_host_uart_hook_t hal_host_uart_tx_hook;
+
+/**
+ * \brief Function to move a pot
+ * \description The next scan started by analog_in_start_scan picks it up.
+ * \param in channel the ADC channel
+ * \param in value the value from 0 to ANALOG_IN_MAX
+ */
+void hal_host_set_analog_in(uint8_t channel, uint16_t value);
+
+/**
+ * \brief Function to fire ADC_vect until the running scan is done
+ */
+void hal_host_adc_finish(void);
+
+/**
+ * \brief Function to set the RAM usage stack_monitor finds
+ * \description Paints the RAM from the end of the variables up to the
+ * lowest stack pointer the way the AVR does at boot, everything above it
+ * counts as used by the stack.
+ * \param in variables the RAM taken by the variables in bytes
+ * \param in unused the RAM never used by the stack in bytes
+ * \param in free_now the RAM free right now in bytes, at least unused
+ */
+void hal_host_set_stack(uint16_t variables, uint16_t unused, uint16_t free_now);
+
+/**
+ * \brief Function to erase the whole EEPROM
+ */
+void hal_host_eeprom_clear(void);
+
+/**
+ * \brief Function to fire EE_RDY_vect until the running saves are written
+ */
+void hal_host_eeprom_finish(void);
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef _LATENCY_H_
+#define _LATENCY_H_
+
+#include <stdint.h>
+#include "timebase.h"
+#include "ringbuffer.h"
+#include "stats.h"
+
+// the MIDI messages measured in a latency build - each one from its last
+// byte being received up to the end of the task putting it out
+#define LATENCY_NOTE_ON		(0) // pitch and gate written by update_dac
+#define LATENCY_NOTE_OFF	(1) // gate cleared by update_dac
+#define LATENCY_CONTROL_CHANGE	(2) // CC output written by update_dac
+#define LATENCY_CLOCK		(3) // trigger dividers and LFO sync moved on by the clock task
+#define NUM_LATENCY_CLASSES	(4)
+
+#define LATENCY_CLASS_BIT(c)	(1<<(c))
+
+// two buckets per octave: bucket 0 counts everything below 256 ticks (128us),
+// the last one everything from 32768 ticks (16.4ms) on
+#define NUM_LATENCY_BUCKETS	(16)
+#define LATENCY_FIRST_OCTAVE	(8)
+
+// messages handled but not put out yet
+#define LATENCY_PENDING		(8)
+
+// F0 7D 03 <class> followed by count, min, max, mean and the histogram -
+// each one 16 bit value sent as 3 data bytes (2, 7 and 7 bits) - and F7
+#define LATENCY_SYSEX_ID		(0x7d)
+#define LATENCY_SYSEX_TYPE		(0x03)
+#define LATENCY_SYSEX_LENGTH	(4+STATS_SYSEX_LENGTH(NUM_LATENCY_BUCKETS)+1)
+
+#ifdef LATENCY
+
+/**
+ * \brief Function to get the histogram bucket of a latency
+ * \param in ticks the latency in timebase ticks
+ * \return the bucket from 0 to NUM_LATENCY_BUCKETS-1
+ */
+uint8_t latency_bucket(uint16_t ticks);
+
+/**
+ * \brief Function to get the lowest latency counted by a bucket
+ * \param in bucket the bucket
+ * \return the latency in timebase ticks
+ */
+uint16_t latency_bucket_start(uint8_t bucket);
+
+typedef struct latency_t latency_t;
+
+/**
+ * Latencies of a single message class in timebase ticks. Only the lower 16
+ * bit are kept - anything taking longer than 32ms gets counted wrong.
+ */
+struct latency_t {
+	stats_t stats;
+	uint16_t histogram[NUM_LATENCY_BUCKETS];
+};
+
+extern latency_t latency[NUM_LATENCY_CLASSES];
+// the time each byte in the MIDI input buffer got received
+extern uint16_t latency_received[RINGBUFFER_SIZE];
+
+// put this into the receive interrupt right before the byte goes to position
+#define LATENCY_RECEIVED(position)	latency_received[(position)] = (uint16_t)timebase_now()
+
+/**
+ * \brief Function to clear all classes
+ */
+void latency_init(void);
+
+/**
+ * \brief Function to note down a message just handled
+ * \description The latency gets recorded by the next latency_output for its
+ * class. If there are LATENCY_PENDING messages waiting already this one
+ * does not get measured.
+ * \param in c the message class
+ * \param in position the position of its last byte in the MIDI input buffer
+ */
+void latency_handled(uint8_t c, uint8_t position);
+
+/**
+ * \brief Function to record the latencies of all messages put out right now
+ * \param in classes the LATENCY_CLASS_BITs of the classes put out
+ */
+void latency_output(uint8_t classes);
+
+/**
+ * \brief Function to add a latency to a class
+ * \description Once a class got counted 0xffff times all its counts are
+ * halved just like the profiling does.
+ * \param in c the message class
+ * \param in ticks the latency in timebase ticks
+ */
+void latency_record(uint8_t c, uint16_t ticks);
+
+/**
+ * \brief Function to put a class into a SysEx message
+ * \param in c the message class
+ * \param out out LATENCY_SYSEX_LENGTH bytes ready to be sent
+ * \return the number of bytes written to out
+ */
+uint8_t latency_sysex(uint8_t c, uint8_t* out);
+
+#ifndef __AVR__
+// on the host every single latency gets handed to this as well - may be 0
+typedef void (*latency_hook_t)(uint8_t c, uint16_t ticks);
+extern latency_hook_t latency_hook;
+#endif
+
+#define LATENCY_HANDLED(c, position)	latency_handled(c, position)
+#define LATENCY_OUTPUT(classes)			latency_output(classes)
+
+#else
+
+#define LATENCY_RECEIVED(position)
+#define LATENCY_HANDLED(c, position)
+#define LATENCY_OUTPUT(classes)
+
+#endif
+
+#endif
@@ -3,35 +3,151 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "timebase.h"
 
-#define TRIANGLE	(0)
-#define PULSE		(1)
-#define SAWTOOTH	(2)
+// the shapes are numbered the way the wave switches on the panel select them
+#define REV_SAWTOOTH	(0)
+#define TRIANGLE		(1)
+#define PULSE			(2)
+#define SAWTOOTH		(3)
+// random shapes - a new random value is drawn at the start of each cycle
+#define SAMPLE_HOLD		(4)
+#define SMOOTH_RANDOM	(5)
+#define RANDOM_GATE		(6)
+#define NUM_LFO_SHAPES	(7)
 
 #define LFO_TABLE_LENGTH		(0xffff)
 #define LFO_HALF_TABLE_LENGTH	(0x7fff)
 
-extern uint16_t clock_limit[];
+// the LFO moves on by its stepwidth every LFO_TICK
+#define LFO_TICK				US_TO_TIMEBASE(4096)
 
-typedef struct lfo_t lfo_t;
+#ifndef NUM_LFO
+#pragma message "NUM_LFO not defined - defaulting to 2"
+#define NUM_LFO		(2)
+#endif
+#if NUM_LFO > 8
+#error "NUM_LFO must not exceed 8 - the per LFO flags are kept in a single byte"
+#endif
+
+// the bit of a single LFO in clock_sync and retrigger_on_new_note
+#define LFO_BIT(n)	(1<<(n))
 
-typedef uint16_t (*get_lfo_value_t)(lfo_t* lfo);
+// in flash - read with pgm_read_word
+extern const uint16_t clock_limit[];
 
-struct lfo_t {
-	bool clock_sync;
-	bool retrigger_on_new_note;
-	uint16_t stepwidth;
-	uint32_t position;
-	uint32_t last_cycle_completed_tick;
-	uint16_t clock_counter;
-	uint8_t clock_mode;
-	get_lfo_value_t get_value;
+typedef struct lfo_bank_t lfo_bank_t;
+
+/**
+ * All LFOs are kept as struct-of-arrays. Advancing them is the same for
+ * every shape, rendering their values is done in one loop per shape over
+ * the LFOs having that shape - so there is no call per LFO and sample.
+ * Only change shape, clock_mode and clock_sync through the setters below,
+ * they keep the shape groups and the synced stepwidths up to date.
+ */
+struct lfo_bank_t {
+	uint16_t position[NUM_LFO];
+	uint16_t stepwidth[NUM_LFO];
+	uint16_t value[NUM_LFO];
+	uint8_t clock_mode[NUM_LFO];
+	uint8_t shape[NUM_LFO];
+	uint8_t clock_sync;
+	uint8_t retrigger_on_new_note;
+	// the MIDI clock period the synced stepwidths were calculated for
+	uint32_t midiclock_period;
+	// the LFOs which started a new cycle since the last render
+	uint8_t new_cycle;
+	uint16_t random_seed;
+	uint16_t random_value[NUM_LFO];
+	uint16_t random_last[NUM_LFO];
+	uint8_t shape_count[NUM_LFO_SHAPES];
+	uint8_t shape_member[NUM_LFO_SHAPES][NUM_LFO];
 };
 
+/**
+ * \brief Function to initialize the LFO bank
+ * \description All LFOs start free running as triangle with the slowest
+ * stepwidth at position 0.
+ * \param in bank the LFO bank
+ */
+void lfo_bank_init(lfo_bank_t* bank);
+
+/**
+ * \brief Function to set the shape of a single LFO
+ * \param in bank the LFO bank
+ * \param in n the LFO
+ * \param in shape one of the shapes above (anything else is ignored)
+ */
+void lfo_set_shape(lfo_bank_t* bank, uint8_t n, uint8_t shape);
+
+/**
+ * \brief Function to switch a single LFO between free running and clock synced
+ * \param in bank the LFO bank
+ * \param in n the LFO
+ * \param in sync whether or not the LFO follows the MIDI clock
+ */
+void lfo_set_clock_sync(lfo_bank_t* bank, uint8_t n, bool sync);
 
-extern get_lfo_value_t lfo_get_rev_sawtooth;
-extern get_lfo_value_t lfo_get_sawtooth;
-extern get_lfo_value_t lfo_get_pulse;
-extern get_lfo_value_t lfo_get_triangle;
+/**
+ * \brief Function to set the clock_limit entry a synced LFO uses as cycle length
+ * \param in bank the LFO bank
+ * \param in n the LFO
+ * \param in clock_mode the index into clock_limit
+ */
+void lfo_set_clock_mode(lfo_bank_t* bank, uint8_t n, uint8_t clock_mode);
+
+/**
+ * \brief Function to start a single LFO all over again
+ * \description Used for retriggering on new notes and for staying in sync with
+ * the MIDI clock. Random shapes draw their next value on the next render.
+ * \param in bank the LFO bank
+ * \param in n the LFO
+ */
+void lfo_restart(lfo_bank_t* bank, uint8_t n);
+
+/**
+ * \brief Function to get the next value of the xorshift generator
+ * \description A 16 bit xorshift - only a couple of shifts and xors, which is
+ * cheap enough to be called from the LFO update.
+ * \param in bank the LFO bank holding the generator state
+ * \return the next pseudo random value (never 0)
+ */
+uint16_t lfo_random(lfo_bank_t* bank);
+
+/**
+ * \brief Function to move all LFOs on by the ticks passed since their last update
+ * \description Advancing by n ticks at once gives exactly the same positions
+ * as advancing n times by a single tick. Clock synced LFOs recalculate their
+ * stepwidth first whenever the MIDI clock period changed.
+ * \param in bank the LFO bank
+ * \param in elapsed_ticks the number of LFO_TICKs passed since the last update
+ * \param in midiclock_period the timebase ticks between the last two MIDI clocks,
+ * 0 or MAX_MIDICLOCK_PERIOD and up for no tempo - the synced LFOs keep going
+ * the way they did
+ */
+void lfo_bank_advance(lfo_bank_t* bank, uint8_t elapsed_ticks, uint32_t midiclock_period);
+
+/**
+ * \brief Function to calculate the current value of all LFOs
+ * \description The results are left in bank->value, ready for the DAC.
+ * \param in bank the LFO bank
+ */
+void lfo_bank_render(lfo_bank_t* bank);
+
+#ifndef __AVR__
+/**
+ * \brief Function to render many LFO updates at once on the host
+ * \description Gives exactly the same samples and leaves the bank in exactly
+ * the same state as length times lfo_bank_advance followed by
+ * lfo_bank_render - only the loops run over the samples of one LFO and shape
+ * instead of over the LFOs of one sample, so the compiler can vectorize them.
+ * \param in bank the LFO bank
+ * \param in elapsed_ticks the number of LFO_TICKs passed between two samples
+ * \param in midiclock_period the timebase ticks between the last two MIDI clocks
+ * \param out out the samples of LFO n at out[n*length] to out[n*length+length-1]
+ * \param in length the number of samples per LFO
+ */
+void lfo_bank_render_block(lfo_bank_t* bank, uint8_t elapsed_ticks, uint32_t midiclock_period, uint16_t* out, uint16_t length);
+#endif
 
 #endif
@@ -19,6 +19,7 @@
 #define NOTE_ON_NIBBLE		(0x9)
 #define NOTE_OFF_NIBBLE		(0x8)
 #define CONTROL_CHANGE(x)	((0xB0)|(x))
+#define PROGRAM_CHANGE(x)	((0xC0)|(x))
 #define PITCH_BEND(x)		((0xE0)|(x))
 #define ALL_NOTES_OFF(x)	((x>=123) && (x<=127))
 #define MOD_WHEEL			(0x1)
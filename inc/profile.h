@@ -0,0 +1,87 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include <stdint.h>
+#include "timebase.h"
+#include "stats.h"
+
+// the hot paths measured in a profiling build
+#define PROFILE_UPDATE_DAC			(0)
+#define PROFILE_UPDATE_NOTES		(1)
+#define PROFILE_MIDIBUFFER_GET		(2)
+#define PROFILE_UPDATE_LFO			(3)
+#define PROFILE_ISR_USART_RXC		(4)
+#define PROFILE_ISR_TIMER1_COMPA	(5)
+#define PROFILE_ISR_TIMER1_COMPB	(6)
+#define NUM_PROFILE_PATHS			(7)
+
+// bucket n counts the durations from 4^n up to 4^(n+1)-1 timebase ticks -
+// bucket 0 starts at 0 and the last one takes everything above
+#define NUM_PROFILE_BUCKETS			(8)
+
+// F0 7D 01 <path> followed by count, min, max, mean and the histogram - each
+// one 16 bit value sent as 3 data bytes (2, 7 and 7 bits) - and F7
+#define PROFILE_SYSEX_ID			(0x7d)
+#define PROFILE_SYSEX_TYPE			(0x01)
+#define PROFILE_SYSEX_LENGTH		(4+STATS_SYSEX_LENGTH(NUM_PROFILE_BUCKETS)+1)
+
+#ifdef PROFILING
+
+typedef struct profile_t profile_t;
+
+/**
+ * Durations of a single hot path in timebase ticks (8 CPU cycles @16MHz).
+ * Interrupts hitting a path while it runs are counted in as well.
+ */
+struct profile_t {
+	stats_t stats;
+	uint16_t histogram[NUM_PROFILE_BUCKETS];
+};
+
+extern profile_t profile[NUM_PROFILE_PATHS];
+
+// put these at the start and at the end of a path within the same block
+#define PROFILE_BEGIN(path)	uint16_t profile_start_##path = (uint16_t)timebase_now()
+#define PROFILE_END(path)	profile_record(path, (uint16_t)timebase_now() - profile_start_##path)
+
+/**
+ * \brief Function to initialize the profiling
+ * \description This function clears all paths and measures the time taken
+ * by PROFILE_BEGIN and PROFILE_END themselves, which gets subtracted from
+ * every duration recorded later on.
+ */
+void profile_init(void);
+
+/**
+ * \brief Function to clear the durations of a single path
+ * \param in path the path
+ */
+void profile_reset(uint8_t path);
+
+/**
+ * \brief Function to add a duration to a path
+ * \description Once a path got counted 0xffff times all its counts are
+ * halved - the mean and the histogram keep following the latest durations.
+ * Not safe to be called for the same path from the main loop and from
+ * within interrupts.
+ * \param in path the path
+ * \param in ticks the duration in timebase ticks
+ */
+void profile_record(uint8_t path, uint16_t ticks);
+
+/**
+ * \brief Function to put a path into a SysEx message
+ * \param in path the path
+ * \param out out PROFILE_SYSEX_LENGTH bytes ready to be sent
+ * \return the number of bytes written to out
+ */
+uint8_t profile_sysex(uint8_t path, uint8_t* out);
+
+#else
+
+#define PROFILE_BEGIN(path)
+#define PROFILE_END(path)
+
+#endif
+
+#endif
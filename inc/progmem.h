@@ -0,0 +1,16 @@
+#ifndef _PROGMEM_H_
+#define _PROGMEM_H_
+#include <stdint.h>
+
+// read-only tables stay in flash on the device instead of taking up SRAM -
+// the host tests just read them like any other table
+#ifdef __AVR__
+#include <avr/pgmspace.h>
+#else
+#define PROGMEM
+#define pgm_read_byte(address)	(*(const uint8_t*)(address))
+#define pgm_read_word(address)	(*(const uint16_t*)(address))
+#define pgm_read_dword(address)	(*(const uint32_t*)(address))
+#endif
+
+#endif
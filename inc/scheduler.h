@@ -0,0 +1,68 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "timebase.h"
+
+typedef void (*task_function_t)(void);
+
+typedef struct task_t task_t;
+
+/**
+ * A task runs to completion once it got released - either by being posted
+ * or because its period came around. Of all released tasks the one with
+ * the lowest priority value runs first, tasks of the same priority run
+ * earliest deadline first. A task starting later than its deadline after
+ * being released counts as an overrun, just as a periodic task which is
+ * still waiting when its next period comes around.
+ */
+struct task_t {
+	task_function_t run;
+	// 0 is the most urgent
+	uint8_t priority;
+	// in timebase ticks - 0 for tasks only running when posted
+	timebase_t period;
+	// in timebase ticks after the release
+	timebase_t deadline;
+	volatile bool pending;
+	timebase_t release;
+	uint16_t overruns;
+};
+
+/**
+ * \brief Function to set up a single task
+ * \param in t the task
+ * \param in run the function doing the work
+ * \param in priority 0 is the most urgent
+ * \param in period the time between two runs for periodic tasks, 0 otherwise
+ * \param in deadline the time the task may wait after being released
+ */
+void task_init(task_t* t, task_function_t run, uint8_t priority, timebase_t period, timebase_t deadline);
+
+/**
+ * \brief Function to hand the task table to the scheduler
+ * \description Tasks are identified by their index in this table from here
+ * on. Periodic tasks get released for the first time one period from now.
+ * \param in tasks the task table
+ * \param in num_tasks the number of tasks in that table
+ */
+void scheduler_init(task_t* tasks, uint8_t num_tasks);
+
+/**
+ * \brief Function to release a task
+ * \description Safe to call from within interrupts. Posting an already
+ * released task keeps its original release time - it still runs only once.
+ * \param in id the index of the task
+ */
+void scheduler_post(uint8_t id);
+
+/**
+ * \brief Function to run the most urgent released task
+ * \description Call this in your main loop. Returning after each task gives
+ * the scheduler a chance to pick up more urgent tasks right away.
+ * \return wether or not a task was run
+ */
+bool scheduler_run_next(void);
+
+#endif
@@ -1,6 +1,6 @@
 #ifndef __SPI_H_
 #define __SPI_H_
-#include <avr/io.h>
+#include "hal.h"
 #include <stdint.h>
 
 #ifndef SPI_DDR
@@ -23,8 +23,36 @@
 #pragma message "SPI_SCK not defined - defaulting to PB5"
 #define SPI_SCK		PB5
 #endif
-// CHIP_SELECT line must be defined by the according init-function of the chip
-// and also set before spi_transfer and unset afterwards...
+// the CHIP_SELECT line is set up as output by the init-function of the chip -
+// spi_begin and spi_end take care of pulling it low and high again
+
+// SPI modes - CPOL and CPHA right where they go in SPCR
+#define SPI_MODE0	(0)
+#define SPI_MODE1	(1<<CPHA)
+#define SPI_MODE2	(1<<CPOL)
+#define SPI_MODE3	((1<<CPOL)|(1<<CPHA))
+
+// clock dividers - SPR1 and SPR0 in the lower bits, SPI2X on top of them
+#define SPI_CLOCK_DIV2		(0x04)
+#define SPI_CLOCK_DIV4		(0x00)
+#define SPI_CLOCK_DIV8		(0x05)
+#define SPI_CLOCK_DIV16		(0x01)
+#define SPI_CLOCK_DIV32		(0x06)
+#define SPI_CLOCK_DIV64		(0x02)
+#define SPI_CLOCK_DIV128	(0x03)
+
+typedef struct spi_device_t spi_device_t;
+
+/**
+ * Everything one chip needs the bus to be set to. The registers only get
+ * written on switching between chips which need different settings.
+ */
+struct spi_device_t {
+	uint8_t spcr;
+	uint8_t spsr;
+	volatile uint8_t* cs_port;
+	uint8_t cs_mask;
+};
 
 /**
  * Function to initialize the SPI-Interface except CS-Pin. Please initialize the
@@ -40,4 +68,36 @@ void init_spi(void);
  */
 uint8_t spi_transfer(uint8_t data);
 
+/**
+ * \brief Function to set up the bus settings of a chip
+ * \description The CS pin gets pulled high - its DDR has to be set by the
+ * init-function of the chip.
+ * \param in device the chip
+ * \param in mode SPI_MODE0 to SPI_MODE3
+ * \param in divider one of the SPI_CLOCK_DIV* values
+ * \param in cs_port the PORT register of the CS pin
+ * \param in cs_pin the CS pin
+ */
+void spi_device_init(spi_device_t* device, uint8_t mode, uint8_t divider, volatile uint8_t* cs_port, uint8_t cs_pin);
+
+/**
+ * \brief Function to start a transaction with a chip
+ * \description This function disables interrupts, sets up the bus for the
+ * chip and selects it. Everything up to spi_end is atomic, so transactions
+ * can be run from the main loop and from within interrupts alike. Keep them
+ * short - nothing else gets serviced in the meantime.
+ * \param in device the chip
+ * \return the interrupt state to be handed to spi_end
+ */
+uint8_t spi_begin(spi_device_t* device);
+
+/**
+ * \brief Function to finish a transaction with a chip
+ * \description This function deselects the chip and restores the
+ * interrupt state from before spi_begin.
+ * \param in device the chip
+ * \param in sreg the value returned by spi_begin
+ */
+void spi_end(spi_device_t* device, uint8_t sreg);
+
 #endif // __SPI_H_
@@ -0,0 +1,48 @@
+#ifndef _STACK_MONITOR_H_
+#define _STACK_MONITOR_H_
+#include <stdint.h>
+
+/**
+ * All RAM between the end of the variables (.data and .bss) and the top of
+ * the stack gets painted with STACK_MONITOR_CANARY before main is called.
+ * However deep the stack (ISRs included) ever grew, it overwrote the paint
+ * on its way - whatever is still painted at the bottom has never been used.
+ * There is no heap (no malloc) so all of this RAM belongs to the stack.
+ */
+#define STACK_MONITOR_CANARY		(0xc5)
+
+// F0 7D 02 followed by the RAM taken by variables, the most stack ever
+// used, the RAM never used and the RAM free right now (in bytes) - each one
+// 16 bit value sent as 3 data bytes (2, 7 and 7 bits) - and F7
+#define STACK_MONITOR_SYSEX_ID		(0x7d)
+#define STACK_MONITOR_SYSEX_TYPE	(0x02)
+#define STACK_MONITOR_SYSEX_LENGTH	(3+4*3+1)
+
+/**
+ * \brief Function to get the RAM taken by all variables
+ * \return the size of .data and .bss in bytes
+ */
+uint16_t stack_monitor_static(void);
+
+/**
+ * \brief Function to get the RAM never touched by the stack so far
+ * \description This function walks up the painted RAM from the bottom -
+ * keep it out of time critical code.
+ * \return the RAM between the variables and the lowest stack pointer ever in bytes
+ */
+uint16_t stack_monitor_unused(void);
+
+/**
+ * \brief Function to get the RAM free right now
+ * \return the RAM between the variables and the current stack pointer in bytes
+ */
+uint16_t stack_monitor_free(void);
+
+/**
+ * \brief Function to put the RAM usage into a SysEx message
+ * \param out out STACK_MONITOR_SYSEX_LENGTH bytes ready to be sent
+ * \return the number of bytes written to out
+ */
+uint8_t stack_monitor_sysex(uint8_t* out);
+
+#endif
@@ -0,0 +1,70 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdint.h>
+
+/**
+ * The measurements sent to MIDI OUT (profiling, latency and the stack
+ * monitor) share their SysEx encoding, the first two the way they keep
+ * their durations as well.
+ */
+
+/**
+ * \brief Function to put a 16 bit value into a SysEx message
+ * \description The value gets sent as 3 data bytes - its upper 2, middle
+ * 7 and lower 7 bits.
+ * \param out out the message
+ * \param in value the value
+ * \return the position right after the 3 bytes written
+ */
+uint8_t* sysex_put16(uint8_t* out, uint16_t value);
+
+// the number of data bytes stats_sysex writes
+#define STATS_SYSEX_LENGTH(num_buckets)	((4+(num_buckets))*3)
+
+typedef struct stats_t stats_t;
+
+/**
+ * Durations in timebase ticks - the histogram buckets are kept next to it
+ * by its owner, each one with its own number and meaning of buckets.
+ */
+struct stats_t {
+	uint16_t count;
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+};
+
+/**
+ * \brief Function to clear the durations
+ * \param in s the durations
+ * \param in histogram its num_buckets buckets
+ * \param in num_buckets the number of buckets
+ */
+void stats_reset(stats_t* s, uint16_t* histogram, uint8_t num_buckets);
+
+/**
+ * \brief Function to add a duration
+ * \description Once counted 0xffff times all counts are halved - the mean
+ * and the histogram keep following the latest durations.
+ * \param in s the durations
+ * \param in histogram its num_buckets buckets
+ * \param in num_buckets the number of buckets
+ * \param in bucket the bucket of the duration
+ * \param in ticks the duration in timebase ticks
+ */
+void stats_record(stats_t* s, uint16_t* histogram, uint8_t num_buckets, uint8_t bucket, uint16_t ticks);
+
+/**
+ * \brief Function to put the durations into a SysEx message
+ * \description Writes count, min, max, mean and the histogram as 16 bit
+ * values with sysex_put16 - the framing is up to the caller.
+ * \param in s the durations
+ * \param in histogram its num_buckets buckets
+ * \param in num_buckets the number of buckets
+ * \param out out STATS_SYSEX_LENGTH(num_buckets) bytes
+ * \return the position right after the bytes written
+ */
+uint8_t* stats_sysex(const stats_t* s, const uint16_t* histogram, uint8_t num_buckets, uint8_t* out);
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef _TIMEBASE_H_
+#define _TIMEBASE_H_
+#include <stdint.h>
+
+#ifndef F_CPU
+#pragma message "F_CPU not defined - defaulting to 16000000UL"
+#define F_CPU	16000000UL
+#endif
+
+// timer1 runs free with a prescaler of 8 -> 2 timebase ticks per us (@16MHz Clock)
+// the 32 bit timebase wraps around every ~35 minutes - so always compare
+// differences of two timebase values and never the values themselves
+#define TIMEBASE_TICKS_PER_US	(F_CPU/8/1000000UL)
+#define US_TO_TIMEBASE(us)		((uint32_t)(us)*TIMEBASE_TICKS_PER_US)
+#define MS_TO_TIMEBASE(ms)		((uint32_t)(ms)*1000UL*TIMEBASE_TICKS_PER_US)
+
+// MIDI clocks slower than this (~10bpm) are considered as stopped
+#define MAX_MIDICLOCK_PERIOD	MS_TO_TIMEBASE(250)
+
+typedef uint32_t timebase_t;
+
+/**
+ * \brief Function to initialize the timebase
+ * \description This function starts timer1 free running and enables its
+ * overflow interrupt which counts the upper 16 bits of the timebase.
+ * The compare match units of timer1 stay free to be used by anybody
+ * scheduling events on the timebase.
+ */
+void timebase_init(void);
+
+/**
+ * \brief Function to read the current time
+ * \description This function reads the 32 bit timebase atomically. It is
+ * safe to call it from the main loop as well as from within interrupts.
+ * \return the current time in timebase ticks
+ */
+timebase_t timebase_now(void);
+
+#endif
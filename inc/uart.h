@@ -1,6 +1,6 @@
 #ifndef __UART_H_
 #define __UART_H_
-#include <avr/io.h>
+#include "hal.h"
 #include <stdbool.h>
 
 #ifndef BAUD
@@ -27,16 +27,44 @@
  */
 void uart_init(void);
 
+// bytes waiting to be sent - must be 2^n
+#ifndef UART_TX_BUFFER_SIZE
+#define UART_TX_BUFFER_SIZE	(16)
+#endif
+#define UART_TX_BUFFER_MASK	(UART_TX_BUFFER_SIZE-1)
+
 /**
  * \brief Function to put a character to the UART TX line
- * \description This function outputs the given character to the UART and
- * returns true afterwards. This function is blocking and sends the
- * given byte whenever the UART is ready to send!
+ * \description This function queues the given character for sending and
+ * waits as long as the queue is full. Interrupts have to be enabled, the
+ * queue gets emptied by the UDRE interrupt!
  * \param in c the character to put to UART
  * \return always true
  */
 bool uart_putc(unsigned char c);
 
+/**
+ * \brief Function to put a character to the UART TX line if there is room
+ * \description This function queues the given character for sending only
+ * if the queue is not full. It never waits and therefor can be used from
+ * within interrupt routines. The queue is emptied in order by the UDRE
+ * interrupt.
+ * \param in c the character to put to UART
+ * \return wether or not the character has been queued
+ */
+bool uart_try_putc(unsigned char c);
+
+/**
+ * \brief Function to send a MIDI realtime message as soon as possible
+ * \description Realtime messages may be sent in between the bytes of any
+ * other message - this one goes out right after the byte being sent now,
+ * ahead of everything queued by uart_try_putc. Only one can be waiting.
+ * Can be used from within interrupt routines.
+ * \param in c the realtime message (0xF8 to 0xFF)
+ * \return wether or not the message has been queued
+ */
+bool uart_put_realtime(unsigned char c);
+
 /**
  * \brief Function to put a character string (terminated by '\0') to UART TX
  * \description This function outputs the given string to the UART.
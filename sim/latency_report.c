@@ -0,0 +1,434 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "sim.h"
+#include "latency.h"
+#include "midi_datatypes.h"
+
+// plays the standard load profiles to the simulated device and reports the
+// MIDI to CV latencies it measured - or reports the ones sent by a device
+
+#define REPORT_DEFAULT_SECONDS	(60)
+
+// the first CC put out by update_dac with the default settings
+extern const uint8_t default_cc_message[4];
+
+/**
+ * A load profile: notes - single ones or chords - held for half their
+ * period, optionally played along with the MIDI clock and a stream of CCs.
+ * Pitches and velocities are random but the same on every run.
+ */
+typedef struct {
+	const char* name;
+	const char* description;
+	uint32_t note_period_us;
+	uint8_t chord;
+	// 0 for no MIDI clock
+	uint16_t clock_bpm;
+	// 0 for no CCs
+	uint32_t cc_period_us;
+} load_profile_t;
+
+const load_profile_t load_profile[] = {
+	{"notes",  "single notes every 250ms", 250000, 1, 0, 0},
+	{"chords", "4 note chords every 500ms", 500000, 4, 0, 0},
+	{"clock",  "single notes every 250ms, MIDI clock at 120bpm", 250000, 1, 120, 0},
+	{"cc",     "single notes every 250ms, MIDI clock at 120bpm, a CC every 10ms", 250000, 1, 120, 10000},
+	{"flood",  "4 note chords every 125ms, MIDI clock at 240bpm, a CC every 1.5ms", 125000, 4, 240, 1500},
+};
+#define NUM_LOAD_PROFILES	(sizeof(load_profile)/sizeof(load_profile_t))
+
+const char* class_name[NUM_LATENCY_CLASSES] = {
+	"note on",
+	"note off",
+	"cc",
+	"clock"
+};
+
+typedef struct {
+	uint64_t time_us;
+	uint8_t byte[3];
+	uint8_t length;
+} message_t;
+
+typedef struct {
+	message_t* message;
+	uint32_t num_messages;
+	uint32_t size;
+} messages_t;
+
+uint32_t random_state = 1;
+
+uint8_t random_byte(void) {
+	random_state = random_state*1103515245UL + 12345;
+	return random_state>>16;
+}
+
+void add_message(messages_t* m, uint64_t time_us, uint8_t b0, uint8_t b1, uint8_t b2, uint8_t length) {
+	if(m->num_messages == m->size) {
+		m->size = m->size ? m->size*2 : 4096;
+		m->message = realloc(m->message, m->size*sizeof(message_t));
+		if(!m->message) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	message_t* e = m->message + m->num_messages++;
+	e->time_us = time_us;
+	e->byte[0] = b0;
+	e->byte[1] = b1;
+	e->byte[2] = b2;
+	e->length = length;
+}
+
+// simultaneous messages stay in the order they got added
+int compare_messages(const void* a, const void* b) {
+	const message_t* x = a;
+	const message_t* y = b;
+	if(x->time_us != y->time_us) {
+		return x->time_us < y->time_us ? -1 : 1;
+	}
+	return x < y ? -1 : (x > y);
+}
+
+void generate(const load_profile_t* p, uint32_t seconds, messages_t* m) {
+	uint64_t end = (uint64_t)seconds*1000000;
+	uint64_t t;
+	uint8_t i;
+	random_state = 1;
+	for(t=0; t<end; t+=p->note_period_us) {
+		uint8_t root = 36+random_byte()%36;
+		for(i=0;i<p->chord;i++) {
+			uint8_t note = root+i*4;
+			add_message(m, t, NOTE_ON(0), note, 1+random_byte()%127, 3);
+			add_message(m, t+p->note_period_us/2, NOTE_OFF(0), note, 0, 3);
+		}
+	}
+	if(p->clock_bpm) {
+		// 24 clocks per quarter note
+		uint64_t period_us = 60000000ULL/p->clock_bpm/24;
+		for(t=0; t<end; t+=period_us) {
+			add_message(m, t, CLOCK_SIGNAL, 0, 0, 1);
+		}
+	}
+	if(p->cc_period_us) {
+		for(t=0; t<end; t+=p->cc_period_us) {
+			add_message(m, t, CONTROL_CHANGE(0), default_cc_message[0], random_byte()&0x7f, 3);
+		}
+	}
+	qsort(m->message, m->num_messages, sizeof(message_t), compare_messages);
+}
+
+typedef struct {
+	uint32_t count;
+	// all in timebase ticks
+	double min;
+	double p50;
+	double p90;
+	double p99;
+	double max;
+	double mean;
+} summary_t;
+
+// every single latency measured in the simulation
+typedef struct {
+	uint16_t* ticks;
+	uint32_t num_samples;
+	uint32_t size;
+} samples_t;
+
+samples_t samples[NUM_LATENCY_CLASSES];
+
+void record_sample(uint8_t c, uint16_t ticks) {
+	samples_t* s = samples+c;
+	if(s->num_samples == s->size) {
+		s->size = s->size ? s->size*2 : 4096;
+		s->ticks = realloc(s->ticks, s->size*sizeof(uint16_t));
+		if(!s->ticks) {
+			fprintf(stderr, "out of memory\n");
+			exit(1);
+		}
+	}
+	s->ticks[s->num_samples++] = ticks;
+}
+
+int compare_ticks(const void* a, const void* b) {
+	return (int)*(const uint16_t*)a - (int)*(const uint16_t*)b;
+}
+
+double sample_percentile(const samples_t* s, double p) {
+	return s->ticks[(uint32_t)(p*(s->num_samples-1)+0.5)];
+}
+
+void summarize_samples(samples_t* s, summary_t* out) {
+	uint32_t i=0;
+	double sum = 0;
+	memset(out, 0, sizeof(summary_t));
+	out->count = s->num_samples;
+	if(s->num_samples == 0) {
+		return;
+	}
+	qsort(s->ticks, s->num_samples, sizeof(uint16_t), compare_ticks);
+	for(;i<s->num_samples;i++) {
+		sum += s->ticks[i];
+	}
+	out->min = s->ticks[0];
+	out->max = s->ticks[s->num_samples-1];
+	out->p50 = sample_percentile(s, 0.5);
+	out->p90 = sample_percentile(s, 0.9);
+	out->p99 = sample_percentile(s, 0.99);
+	out->mean = sum/s->num_samples;
+}
+
+// interpolated within the histogram bucket the percentile falls into
+double histogram_percentile(const latency_t* l, double p) {
+	uint32_t total = 0;
+	uint32_t below = 0;
+	uint8_t i=0;
+	for(;i<NUM_LATENCY_BUCKETS;i++) {
+		total += l->histogram[i];
+	}
+	double rank = p*total;
+	for(i=0;i<NUM_LATENCY_BUCKETS;i++) {
+		uint16_t n = l->histogram[i];
+		if(n && below+n >= rank) {
+			double low = latency_bucket_start(i);
+			double high = (i < NUM_LATENCY_BUCKETS-1) ? latency_bucket_start(i+1) : l->stats.max;
+			if(low < l->stats.min) {
+				low = l->stats.min;
+			}
+			if(high > l->stats.max) {
+				high = l->stats.max;
+			}
+			return low + (high-low)*(rank-below)/n;
+		}
+		below += n;
+	}
+	return l->stats.max;
+}
+
+void summarize_histogram(const latency_t* l, summary_t* out) {
+	memset(out, 0, sizeof(summary_t));
+	out->count = l->stats.count;
+	if(l->stats.count == 0) {
+		return;
+	}
+	out->min = l->stats.min;
+	out->max = l->stats.max;
+	out->p50 = histogram_percentile(l, 0.5);
+	out->p90 = histogram_percentile(l, 0.9);
+	out->p99 = histogram_percentile(l, 0.99);
+	out->mean = (double)l->stats.sum/l->stats.count;
+}
+
+double ticks_to_us(double ticks) {
+	return ticks/TIMEBASE_TICKS_PER_US;
+}
+
+void report(const summary_t* summary) {
+	uint8_t c=0;
+	printf("  %-9s %7s %8s %8s %8s %8s %8s %8s %8s\n",
+			"class", "count", "min", "p50", "p90", "p99", "max", "mean", "jitter");
+	for(;c<NUM_LATENCY_CLASSES;c++) {
+		const summary_t* k = summary+c;
+		if(k->count == 0) {
+			printf("  %-9s %7u\n", class_name[c], 0);
+			continue;
+		}
+		printf("  %-9s %7u %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f %8.1f\n",
+				class_name[c], k->count,
+				ticks_to_us(k->min),
+				ticks_to_us(k->p50),
+				ticks_to_us(k->p90),
+				ticks_to_us(k->p99),
+				ticks_to_us(k->max),
+				ticks_to_us(k->mean),
+				ticks_to_us(k->max-k->min));
+	}
+}
+
+// every profile gets a freshly powered up device - so it runs on its own
+void run_profile(const load_profile_t* p, uint32_t seconds) {
+	messages_t m = {0, 0, 0};
+	summary_t summary[NUM_LATENCY_CLASSES];
+	uint32_t i=0;
+	pid_t pid;
+	fflush(stdout);
+	pid = fork();
+	if(pid < 0) {
+		perror("fork");
+		exit(1);
+	}
+	if(pid > 0) {
+		waitpid(pid, 0, 0);
+		return;
+	}
+	generate(p, seconds, &m);
+	// the way the device usually runs: LFOs and clocks on the aux outputs
+	sim_init(0, false, true, 0, 0);
+	latency_hook = record_sample;
+	for(;i<m.num_messages;i++) {
+		uint8_t j=0;
+		for(;j<m.message[i].length;j++) {
+			sim_midi_in(m.message[i].time_us*TIMEBASE_TICKS_PER_US, m.message[i].byte[j]);
+		}
+	}
+	sim_run_until(sim_now()+MS_TO_TIMEBASE(100));
+	for(i=0;i<NUM_LATENCY_CLASSES;i++) {
+		summarize_samples(samples+i, summary+i);
+	}
+	printf("%s: %s (%u s, %u messages) - in us\n", p->name, p->description, seconds, m.num_messages);
+	report(summary);
+	fflush(stdout);
+	exit(0);
+}
+
+uint16_t sysex_get(const uint8_t* p) {
+	return ((uint16_t)p[0]<<14)|((uint16_t)p[1]<<7)|p[2];
+}
+
+// a capture of whatever the device sent to MIDI OUT - binary or hex text
+bool report_dump(const char* path) {
+	FILE* f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	uint8_t* data = 0;
+	size_t size = 0;
+	size_t capacity = 0;
+	latency_t l[NUM_LATENCY_CLASSES];
+	summary_t summary[NUM_LATENCY_CLASSES];
+	bool found = false;
+	int c;
+	size_t i;
+	if(!f) {
+		perror(path);
+		return false;
+	}
+	while((c = fgetc(f)) != EOF) {
+		if(size == capacity) {
+			capacity = capacity ? capacity*2 : 4096;
+			data = realloc(data, capacity);
+			if(!data) {
+				fprintf(stderr, "%s: out of memory\n", path);
+				return false;
+			}
+		}
+		data[size++] = c;
+	}
+	if(f != stdin) {
+		fclose(f);
+	}
+	if(!memchr(data, 0xf0, size)) {
+		// hex text - turn it into bytes
+		size_t n = 0;
+		char* s = (char*)data;
+		char* end;
+		data = realloc(data, size+1);
+		s = (char*)data;
+		s[size] = '\0';
+		while(*s) {
+			unsigned long byte = strtoul(s, &end, 16);
+			if(end == s) {
+				s++;
+				continue;
+			}
+			data[n++] = byte;
+			s = end;
+		}
+		size = n;
+	}
+	memset(l, 0, sizeof(l));
+	for(i=0; i+LATENCY_SYSEX_LENGTH<=size; i++) {
+		const uint8_t* m = data+i;
+		uint8_t b=0;
+		if(m[0] != 0xf0 || m[1] != LATENCY_SYSEX_ID || m[2] != LATENCY_SYSEX_TYPE
+				|| m[3] >= NUM_LATENCY_CLASSES || m[LATENCY_SYSEX_LENGTH-1] != 0xf7) {
+			continue;
+		}
+		latency_t* k = l+m[3];
+		k->stats.count = sysex_get(m+4);
+		k->stats.min = sysex_get(m+7);
+		k->stats.max = sysex_get(m+10);
+		k->stats.sum = (uint32_t)sysex_get(m+13)*k->stats.count;
+		for(;b<NUM_LATENCY_BUCKETS;b++) {
+			k->histogram[b] = sysex_get(m+16+b*3);
+		}
+		found = true;
+	}
+	free(data);
+	if(!found) {
+		fprintf(stderr, "%s: no latency SysEx messages\n", path);
+		return false;
+	}
+	for(i=0;i<NUM_LATENCY_CLASSES;i++) {
+		summarize_histogram(l+i, summary+i);
+	}
+	printf("%s - in us\n", path);
+	report(summary);
+	return true;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,
+			"usage: %s [-s seconds] [-p profile] [-d dump]\n"
+			"Plays each load profile to the simulated device and reports the latency\n"
+			"from the last byte of a message received up to its output per message\n"
+			"class: percentiles, mean and jitter (max-min). The simulation only\n"
+			"takes the DAC writes into account - all the other code runs in no time.\n"
+			"  -s seconds  how long to play each profile (default %u)\n"
+			"  -p profile  only play this profile\n"
+			"  -d dump     report the latencies sent by a device (CC 104 value 0)\n"
+			"              instead - a capture of its MIDI OUT, binary or hex text.\n"
+			"              The percentiles are estimated from the histograms.\n"
+			"profiles:\n",
+			name, REPORT_DEFAULT_SECONDS);
+	uint8_t i=0;
+	for(;i<NUM_LOAD_PROFILES;i++) {
+		fprintf(stderr, "  %-8s %s\n", load_profile[i].name, load_profile[i].description);
+	}
+}
+
+int main(int argc, char** argv) {
+	uint32_t seconds = REPORT_DEFAULT_SECONDS;
+	const char* only = 0;
+	const char* dump = 0;
+	bool found = false;
+	uint8_t i=0;
+	int opt;
+	while((opt = getopt(argc, argv, "s:p:d:h")) != -1) {
+		switch(opt) {
+			case 's':
+				seconds = strtoul(optarg, 0, 10);
+				break;
+			case 'p':
+				only = optarg;
+				break;
+			case 'd':
+				dump = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if(optind != argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if(dump) {
+		return report_dump(dump) ? 0 : 1;
+	}
+	for(;i<NUM_LOAD_PROFILES;i++) {
+		if(only && strcmp(only, load_profile[i].name)) {
+			continue;
+		}
+		found = true;
+		run_profile(load_profile+i, seconds);
+	}
+	if(!found) {
+		usage(argv[0]);
+		return 1;
+	}
+	return 0;
+}
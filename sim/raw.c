@@ -0,0 +1,82 @@
+#include "raw.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool raw_read(char* data, smf_message_t f, void* context) {
+	uint32_t line = 0;
+	char* next = data;
+	while(next) {
+		char* s = next;
+		char* end;
+		uint8_t bytes[256];
+		uint32_t length = 0;
+		next = strchr(s, '\n');
+		if(next) {
+			*next++ = '\0';
+		}
+		line++;
+		if(strchr(s, '#')) {
+			*strchr(s, '#') = '\0';
+		}
+		unsigned long long time_us = strtoull(s, &end, 10);
+		if(end == s) {
+			// nothing but whitespace
+			if(strspn(s, " \t\r") != strlen(s)) {
+				fprintf(stderr, "line %u: no time\n", line);
+				return false;
+			}
+			continue;
+		}
+		s = end;
+		while(true) {
+			unsigned long byte = strtoul(s, &end, 16);
+			if(end == s) {
+				break;
+			}
+			if(byte > 0xff || length == sizeof(bytes)) {
+				fprintf(stderr, "line %u: bad byte\n", line);
+				return false;
+			}
+			bytes[length++] = byte;
+			s = end;
+		}
+		if(strspn(s, " \t\r") != strlen(s)) {
+			fprintf(stderr, "line %u: bad byte\n", line);
+			return false;
+		}
+		f(time_us, bytes, length, context);
+	}
+	return true;
+}
+
+char* raw_load(const char* path, size_t* size) {
+	FILE* f = strcmp(path, "-") ? fopen(path, "rb") : stdin;
+	char* data = 0;
+	size_t capacity = 0;
+	*size = 0;
+	if(!f) {
+		perror(path);
+		return 0;
+	}
+	while(true) {
+		if(*size+1 >= capacity) {
+			capacity = capacity ? capacity*2 : 65536;
+			data = realloc(data, capacity);
+			if(!data) {
+				fprintf(stderr, "%s: out of memory\n", path);
+				return 0;
+			}
+		}
+		size_t got = fread(data+*size, 1, capacity-*size-1, f);
+		if(got == 0) {
+			break;
+		}
+		*size += got;
+	}
+	data[*size] = '\0';
+	if(f != stdin) {
+		fclose(f);
+	}
+	return data;
+}
@@ -0,0 +1,31 @@
+#ifndef _RAW_H_
+#define _RAW_H_
+#include <stdbool.h>
+#include "smf.h"
+
+/**
+ * Reads raw MIDI written down as text: one message per line, the time in us
+ * followed by its bytes in hex - for example "1500 90 3c 64". # starts a
+ * comment, empty lines are fine.
+ */
+
+/**
+ * \brief Function to read raw MIDI text
+ * \param in data the text, 0 terminated - gets changed while reading
+ * \param in f called for every message, the same way smf_read does
+ * \param in context handed on to f
+ * \return false on the first line that is no message - the ones before
+ * got handed to f anyway
+ */
+bool raw_read(char* data, smf_message_t f, void* context);
+
+/**
+ * \brief Function to read a whole file - MIDI or text - into memory
+ * \param in path the file, - for stdin
+ * \param out size the number of bytes read
+ * \return the contents with a 0 after them to be freed by the caller, 0 if
+ * the file could not be read
+ */
+char* raw_load(const char* path, size_t* size);
+
+#endif
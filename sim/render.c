@@ -0,0 +1,286 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "hal.h"
+#include "sim.h"
+#include "smf.h"
+#include "raw.h"
+
+// renders what the simulated device puts out for a MIDI file into a WAV
+// file - see the usage below
+
+#define RENDER_DEFAULT_RATE		(48000UL)
+#define RENDER_DEFAULT_TAIL_MS	(1000)
+// every DAC channel and then every gate
+#define RENDER_CHANNELS			(HAL_HOST_NUM_DAC_CHANNELS+NUM_PLAY_NOTES)
+#define RENDER_SAMPLE_BYTES		(2)
+#define RENDER_FRAME_BYTES		(RENDER_CHANNELS*RENDER_SAMPLE_BYTES)
+// the samples are collected and written this many frames at a time - all
+// the memory the rendering needs no matter how long the file plays
+#define RENDER_BLOCK_FRAMES		(4096)
+// RIFF, WAVE, a JUNK chunk to become the RF64 ds64 chunk, fmt and data
+#define RENDER_JUNK_BYTES		(28)
+#define RENDER_FMT_BYTES		(40)
+#define RENDER_HEADER_BYTES		(12+8+RENDER_JUNK_BYTES+8+RENDER_FMT_BYTES+8)
+// the sizes of a WAV file still being written
+#define RENDER_UNKNOWN_FRAMES	(~0ULL)
+
+typedef struct {
+	FILE* out;
+	uint32_t rate;
+	// the output of the device right now as little endian 16 bit samples
+	uint8_t frame[RENDER_FRAME_BYTES];
+	uint8_t block[RENDER_BLOCK_FRAMES*RENDER_FRAME_BYTES];
+	uint16_t block_frames;
+	// frames written so far - the next one is taken at its time
+	uint64_t frames;
+	uint32_t messages;
+	uint32_t bytes;
+	bool ok;
+} render_t;
+
+render_t render;
+
+void render_put16(uint8_t* out, uint16_t value) {
+	out[0] = value;
+	out[1] = value>>8;
+}
+
+void render_put32(uint8_t* out, uint32_t value) {
+	render_put16(out, value);
+	render_put16(out+2, value>>16);
+}
+
+void render_put64(uint8_t* out, uint64_t value) {
+	render_put32(out, value);
+	render_put32(out+4, value>>32);
+}
+
+// the DAC values are offset binary - 0 becomes the lowest sample and 0xffff
+// the highest one, so the WAV keeps all 16 bits of them
+void render_set(uint8_t channel, uint16_t value) {
+	render_put16(render.frame+channel*RENDER_SAMPLE_BYTES, value ^ 0x8000);
+}
+
+void render_write_block(void) {
+	if(render.block_frames == 0) {
+		return;
+	}
+	if(fwrite(render.block, RENDER_FRAME_BYTES, render.block_frames, render.out) != render.block_frames) {
+		render.ok = false;
+	}
+	render.block_frames = 0;
+}
+
+// the time of a frame in timebase ticks
+sim_time_t render_frame_time(uint64_t frame) {
+	return frame*TIMEBASE_TICKS_PER_US*1000000UL/render.rate;
+}
+
+// puts out every frame before time with the outputs as they are
+void render_until(sim_time_t time) {
+	while(render_frame_time(render.frames) < time) {
+		memcpy(render.block+render.block_frames*RENDER_FRAME_BYTES, render.frame, RENDER_FRAME_BYTES);
+		render.frames++;
+		if(++render.block_frames == RENDER_BLOCK_FRAMES) {
+			render_write_block();
+		}
+	}
+}
+
+void render_dac(sim_time_t time, uint8_t channel, uint16_t value) {
+	render_until(time);
+	render_set(channel, value);
+}
+
+void render_gate(sim_time_t time, uint8_t gate, bool on) {
+	render_until(time);
+	render_set(HAL_HOST_NUM_DAC_CHANNELS+gate, on ? 0xffff : 0);
+}
+
+void render_message(uint64_t time_us, const uint8_t* bytes, uint32_t length, void* context) {
+	uint32_t i=0;
+	for(;i<length;i++) {
+		sim_midi_in(time_us*TIMEBASE_TICKS_PER_US, bytes[i]);
+	}
+	render.messages++;
+	render.bytes += length;
+}
+
+// a WAVE_FORMAT_EXTENSIBLE header - plain PCM is meant for up to 2 channels.
+// Over 4 GB it becomes an RF64 header with the sizes in the ds64 chunk,
+// with RENDER_UNKNOWN_FRAMES both sizes are 0xffffffff like in a stream.
+void render_header(uint8_t* h, uint64_t frames) {
+	static const uint8_t pcm_guid[16] = {
+		0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00,
+		0x80, 0x00, 0x00, 0xaa, 0x00, 0x38, 0x9b, 0x71
+	};
+	uint64_t data_bytes = frames*RENDER_FRAME_BYTES;
+	uint64_t riff_bytes = RENDER_HEADER_BYTES-8+data_bytes;
+	bool unknown = frames == RENDER_UNKNOWN_FRAMES;
+	bool rf64 = !unknown && riff_bytes > 0xffffffffUL;
+	memset(h, 0, RENDER_HEADER_BYTES);
+	memcpy(h, rf64 ? "RF64" : "RIFF", 4);
+	render_put32(h+4, rf64 || unknown ? 0xffffffffUL : riff_bytes);
+	memcpy(h+8, "WAVE", 4);
+	h += 12;
+	memcpy(h, rf64 ? "ds64" : "JUNK", 4);
+	render_put32(h+4, RENDER_JUNK_BYTES);
+	if(rf64) {
+		render_put64(h+8, riff_bytes);
+		render_put64(h+16, data_bytes);
+		render_put64(h+24, frames);
+	}
+	h += 8+RENDER_JUNK_BYTES;
+	memcpy(h, "fmt ", 4);
+	render_put32(h+4, RENDER_FMT_BYTES);
+	render_put16(h+8, 0xfffe);
+	render_put16(h+10, RENDER_CHANNELS);
+	render_put32(h+12, render.rate);
+	render_put32(h+16, render.rate*RENDER_FRAME_BYTES);
+	render_put16(h+20, RENDER_FRAME_BYTES);
+	render_put16(h+22, RENDER_SAMPLE_BYTES*8);
+	render_put16(h+24, 22);
+	render_put16(h+26, RENDER_SAMPLE_BYTES*8);
+	// no speaker positions - these are no speakers
+	render_put32(h+28, 0);
+	memcpy(h+32, pcm_guid, sizeof(pcm_guid));
+	h += 8+RENDER_FMT_BYTES;
+	memcpy(h, "data", 4);
+	render_put32(h+4, rf64 || unknown ? 0xffffffffUL : data_bytes);
+}
+
+// writes the header again with the real sizes - a pipe keeps the one
+// written first, with the sizes unknown
+void render_finish(void) {
+	uint8_t header[RENDER_HEADER_BYTES];
+	render_header(header, render.frames);
+	if(fseek(render.out, 0, SEEK_SET) == 0) {
+		if(fwrite(header, 1, sizeof(header), render.out) != sizeof(header)) {
+			render.ok = false;
+		}
+	}
+}
+
+void usage(const char* name) {
+	fprintf(stderr,
+			"usage: %s [-c channel] [-u] [-l] [-r rate] [-t ms] -o wav file\n"
+			"Plays file (a Standard MIDI File or raw MIDI as read by replay, - for\n"
+			"stdin) to the simulated device and renders its outputs into a %u channel\n"
+			"16 bit WAV file (- for stdout): the %u DAC channels and then the %u gates.\n"
+			"The DAC values map to the whole sample range, DAC 0 to the lowest and\n"
+			"0xffff to the highest sample, a gate is either of them.\n"
+			"  -c channel  MIDI channel set on the panel, 1 to 16 (default 1)\n"
+			"  -u          unison mode instead of polyphonic mode\n"
+			"  -l          LFOs and clocks on the aux outputs\n"
+			"  -r rate     sample rate in Hz (default %lu)\n"
+			"  -t ms       keep running this long after the last message (default %u)\n",
+			name, RENDER_CHANNELS, HAL_HOST_NUM_DAC_CHANNELS, NUM_PLAY_NOTES,
+			RENDER_DEFAULT_RATE, RENDER_DEFAULT_TAIL_MS);
+}
+
+int main(int argc, char** argv) {
+	uint8_t header[RENDER_HEADER_BYTES];
+	uint8_t channel = 0;
+	bool unison = false;
+	bool lfo_clock_out = false;
+	unsigned long rate = RENDER_DEFAULT_RATE;
+	unsigned long tail_ms = RENDER_DEFAULT_TAIL_MS;
+	const char* wav_path = 0;
+	struct timespec start;
+	struct timespec end;
+	size_t size;
+	bool ok;
+	uint8_t i=0;
+	int opt;
+	while((opt = getopt(argc, argv, "c:ulr:t:o:h")) != -1) {
+		switch(opt) {
+			case 'c':
+				channel = atoi(optarg)-1;
+				if(channel > 15) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'u':
+				unison = true;
+				break;
+			case 'l':
+				lfo_clock_out = true;
+				break;
+			case 'r':
+				rate = strtoul(optarg, 0, 10);
+				if(rate < 1000 || rate > 384000) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 't':
+				tail_ms = strtoul(optarg, 0, 10);
+				break;
+			case 'o':
+				wav_path = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if(optind != argc-1 || !wav_path) {
+		usage(argv[0]);
+		return 1;
+	}
+	char* data = raw_load(argv[optind], &size);
+	if(!data) {
+		return 1;
+	}
+	memset(&render, 0, sizeof(render));
+	render.rate = rate;
+	render.ok = true;
+	render.out = strcmp(wav_path, "-") == 0 ? stdout : fopen(wav_path, "wb");
+	if(!render.out) {
+		perror(wav_path);
+		free(data);
+		return 1;
+	}
+	// fixed up at the end unless it goes to a pipe
+	render_header(header, RENDER_UNKNOWN_FRAMES);
+	fwrite(header, 1, sizeof(header), render.out);
+	for(;i<RENDER_CHANNELS;i++) {
+		render_set(i, 0);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sim_init(channel, unison, lfo_clock_out, render_dac, render_gate);
+	if(smf_detect((uint8_t*)data, size)) {
+		ok = smf_read((uint8_t*)data, size, render_message, 0);
+		if(!ok) {
+			fprintf(stderr, "%s: broken MIDI file - rendered what could be read\n", argv[optind]);
+		}
+	} else {
+		ok = raw_read(data, render_message, 0);
+	}
+	sim_run_until(sim_now()+MS_TO_TIMEBASE(tail_ms));
+	render_until(sim_now());
+	render_write_block();
+	render_finish();
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double simulated = (double)sim_now()/TIMEBASE_TICKS_PER_US/1e6;
+	double wall = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+	fprintf(stderr, "%u messages (%u bytes), %llu frames of %u channels at %lu Hz\n",
+			render.messages, render.bytes, (unsigned long long)render.frames, RENDER_CHANNELS, rate);
+	fprintf(stderr, "%.3f s rendered in %.3f s (%.0fx realtime)\n",
+			simulated, wall, wall > 0 ? simulated/wall : 0);
+	if(render.out != stdout && fclose(render.out) != 0) {
+		render.ok = false;
+	}
+	if(!render.ok) {
+		fprintf(stderr, "%s: could not be written\n", wav_path);
+	}
+	free(data);
+	return ok && render.ok ? 0 : 1;
+}
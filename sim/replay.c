@@ -0,0 +1,157 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sim.h"
+#include "smf.h"
+#include "raw.h"
+
+// replays a MIDI file through the simulated device and writes down all the
+// CV it puts out - see the usage below
+
+#define REPLAY_DEFAULT_TAIL_MS	(1000)
+
+typedef struct {
+	FILE* out;
+	uint32_t messages;
+	uint32_t bytes;
+	uint32_t dac_writes;
+	uint32_t gate_edges;
+} replay_t;
+
+replay_t replay;
+
+void replay_print_time(sim_time_t time) {
+	fprintf(replay.out, "%llu.%u", (unsigned long long)(time/TIMEBASE_TICKS_PER_US),
+			(unsigned)((time%TIMEBASE_TICKS_PER_US)*10/TIMEBASE_TICKS_PER_US));
+}
+
+void replay_dac(sim_time_t time, uint8_t channel, uint16_t value) {
+	replay.dac_writes++;
+	if(replay.out) {
+		replay_print_time(time);
+		fprintf(replay.out, " dac %u %u\n", channel, value);
+	}
+}
+
+void replay_gate(sim_time_t time, uint8_t gate, bool on) {
+	replay.gate_edges++;
+	if(replay.out) {
+		replay_print_time(time);
+		fprintf(replay.out, " gate %u %u\n", gate, on);
+	}
+}
+
+void replay_message(uint64_t time_us, const uint8_t* bytes, uint32_t length, void* context) {
+	uint32_t i=0;
+	for(;i<length;i++) {
+		sim_midi_in(time_us*TIMEBASE_TICKS_PER_US, bytes[i]);
+	}
+	replay.messages++;
+	replay.bytes += length;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,
+			"usage: %s [-c channel] [-u] [-l] [-t ms] [-n] [-o trace] file\n"
+			"Plays file (a Standard MIDI File or raw MIDI, - for stdin) to the\n"
+			"simulated device and writes every DAC write and gate edge to the trace\n"
+			"(stdout by default) as lines of: <time in us> dac <channel> <value>\n"
+			"or <time in us> gate <gate> <0|1>.\n"
+			"Raw MIDI is a text file with a line per message: the time in us and\n"
+			"the bytes in hex, for example \"1500 90 3c 64\".\n"
+			"  -c channel  MIDI channel set on the panel, 1 to 16 (default 1)\n"
+			"  -u          unison mode instead of polyphonic mode\n"
+			"  -l          LFOs and clocks on the aux outputs\n"
+			"  -t ms       keep running this long after the last message (default %u)\n"
+			"  -n          no trace, just the summary\n",
+			name, REPLAY_DEFAULT_TAIL_MS);
+}
+
+int main(int argc, char** argv) {
+	uint8_t channel = 0;
+	bool unison = false;
+	bool lfo_clock_out = false;
+	unsigned long tail_ms = REPLAY_DEFAULT_TAIL_MS;
+	bool trace = true;
+	const char* trace_path = 0;
+	struct timespec start;
+	struct timespec end;
+	size_t size;
+	bool ok;
+	int opt;
+	while((opt = getopt(argc, argv, "c:ult:no:h")) != -1) {
+		switch(opt) {
+			case 'c':
+				channel = atoi(optarg)-1;
+				if(channel > 15) {
+					usage(argv[0]);
+					return 1;
+				}
+				break;
+			case 'u':
+				unison = true;
+				break;
+			case 'l':
+				lfo_clock_out = true;
+				break;
+			case 't':
+				tail_ms = strtoul(optarg, 0, 10);
+				break;
+			case 'n':
+				trace = false;
+				break;
+			case 'o':
+				trace_path = optarg;
+				break;
+			default:
+				usage(argv[0]);
+				return 1;
+		}
+	}
+	if(optind != argc-1) {
+		usage(argv[0]);
+		return 1;
+	}
+	char* data = raw_load(argv[optind], &size);
+	if(!data) {
+		return 1;
+	}
+	memset(&replay, 0, sizeof(replay));
+	if(trace) {
+		replay.out = trace_path ? fopen(trace_path, "w") : stdout;
+		if(!replay.out) {
+			perror(trace_path);
+			return 1;
+		}
+		setvbuf(replay.out, 0, _IOFBF, 1<<20);
+		fprintf(replay.out, "# time_us event channel value\n");
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	sim_init(channel, unison, lfo_clock_out, replay_dac, replay_gate);
+	if(smf_detect((uint8_t*)data, size)) {
+		ok = smf_read((uint8_t*)data, size, replay_message, 0);
+		if(!ok) {
+			fprintf(stderr, "%s: broken MIDI file - played what could be read\n", argv[optind]);
+		}
+	} else {
+		ok = raw_read(data, replay_message, 0);
+	}
+	sim_run_until(sim_now()+MS_TO_TIMEBASE(tail_ms));
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double simulated = (double)sim_now()/TIMEBASE_TICKS_PER_US/1e6;
+	double wall = (end.tv_sec-start.tv_sec) + (end.tv_nsec-start.tv_nsec)/1e9;
+	fprintf(stderr, "%u messages (%u bytes), %u DAC writes, %u gate edges\n",
+			replay.messages, replay.bytes, replay.dac_writes, replay.gate_edges);
+	fprintf(stderr, "%.3f s simulated in %.3f s (%.0fx realtime)\n",
+			simulated, wall, wall > 0 ? simulated/wall : 0);
+	if(replay.out && replay.out != stdout) {
+		fclose(replay.out);
+	}
+	free(data);
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,163 @@
+// the real firmware - built against the mocked hardware in hal_host.c
+#include "../src/main.c"
+#include "sim.h"
+
+sim_time_t sim_time = 0;
+// the MIDI wire is busy up to here
+sim_time_t sim_wire_free = 0;
+uint8_t sim_gates = 0;
+sim_dac_trace_t sim_dac_trace = 0;
+sim_gate_trace_t sim_gate_trace = 0;
+
+// the scheduler does not hand out its task table
+extern task_t* scheduler_tasks;
+extern uint8_t scheduler_num_tasks;
+
+void sim_advance(sim_time_t end);
+
+// the write takes its time - the value is out once it is through
+void sim_dac_hook(uint8_t channel, uint16_t value) {
+	sim_advance(sim_time+SIM_DAC_WRITE_TICKS);
+	if(sim_dac_trace) {
+		sim_dac_trace(sim_time, channel, value);
+	}
+}
+
+// the gates are plain port pins only ever set by the tasks - look for edges
+// after each one
+void sim_check_gates(void) {
+	uint8_t gates = (GATE_PORT>>GATE_OFFSET) & ((1<<NUM_PLAY_NOTES)-1);
+	uint8_t changed = gates ^ sim_gates;
+	uint8_t i=0;
+	sim_gates = gates;
+	if(!sim_gate_trace) {
+		return;
+	}
+	for(;i<NUM_PLAY_NOTES;i++) {
+		if(changed & (1<<i)) {
+			sim_gate_trace(sim_time, i, ISSET(gates, (1<<i)));
+		}
+	}
+}
+
+void sim_set_time(sim_time_t time) {
+	sim_time = time;
+	hal_host_time = (timebase_t)time;
+}
+
+// the next time timer1 runs into a compare value - one whole timer1 period
+// from now if it is there already
+sim_time_t sim_next_match(uint16_t compare) {
+	uint32_t wait = (uint16_t)(compare - (uint16_t)sim_time);
+	if(wait == 0) {
+		wait = 0x10000UL;
+	}
+	return sim_time + wait;
+}
+
+sim_time_t sim_next_interrupt(sim_time_t end) {
+	sim_time_t next = end;
+	if(ISSET(TIMSK, (1<<OCIE1A)) && sim_next_match(OCR1A) < next) {
+		next = sim_next_match(OCR1A);
+	}
+	if(ISSET(TIMSK, (1<<OCIE1B)) && sim_next_match(OCR1B) < next) {
+		next = sim_next_match(OCR1B);
+	}
+	return next;
+}
+
+sim_time_t sim_next_event(sim_time_t end) {
+	sim_time_t next = sim_next_interrupt(end);
+	uint8_t i=0;
+	for(;i<scheduler_num_tasks;i++) {
+		task_t* t = scheduler_tasks+i;
+		if(t->period != 0 && !t->pending) {
+			int32_t wait = (int32_t)(t->release - hal_host_time);
+			if(wait < 0) {
+				wait = 0;
+			}
+			if(sim_time + wait < next) {
+				next = sim_time + wait;
+			}
+		}
+	}
+	return next;
+}
+
+void sim_init(uint8_t midi_channel, bool unison, bool lfo_clock_out, sim_dac_trace_t dac, sim_gate_trace_t gate) {
+	sim_set_time(0);
+	sim_wire_free = 0;
+	sim_gates = 0;
+	sim_dac_trace = dac;
+	sim_gate_trace = gate;
+	hal_host_dac_hook = sim_dac_hook;
+	memset(hal_host_panel, 0, sizeof(hal_host_panel));
+	hal_host_panel[0] = (midi_channel & MIDI_CHANNEL_MASK)
+			| (unison ? 0 : MODE_BIT0)
+			| (lfo_clock_out ? LFO_CLOCK_ENABLE_BIT : 0);
+	// button released
+	PINC = (1<<BUTTON);
+	hal_host_eeprom_clear();
+	GATE_PORT = 0;
+	init_firmware();
+	// as if the device had been on long enough to have read its panel
+	process_user_input();
+	sim_check_gates();
+}
+
+// fires the timer1 interrupts matching right now in the order of their
+// vectors - and the EEPROM and ADC ones for the next byte of a save or
+// the next conversion of a scan
+void sim_interrupts(void) {
+	if(ISSET(TIMSK, (1<<OCIE1A)) && (uint16_t)sim_time == OCR1A) {
+		TIMER1_COMPA_vect();
+	}
+	if(ISSET(TIMSK, (1<<OCIE1B)) && (uint16_t)sim_time == OCR1B) {
+		TIMER1_COMPB_vect();
+	}
+	if(ISSET(EECR, (1<<EERIE))) {
+		EE_RDY_vect();
+	}
+	if(ISSET(ADCSRA, (1<<ADSC))) {
+		UNSET(ADCSRA, (1<<ADSC));
+		ADC_vect();
+	}
+}
+
+// moves on in the middle of a task - the timer1 interrupts cut in on time
+void sim_advance(sim_time_t end) {
+	while(sim_time < end) {
+		sim_set_time(sim_next_interrupt(end));
+		sim_interrupts();
+	}
+}
+
+void sim_run_until(sim_time_t end) {
+	while(true) {
+		// a task taking longer than the time left makes the next one wait
+		while(sim_time < end && scheduler_run_next()) {
+			sim_check_gates();
+		}
+		if(sim_time >= end) {
+			break;
+		}
+		sim_set_time(sim_next_event(end));
+		sim_interrupts();
+	}
+}
+
+sim_time_t sim_midi_in(sim_time_t time, uint8_t byte) {
+	sim_time_t received = (time > sim_wire_free ? time : sim_wire_free) + SIM_MIDI_BYTE_TICKS;
+	sim_wire_free = received;
+	sim_run_until(received);
+	// a task may have run past the byte - the interrupt cuts in on time anyway
+	hal_host_time = (timebase_t)received;
+	hal_host_uart_rx = byte;
+	USART_RXC_vect();
+	hal_host_time = (timebase_t)sim_time;
+	return received;
+}
+
+sim_time_t sim_now(void) {
+	return sim_time;
+}
@@ -0,0 +1,71 @@
+#ifndef _SIM_H_
+#define _SIM_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include "timebase.h"
+#include "uart.h"
+
+/**
+ * The real firmware (src/main.c built against hal_host.c) driven by
+ * simulated time. Nothing happens in between two events: the main loop
+ * runs every released task at once and the clock jumps straight to whatever
+ * comes next, be it a timer1 compare match, a periodic task or the next MIDI
+ * byte. That is what makes an hour of MIDI go through in seconds.
+ *
+ * The code itself takes no time at all - except for the DAC writes, which
+ * are what keeps the device busy the longest. Each one takes
+ * SIM_DAC_WRITE_TICKS, interrupts cut in on time while tasks wait.
+ *
+ * Times are timebase ticks (see timebase.h) since sim_init. They are 64 bit
+ * wide here while the firmware sees the lower 32 bit wrapping around just
+ * like on the device.
+ */
+typedef uint64_t sim_time_t;
+
+// one byte on the MIDI wire: start bit, 8 data bits and stop bit
+#define SIM_MIDI_BYTE_TICKS	((10*1000000UL*TIMEBASE_TICKS_PER_US)/BAUD)
+
+// 4 bytes of 16 CPU cycles each on the SPI plus ~40 cycles around them
+#define SIM_DAC_WRITE_TICKS	((4*16+40)/(F_CPU/1000000UL/TIMEBASE_TICKS_PER_US))
+
+// called on every write to a DAC channel and on every edge of a gate
+typedef void (*sim_dac_trace_t)(sim_time_t time, uint8_t channel, uint16_t value);
+typedef void (*sim_gate_trace_t)(sim_time_t time, uint8_t gate, bool on);
+
+/**
+ * \brief Function to power up the simulated device
+ * \description The panel switches are set up once and never move - they
+ * are applied right away instead of on the first panel read. The pots stay
+ * at 0 and the EEPROM is empty so the default settings get used.
+ * \param in midi_channel the MIDI channel from 0 to 15
+ * \param in unison true for unison mode, false for polyphonic mode
+ * \param in lfo_clock_out true to have the aux outputs play the LFOs and clocks
+ * \param in dac called on every DAC write - may be 0
+ * \param in gate called on every gate edge - may be 0
+ */
+void sim_init(uint8_t midi_channel, bool unison, bool lfo_clock_out, sim_dac_trace_t dac, sim_gate_trace_t gate);
+
+/**
+ * \brief Function to let the device run on its own up to some point in time
+ * \param in end the time to stop at - nothing happens if it has passed already
+ */
+void sim_run_until(sim_time_t end);
+
+/**
+ * \brief Function to receive a MIDI byte
+ * \description Runs the device up to the time the byte is completely on the
+ * wire and fires the receive interrupt. A byte starts on the wire at the
+ * given time or once the byte before is through, whatever is later.
+ * \param in time the time the byte gets sent
+ * \param in byte the byte
+ * \return the time the byte got received
+ */
+sim_time_t sim_midi_in(sim_time_t time, uint8_t byte);
+
+/**
+ * \brief Function to read the simulated time
+ * \return the current time in timebase ticks since sim_init
+ */
+sim_time_t sim_now(void);
+
+#endif
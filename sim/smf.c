@@ -0,0 +1,239 @@
+#include "smf.h"
+#include <stdlib.h>
+#include <string.h>
+
+// 120 bpm until the file says otherwise
+#define SMF_DEFAULT_TEMPO	(500000UL)
+#define SMF_META			(0xff)
+#define SMF_META_TEMPO		(0x51)
+#define SMF_META_END		(0x2f)
+#define SMF_SYSEX			(0xf0)
+#define SMF_ESCAPE			(0xf7)
+
+typedef struct {
+	uint64_t tick;
+	// position in the file - keeps simultaneous events in order
+	uint32_t order;
+	// 0 for the raw bytes of an escape
+	uint8_t status;
+	const uint8_t* data;
+	uint32_t length;
+	// for tempo changes - 0 for everything else
+	uint32_t tempo;
+} smf_event_t;
+
+typedef struct {
+	smf_event_t* event;
+	uint32_t num_events;
+	uint32_t size;
+} smf_events_t;
+
+uint32_t smf_get32(const uint8_t* p) {
+	return ((uint32_t)p[0]<<24)|((uint32_t)p[1]<<16)|((uint32_t)p[2]<<8)|p[3];
+}
+
+uint16_t smf_get16(const uint8_t* p) {
+	return ((uint16_t)p[0]<<8)|p[1];
+}
+
+// variable length quantity - at most 4 bytes
+bool smf_get_vlq(const uint8_t* data, size_t size, size_t* pos, uint32_t* out) {
+	uint8_t i=0;
+	*out = 0;
+	for(;i<4 && *pos<size;i++) {
+		uint8_t b = data[(*pos)++];
+		*out = (*out<<7)|(b & 0x7f);
+		if(!(b & 0x80)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+bool smf_add(smf_events_t* events, smf_event_t* e) {
+	if(events->num_events == events->size) {
+		uint32_t size = events->size ? events->size*2 : 1024;
+		smf_event_t* grown = realloc(events->event, size*sizeof(smf_event_t));
+		if(!grown) {
+			return false;
+		}
+		events->event = grown;
+		events->size = size;
+	}
+	e->order = events->num_events;
+	events->event[events->num_events++] = *e;
+	return true;
+}
+
+bool smf_read_track(const uint8_t* data, size_t size, smf_events_t* events) {
+	size_t pos = 0;
+	uint8_t running = 0;
+	smf_event_t e;
+	memset(&e, 0, sizeof(e));
+	while(pos < size) {
+		uint32_t delta;
+		uint32_t length;
+		if(!smf_get_vlq(data, size, &pos, &delta) || pos >= size) {
+			return false;
+		}
+		e.tick += delta;
+		e.tempo = 0;
+		uint8_t b = data[pos];
+		if(b == SMF_META) {
+			if(pos+2 > size) {
+				return false;
+			}
+			uint8_t type = data[pos+1];
+			pos += 2;
+			if(!smf_get_vlq(data, size, &pos, &length) || pos+length > size) {
+				return false;
+			}
+			if(type == SMF_META_END) {
+				return true;
+			}
+			if(type == SMF_META_TEMPO && length == 3) {
+				e.status = SMF_META;
+				e.tempo = ((uint32_t)data[pos]<<16)|((uint32_t)data[pos+1]<<8)|data[pos+2];
+				e.data = data+pos;
+				e.length = 0;
+				if(!smf_add(events, &e)) {
+					return false;
+				}
+			}
+			pos += length;
+		} else if(b == SMF_SYSEX || b == SMF_ESCAPE) {
+			pos++;
+			if(!smf_get_vlq(data, size, &pos, &length) || pos+length > size) {
+				return false;
+			}
+			e.status = (b == SMF_SYSEX) ? SMF_SYSEX : 0;
+			e.data = data+pos;
+			e.length = length;
+			if(!smf_add(events, &e)) {
+				return false;
+			}
+			pos += length;
+			running = 0;
+		} else {
+			if(b & 0x80) {
+				running = b;
+				pos++;
+			}
+			if(running < 0x80 || running >= SMF_SYSEX) {
+				return false;
+			}
+			// program change and channel pressure come with a single data byte
+			length = ((running & 0xe0) == 0xc0) ? 1 : 2;
+			if(pos+length > size) {
+				return false;
+			}
+			e.status = running;
+			e.data = data+pos;
+			e.length = length;
+			if(!smf_add(events, &e)) {
+				return false;
+			}
+			pos += length;
+		}
+	}
+	// no end of track - take what we got
+	return true;
+}
+
+int smf_compare(const void* a, const void* b) {
+	const smf_event_t* x = a;
+	const smf_event_t* y = b;
+	if(x->tick != y->tick) {
+		return x->tick < y->tick ? -1 : 1;
+	}
+	return x->order < y->order ? -1 : (x->order > y->order);
+}
+
+bool smf_detect(const uint8_t* data, size_t size) {
+	return size >= 14 && memcmp(data, "MThd", 4) == 0;
+}
+
+bool smf_read(const uint8_t* data, size_t size, smf_message_t f, void* context) {
+	smf_events_t events = {0, 0, 0};
+	size_t pos;
+	uint16_t num_tracks;
+	uint16_t division;
+	uint16_t i=0;
+	bool ok = true;
+	if(!smf_detect(data, size)) {
+		return false;
+	}
+	num_tracks = smf_get16(data+10);
+	division = smf_get16(data+12);
+	pos = 8+smf_get32(data+4);
+	for(;i<num_tracks && ok;i++) {
+		if(pos+8 > size) {
+			ok = false;
+			break;
+		}
+		uint32_t length = smf_get32(data+pos+4);
+		bool is_track = memcmp(data+pos, "MTrk", 4) == 0;
+		pos += 8;
+		if(length > size-pos) {
+			length = size-pos;
+			ok = false;
+		}
+		if(is_track) {
+			ok = smf_read_track(data+pos, length, &events) && ok;
+		} else {
+			// not a track - does not count
+			i--;
+		}
+		pos += length;
+	}
+	qsort(events.event, events.num_events, sizeof(smf_event_t), smf_compare);
+
+	// the time up to the last tempo change plus the ticks since then
+	uint64_t base_us = 0;
+	uint64_t base_tick = 0;
+	uint32_t tempo = SMF_DEFAULT_TEMPO;
+	uint8_t* message = 0;
+	uint32_t message_size = 0;
+	uint32_t j=0;
+	for(;j<events.num_events;j++) {
+		smf_event_t* e = events.event+j;
+		uint64_t time_us;
+		if(division & 0x8000) {
+			// SMPTE: frames per second (29 meaning 29.97) times ticks per frame
+			uint64_t fps100 = (uint8_t)(-(int8_t)(division>>8))*100;
+			if(fps100 == 2900) {
+				fps100 = 2997;
+			}
+			time_us = (e->tick*100000000ULL)/(fps100*(division & 0xff));
+		} else {
+			time_us = base_us + ((e->tick-base_tick)*tempo)/(division ? division : 1);
+		}
+		if(e->tempo) {
+			base_us = time_us;
+			base_tick = e->tick;
+			tempo = e->tempo;
+			continue;
+		}
+		if(e->length+1 > message_size) {
+			uint8_t* grown = realloc(message, e->length+1);
+			if(!grown) {
+				ok = false;
+				break;
+			}
+			message = grown;
+			message_size = e->length+1;
+		}
+		uint32_t length = 0;
+		if(e->status) {
+			message[length++] = e->status;
+		}
+		memcpy(message+length, e->data, e->length);
+		length += e->length;
+		if(length) {
+			f(time_us, message, length, context);
+		}
+	}
+	free(message);
+	free(events.event);
+	return ok;
+}
@@ -0,0 +1,41 @@
+#ifndef _SMF_H_
+#define _SMF_H_
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Reads Standard MIDI Files of format 0 and 1. The tracks get merged and
+ * the ticks turned into microseconds following the tempo changes.
+ * Meta events are dropped, running status gets expanded so every channel
+ * message comes with its status byte - just like most sequencers send them.
+ */
+
+/**
+ * \brief called for every message in the order they are to be sent
+ * \param in time_us the time since the start of the file
+ * \param in bytes the message as sent on the MIDI wire
+ * \param in length the number of bytes
+ * \param in context whatever got handed to smf_read
+ */
+typedef void (*smf_message_t)(uint64_t time_us, const uint8_t* bytes, uint32_t length, void* context);
+
+/**
+ * \brief Function to tell whether some data is a Standard MIDI File
+ * \param in data the file contents
+ * \param in size the number of bytes
+ * \return true if it starts with a MThd chunk
+ */
+bool smf_detect(const uint8_t* data, size_t size);
+
+/**
+ * \brief Function to read a whole Standard MIDI File
+ * \param in data the file contents
+ * \param in size the number of bytes
+ * \param in f called for every message
+ * \param in context handed on to f
+ * \return false if the file is broken - whatever could be read got handed to f anyway
+ */
+bool smf_read(const uint8_t* data, size_t size, smf_message_t f, void* context);
+
+#endif
@@ -1,19 +1,101 @@
 #include "analog_in.h"
-#include <avr/io.h>
+#include "hal.h"
+
+volatile uint16_t analog_in_value[NUM_ANALOG_IN_CHANNELS];
+volatile uint8_t analog_in_changed = 0;
+// the channel converted right now - NUM_ANALOG_IN_CHANNELS while idle
+volatile uint8_t analog_in_channel = NUM_ANALOG_IN_CHANNELS;
+uint8_t analog_in_samples = 0;
+uint16_t analog_in_sum = 0;
+
+void analog_in_select(uint8_t channel) {
+	analog_in_channel = channel;
+	analog_in_samples = 0;
+	analog_in_sum = 0;
+	ADMUX = (ADMUX & ~(0x1F))|(channel&0x1F);
+	ADCSRA |= (1<<ADSC);
+}
+
+// the next channel to scan after the given one - NUM_ANALOG_IN_CHANNELS at the end
+uint8_t analog_in_next_channel(uint8_t channel) {
+	while(++channel < NUM_ANALOG_IN_CHANNELS) {
+		if(ANALOG_IN_CHANNELS & ANALOG_IN_BIT(channel)) {
+			break;
+		}
+	}
+	return channel;
+}
 
 void init_analogin(void) {
+	uint8_t i=0;
 	ADMUX = (1<<REFS0); // take AVCC as reference
-	ADCSRA = (1<<ADPS1) | (1<<ADPS2); // pre-scaler
+	// pre-scaler 128 -> 125kHz ADC clock, ~104us per conversion (@16MHz Clock)
+	ADCSRA = (1<<ADPS0) | (1<<ADPS1) | (1<<ADPS2);
 	ADCSRA |= (1<<ADEN); // enable
-	ADCSRA |= (1<<ADSC); // one dummy read
-	while(ADCSRA & (1<<ADSC));
-	(void) ADCW;
+	ADCSRA |= (1<<ADIE); // conversion complete interrupt
+	for(;i<NUM_ANALOG_IN_CHANNELS;i++) {
+		// far off any value so the first scan counts as a change
+		analog_in_value[i] = 0xffff;
+	}
+	analog_in_changed = 0;
+	analog_in_channel = NUM_ANALOG_IN_CHANNELS;
+	analog_in_start_scan();
+}
+
+void analog_in_start_scan(void) {
+	uint8_t sreg = SREG;
+	cli();
+	if(analog_in_channel == NUM_ANALOG_IN_CHANNELS) {
+		uint8_t first = analog_in_next_channel(0xff);
+		if(first < NUM_ANALOG_IN_CHANNELS) {
+			analog_in_select(first);
+		}
+	}
+	SREG = sreg;
 }
 
 uint16_t analog_read(uint8_t channel) {
-	ADMUX = (ADMUX & ~(0x1F))|(channel&0x1F);
-	ADCSRA |= (1<<ADSC);
-	while(ADCSRA & (1<<ADSC));
-	return ADCW;
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t value = analog_in_value[channel];
+	SREG = sreg;
+	return (value > ANALOG_IN_MAX) ? 0 : value;
 }
 
+uint8_t analog_in_changes(void) {
+	uint8_t sreg = SREG;
+	cli();
+	uint8_t changed = analog_in_changed;
+	analog_in_changed = 0;
+	SREG = sreg;
+	return changed;
+}
+
+ISR(ADC_vect) {
+	uint8_t channel = analog_in_channel;
+	uint16_t sample = ADCW;
+	// the first conversion after switching the channel is thrown away
+	if(analog_in_samples++ == 0) {
+		ADCSRA |= (1<<ADSC);
+		return;
+	}
+	analog_in_sum += sample;
+	if(analog_in_samples <= ANALOG_IN_OVERSAMPLING) {
+		ADCSRA |= (1<<ADSC);
+		return;
+	}
+	uint16_t value = analog_in_sum/ANALOG_IN_OVERSAMPLING;
+	uint16_t last = analog_in_value[channel];
+	// the ends of the range have to be reachable in spite of the hysteresis
+	if(last > ANALOG_IN_MAX || value >= last+ANALOG_IN_HYSTERESIS || last >= value+ANALOG_IN_HYSTERESIS ||
+			(value != last && (value == 0 || value == ANALOG_IN_MAX))) {
+		analog_in_value[channel] = value;
+		analog_in_changed |= ANALOG_IN_BIT(channel);
+	}
+	channel = analog_in_next_channel(channel);
+	if(channel < NUM_ANALOG_IN_CHANNELS) {
+		analog_in_select(channel);
+	} else {
+		analog_in_channel = NUM_ANALOG_IN_CHANNELS;
+	}
+}
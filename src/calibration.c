@@ -0,0 +1,59 @@
+#include "calibration.h"
+#include "progmem.h"
+#include <string.h>
+
+// those voltages created for the values by the DAC
+// will be ~doubled by a OpAmp
+// (not exactly doubled because it's 127 at 5V but the
+// 10th octave completes at 120 already - so we must
+// land at something like
+//		(10V/120semitones)*127semitones = 10.5833V
+// if we output 5V from the dac for the 127th semitone
+// - that makes a factor of amplification of 2.1166666)
+const uint32_t calibration_default[NUM_CALIBRATION_POINTS] PROGMEM = {
+	6192, // calculated: ((2^16)/127)*1*12
+	12385,// calculated: ((2^16)/127)*2*12
+	18577,// calculated: ((2^16)/127)*3*12
+	24769,// ... u get it :-)
+		  // one semitone is ((2^16)/127) round about 516
+	30962,
+	37154,
+	43347,
+	49539,
+	55731,
+	61924,
+	68116
+};
+
+void calibration_init(calibration_t* c) {
+	memset(c, 0, sizeof(calibration_t));
+}
+
+uint32_t calibration_voltage(const calibration_t* c, uint8_t voice, uint8_t point) {
+	return pgm_read_dword(calibration_default+point) + c->delta[voice][point];
+}
+
+void calibration_adjust(calibration_t* c, uint8_t voice, uint8_t point, int16_t step) {
+	int32_t delta = (int32_t)c->delta[voice][point] + step;
+	if(delta > INT16_MAX) {
+		delta = INT16_MAX;
+	} else if(delta < INT16_MIN) {
+		delta = INT16_MIN;
+	}
+	c->delta[voice][point] = delta;
+}
+
+uint8_t calibration_get_byte(const calibration_t* c, uint16_t position) {
+	uint16_t delta = c->delta[0][position>>1];
+	return (position & 1) ? delta>>8 : delta & 0xff;
+}
+
+void calibration_put_byte(calibration_t* c, uint16_t position, uint8_t byte) {
+	uint16_t delta = c->delta[0][position>>1];
+	if(position & 1) {
+		delta = (delta & 0x00ff)|((uint16_t)byte<<8);
+	} else {
+		delta = (delta & 0xff00)|byte;
+	}
+	c->delta[0][position>>1] = delta;
+}
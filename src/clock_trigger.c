@@ -0,0 +1,35 @@
+#include "clock_trigger.h"
+#include "progmem.h"
+
+// 96 sub-clocks per quarter note
+const uint16_t clock_trigger_division[NUM_CLOCK_TRIGGER_MODES] PROGMEM = {
+	768,	// 2 bars
+	384,	// 1 bar
+	192,	// half note
+	96,		// quarter note
+	72,		// dotted 8th note
+	64,		// quarter note triplet
+	48,		// 8th note
+	36,		// dotted 16th note
+	32,		// 8th note triplet
+	24,		// 16th note
+	18,		// dotted 32th note
+	16,		// 16th note triplet
+	12,		// 32th note
+	4,		// 24 ppq - MIDI clock
+	2,		// 48 ppq
+	1		// 96 ppq
+};
+
+bool clock_trigger_fires(clock_trigger_t* t, uint32_t subclock_counter) {
+	return (subclock_counter % pgm_read_word(clock_trigger_division+t->mode)) == 0;
+}
+
+uint32_t clock_trigger_pulse_width(clock_trigger_t* t, uint32_t subclock_interval, uint32_t pulse_width) {
+	uint32_t max_width = (subclock_interval*pgm_read_word(clock_trigger_division+t->mode))/2;
+	// no tempo measured yet - just take what we are asked for
+	if(max_width == 0 || pulse_width < max_width) {
+		return pulse_width;
+	}
+	return max_width;
+}
@@ -9,11 +9,14 @@ typedef union {
 
 void __dac8568c_output_bytes(dac_command_t command, bool ldacswitch);
 
+// mode 1 at 8MHz (@16MHz Clock)
+spi_device_t dac8568c_spi;
+
 void dac8568c_init(void) {
 	init_spi();
 	DAC_DDR |= (1<<DAC_CS_PIN);
 	SPI_PORT &= ~(1<<SPI_MOSI);
-	DAC_PORT &= ~(1<<DAC_CS_PIN);
+	spi_device_init(&dac8568c_spi, SPI_MODE1, SPI_CLOCK_DIV2, &DAC_PORT, DAC_CS_PIN);
 	DAC_PORT |= (1<<DAC_LDAC_PIN);
 	DAC_PORT &= ~(1<<DAC_CLR_PIN);
 	__asm("nop\n\t");
@@ -71,10 +74,7 @@ void dac8568c_disable_internal_ref(void) {
 }
 
 void __dac8568c_output_bytes(dac_command_t command, bool ldacswitch){
-	// change to right clock phase for this chip
-	// ATTENTION: this is only save if this method cannot be interrupted by another method that might overwrite SPCR again!
-	SPCR |= (1<<CPHA);
-	DAC_PORT &= ~(1<<DAC_CS_PIN);
+	uint8_t sreg = spi_begin(&dac8568c_spi);
 	// wait till that pin is really set
 	__asm("nop\n\t");
 	spi_transfer(command.b[3]);
@@ -88,6 +88,6 @@ void __dac8568c_output_bytes(dac_command_t command, bool ldacswitch){
 		DAC_PORT |= (1<<DAC_LDAC_PIN);
 	}
 	__asm("nop\n\t");
-	DAC_PORT |= (1<<DAC_CS_PIN);
+	spi_end(&dac8568c_spi, sreg);
 }
 
@@ -0,0 +1,207 @@
+#include "eeprom_store.h"
+#include "hal.h"
+#ifdef __AVR__
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#endif
+
+#define EEPROM_SIZE	(E2END+1)
+
+uint8_t eeprom_store_version = 0;
+uint16_t eeprom_store_size = 0;
+eeprom_store_get_t eeprom_store_get = 0;
+eeprom_store_put_t eeprom_store_put = 0;
+uint8_t eeprom_store_num_slots = 0;
+// id and sequence of the valid record in each slot
+uint8_t eeprom_store_slot_id[EEPROM_STORE_MAX_SLOTS];
+uint32_t eeprom_store_slot_sequence[EEPROM_STORE_MAX_SLOTS];
+// sequence of the newest record of all
+uint32_t eeprom_store_sequence = 0;
+
+// the save running in the background
+const void* volatile eeprom_store_data = 0;
+uint8_t eeprom_store_id = 0;
+uint8_t eeprom_store_slot = 0;
+// saved right after the running save
+const void* volatile eeprom_store_next_data = 0;
+uint8_t eeprom_store_next_id = 0;
+uint16_t eeprom_store_address = 0;
+uint16_t eeprom_store_position = 0;
+uint16_t eeprom_store_crc = 0xffff;
+
+// reads and checks the record in the given slot - out may be 0 to check only
+bool eeprom_store_read_slot(uint8_t slot, void* out) {
+	uint16_t address = slot*EEPROM_STORE_RECORD_SIZE(eeprom_store_size);
+	uint16_t crc = 0xffff;
+	uint32_t sequence = 0;
+	uint16_t i=0;
+	uint8_t byte = eeprom_read_byte((const uint8_t*)(uintptr_t)address++);
+	if(byte != eeprom_store_version) {
+		return false;
+	}
+	crc = _crc16_update(crc, byte);
+	for(;i<4;i++) {
+		byte = eeprom_read_byte((const uint8_t*)(uintptr_t)address++);
+		crc = _crc16_update(crc, byte);
+		sequence |= (uint32_t)byte<<(8*i);
+	}
+	eeprom_store_slot_sequence[slot] = sequence;
+	eeprom_store_slot_id[slot] = eeprom_read_byte((const uint8_t*)(uintptr_t)address++);
+	crc = _crc16_update(crc, eeprom_store_slot_id[slot]);
+	for(i=0;i<eeprom_store_size;i++) {
+		byte = eeprom_read_byte((const uint8_t*)(uintptr_t)address++);
+		crc = _crc16_update(crc, byte);
+		if(out) {
+			eeprom_store_put(out, i, byte);
+		}
+	}
+	crc ^= eeprom_read_byte((const uint8_t*)(uintptr_t)address++);
+	crc ^= (uint16_t)eeprom_read_byte((const uint8_t*)(uintptr_t)address)<<8;
+	return crc == 0;
+}
+
+uint8_t eeprom_store_init(uint8_t version, uint16_t size, eeprom_store_get_t get, eeprom_store_put_t put) {
+	uint8_t slot=0;
+	bool found = false;
+	eeprom_store_version = version;
+	eeprom_store_size = size;
+	eeprom_store_get = get;
+	eeprom_store_put = put;
+	// nothing is being saved right after power up
+	eeprom_store_data = 0;
+	eeprom_store_next_data = 0;
+	eeprom_store_sequence = 0;
+	eeprom_store_num_slots = EEPROM_SIZE/EEPROM_STORE_RECORD_SIZE(size);
+	if(eeprom_store_num_slots > EEPROM_STORE_MAX_SLOTS) {
+		eeprom_store_num_slots = EEPROM_STORE_MAX_SLOTS;
+	}
+	for(;slot<eeprom_store_num_slots;slot++) {
+		if(!eeprom_store_read_slot(slot, 0)) {
+			eeprom_store_slot_id[slot] = EEPROM_STORE_NO_ID;
+			continue;
+		}
+		// 32 bits never wrap around - not even with a save every second for 100 years
+		if(!found || eeprom_store_slot_sequence[slot] > eeprom_store_sequence) {
+			found = true;
+			eeprom_store_sequence = eeprom_store_slot_sequence[slot];
+		}
+	}
+	return eeprom_store_num_slots;
+}
+
+// the slot holding the newest record of an id - eeprom_store_num_slots if there is none
+uint8_t eeprom_store_newest_slot(uint8_t id) {
+	uint8_t slot=0;
+	uint8_t newest = eeprom_store_num_slots;
+	for(;slot<eeprom_store_num_slots;slot++) {
+		if(eeprom_store_slot_id[slot] == id && (newest == eeprom_store_num_slots ||
+				eeprom_store_slot_sequence[slot] > eeprom_store_slot_sequence[newest])) {
+			newest = slot;
+		}
+	}
+	return newest;
+}
+
+// an empty slot or the one with the oldest outdated record - the newest
+// record of the id itself if there is nothing else left
+uint8_t eeprom_store_free_slot(uint8_t id) {
+	uint8_t slot=0;
+	uint8_t target = eeprom_store_num_slots;
+	for(;slot<eeprom_store_num_slots;slot++) {
+		uint8_t slot_id = eeprom_store_slot_id[slot];
+		if(slot_id == EEPROM_STORE_NO_ID) {
+			return slot;
+		}
+		if(eeprom_store_newest_slot(slot_id) != slot && (target == eeprom_store_num_slots ||
+				eeprom_store_slot_sequence[slot] < eeprom_store_slot_sequence[target])) {
+			target = slot;
+		}
+	}
+	if(target == eeprom_store_num_slots) {
+		target = eeprom_store_newest_slot(id);
+	}
+	return (target == eeprom_store_num_slots) ? 0 : target;
+}
+
+bool eeprom_store_load(uint8_t id, void* data) {
+	while(eeprom_store_busy());
+	uint8_t slot = eeprom_store_newest_slot(id);
+	if(slot == eeprom_store_num_slots) {
+		return false;
+	}
+	return eeprom_store_read_slot(slot, data);
+}
+
+// INFO: only call this with interrupts disabled
+void eeprom_store_start(void) {
+	eeprom_store_slot = eeprom_store_free_slot(eeprom_store_id);
+	// the record is gone as soon as the first byte gets written
+	eeprom_store_slot_id[eeprom_store_slot] = EEPROM_STORE_NO_ID;
+	eeprom_store_sequence++;
+	eeprom_store_address = eeprom_store_slot*EEPROM_STORE_RECORD_SIZE(eeprom_store_size);
+	eeprom_store_position = 0;
+	eeprom_store_crc = 0xffff;
+	EECR |= (1<<EERIE);
+}
+
+void eeprom_store_save(uint8_t id, const void* data) {
+	uint8_t sreg = SREG;
+	cli();
+	if(eeprom_store_data) {
+		eeprom_store_next_id = id;
+		eeprom_store_next_data = data;
+	} else {
+		eeprom_store_id = id;
+		eeprom_store_data = data;
+		eeprom_store_start();
+	}
+	SREG = sreg;
+}
+
+bool eeprom_store_busy(void) {
+	// the pointer takes two reads on the AVR - EE_RDY must not change it in between
+	uint8_t sreg = SREG;
+	cli();
+	bool busy = eeprom_store_data != 0;
+	SREG = sreg;
+	return busy;
+}
+
+ISR(EE_RDY_vect) {
+	uint8_t byte;
+	uint16_t position = eeprom_store_position;
+	if(position == 0) {
+		byte = eeprom_store_version;
+	} else if(position < EEPROM_STORE_HEADER_SIZE-1) {
+		byte = eeprom_store_sequence >> (8*(position-1));
+	} else if(position == EEPROM_STORE_HEADER_SIZE-1) {
+		byte = eeprom_store_id;
+	} else if(position < EEPROM_STORE_HEADER_SIZE+eeprom_store_size) {
+		byte = eeprom_store_get(eeprom_store_data, position-EEPROM_STORE_HEADER_SIZE);
+	} else if(position == EEPROM_STORE_HEADER_SIZE+eeprom_store_size) {
+		byte = eeprom_store_crc & 0xff;
+	} else {
+		byte = eeprom_store_crc >> 8;
+	}
+	if(position < EEPROM_STORE_HEADER_SIZE+eeprom_store_size) {
+		eeprom_store_crc = _crc16_update(eeprom_store_crc, byte);
+	}
+	// unchanged bytes are skipped - the interrupt comes right back for the next one.
+	// The EEPROM is ready in here, so this never waits.
+	eeprom_update_byte((uint8_t*)(uintptr_t)eeprom_store_address, byte);
+	eeprom_store_address++;
+	if(++eeprom_store_position < EEPROM_STORE_RECORD_SIZE(eeprom_store_size)) {
+		return;
+	}
+	eeprom_store_slot_id[eeprom_store_slot] = eeprom_store_id;
+	eeprom_store_slot_sequence[eeprom_store_slot] = eeprom_store_sequence;
+	if(eeprom_store_next_data) {
+		eeprom_store_id = eeprom_store_next_id;
+		eeprom_store_data = eeprom_store_next_data;
+		eeprom_store_next_data = 0;
+		eeprom_store_start();
+	} else {
+		EECR &= ~(1<<EERIE);
+		eeprom_store_data = 0;
+	}
+}
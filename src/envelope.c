@@ -0,0 +1,181 @@
+#include "envelope.h"
+
+void envelope_bank_init(envelope_bank_t* bank) {
+	uint8_t i=0;
+	for(;i<NUM_ENVELOPES;i++) {
+		bank->level[i] = 0;
+		bank->stage[i] = ENVELOPE_IDLE;
+	}
+	bank->gate = 0;
+	bank->shared = false;
+	envelope_set_attack(bank, 1);
+	envelope_set_decay(bank, 1);
+	envelope_set_sustain(bank, 0xffff);
+	envelope_set_release(bank, 1);
+}
+
+void envelope_set_attack(envelope_bank_t* bank, uint16_t ticks) {
+	bank->attack_rate = ENVELOPE_MAX/(ticks ? ticks : 1);
+}
+
+void envelope_set_decay(envelope_bank_t* bank, uint16_t ticks) {
+	bank->decay_rate = ENVELOPE_MAX/(ticks ? ticks : 1);
+}
+
+void envelope_set_sustain(envelope_bank_t* bank, uint16_t level) {
+	bank->sustain_level = (uint32_t)level<<8;
+}
+
+void envelope_set_release(envelope_bank_t* bank, uint16_t ticks) {
+	bank->release_rate = ENVELOPE_MAX/(ticks ? ticks : 1);
+}
+
+void envelope_set_gates(envelope_bank_t* bank, uint8_t gates) {
+	uint8_t i=0;
+	if(bank->shared) {
+		gates = gates ? (1<<NUM_ENVELOPES)-1 : 0;
+	}
+	uint8_t changed = gates ^ bank->gate;
+	if(!changed) {
+		return;
+	}
+	for(;i<NUM_ENVELOPES;i++) {
+		if(changed & (1<<i)) {
+			bank->stage[i] = (gates & (1<<i)) ? ENVELOPE_ATTACK : ENVELOPE_RELEASE;
+		}
+	}
+	bank->gate = gates;
+}
+
+void envelope_bank_tick(envelope_bank_t* bank) {
+	uint8_t i=0;
+	for(;i<NUM_ENVELOPES;i++) {
+		uint32_t level = bank->level[i];
+		switch(bank->stage[i]) {
+			case ENVELOPE_ATTACK:
+				level += bank->attack_rate;
+				if(level >= ENVELOPE_MAX) {
+					level = ENVELOPE_MAX;
+					bank->stage[i] = ENVELOPE_DECAY;
+				}
+				break;
+			case ENVELOPE_DECAY:
+				if(level <= bank->sustain_level + bank->decay_rate) {
+					level = bank->sustain_level;
+					bank->stage[i] = ENVELOPE_SUSTAIN;
+				} else {
+					level -= bank->decay_rate;
+				}
+				break;
+			case ENVELOPE_RELEASE:
+				if(level <= bank->release_rate) {
+					level = 0;
+					bank->stage[i] = ENVELOPE_IDLE;
+				} else {
+					level -= bank->release_rate;
+				}
+				break;
+			case ENVELOPE_SUSTAIN:
+				// follow the sustain level while it gets turned
+				level = bank->sustain_level;
+				break;
+			default:
+				break;
+		}
+		bank->level[i] = level;
+	}
+}
+
+uint16_t envelope_value(envelope_bank_t* bank, uint8_t n) {
+	return bank->level[n]>>8;
+}
+
+#ifndef __AVR__
+
+// count ticks of a stage changing the level by step each (negative steps
+// wrap around) - returns the level after them
+static uint32_t envelope_ramp(uint16_t* restrict out, uint32_t level, uint32_t step, uint16_t count) {
+	uint16_t k=0;
+	for(;k<count;k++) {
+		out[k] = (level + (k+1)*step)>>8;
+	}
+	return level + count*step;
+}
+
+static void envelope_fill(uint16_t* restrict out, uint16_t value, uint16_t count) {
+	uint16_t k=0;
+	for(;k<count;k++) {
+		out[k] = value;
+	}
+}
+
+static void envelope_render_block(envelope_bank_t* bank, uint8_t n, uint16_t* out, uint16_t length) {
+	uint32_t level = bank->level[n];
+	uint8_t stage = bank->stage[n];
+	uint16_t k=0;
+	while(k < length) {
+		// the ticks left in the stage before the one ending it
+		uint32_t run = 0;
+		switch(stage) {
+			case ENVELOPE_ATTACK:
+				if(level < ENVELOPE_MAX) {
+					run = (ENVELOPE_MAX - level - 1)/bank->attack_rate;
+				}
+				run = run < (uint32_t)(length-k) ? run : (uint32_t)(length-k);
+				level = envelope_ramp(out+k, level, bank->attack_rate, run);
+				k += run;
+				if(k < length) {
+					level = ENVELOPE_MAX;
+					stage = ENVELOPE_DECAY;
+					out[k++] = level>>8;
+				}
+				break;
+			case ENVELOPE_DECAY:
+				if(level > bank->sustain_level) {
+					run = (level - bank->sustain_level - 1)/bank->decay_rate;
+				}
+				run = run < (uint32_t)(length-k) ? run : (uint32_t)(length-k);
+				level = envelope_ramp(out+k, level, -bank->decay_rate, run);
+				k += run;
+				if(k < length) {
+					level = bank->sustain_level;
+					stage = ENVELOPE_SUSTAIN;
+					out[k++] = level>>8;
+				}
+				break;
+			case ENVELOPE_RELEASE:
+				if(level > 0) {
+					run = (level - 1)/bank->release_rate;
+				}
+				run = run < (uint32_t)(length-k) ? run : (uint32_t)(length-k);
+				level = envelope_ramp(out+k, level, -bank->release_rate, run);
+				k += run;
+				if(k < length) {
+					level = 0;
+					stage = ENVELOPE_IDLE;
+					out[k++] = level>>8;
+				}
+				break;
+			case ENVELOPE_SUSTAIN:
+				level = bank->sustain_level;
+				envelope_fill(out+k, level>>8, length-k);
+				k = length;
+				break;
+			default:
+				envelope_fill(out+k, level>>8, length-k);
+				k = length;
+				break;
+		}
+	}
+	bank->level[n] = level;
+	bank->stage[n] = stage;
+}
+
+void envelope_bank_render_block(envelope_bank_t* bank, uint16_t* out, uint16_t length) {
+	uint8_t i=0;
+	for(;i<NUM_ENVELOPES;i++) {
+		envelope_render_block(bank, i, out + i*length, length);
+	}
+}
+
+#endif
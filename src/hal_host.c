@@ -0,0 +1,147 @@
+#include "hal.h"
+#include "dac8568c.h"
+#include "sr74hc165.h"
+#include "uart.h"
+#include "stack_monitor.h"
+#include <string.h>
+
+// the mocks of all drivers for running the firmware anywhere but on the AVR
+
+volatile uint8_t PORTB, DDRB, PINB;
+volatile uint8_t PORTC, DDRC, PINC;
+volatile uint8_t PORTD, DDRD, PIND;
+volatile uint8_t TIMSK, TIFR, SREG;
+volatile uint8_t EECR;
+volatile uint8_t ADMUX, ADCSRA;
+volatile uint16_t OCR1A, OCR1B;
+
+timebase_t hal_host_time = 0;
+uint16_t hal_host_dac[HAL_HOST_NUM_DAC_CHANNELS];
+uint8_t hal_host_panel[HAL_HOST_NUM_SHIFTIN_REG];
+uint16_t hal_host_analog_in[8];
+uint8_t hal_host_uart_rx = 0;
+hal_host_dac_hook_t hal_host_dac_hook = 0;
+hal_host_uart_hook_t hal_host_uart_tx_hook = 0;
+
+uint8_t hal_host_eeprom[E2END+1];
+uint8_t hal_host_ram[RAMEND+1];
+uint16_t hal_host_ram_end = 0x60;
+uint16_t hal_host_sp = RAMEND;
+
+void timebase_init(void) {
+}
+
+timebase_t timebase_now(void) {
+	return hal_host_time;
+}
+
+void dac8568c_init(void) {
+}
+
+void dac8568c_write(uint8_t command, uint8_t address, uint16_t data) {
+	if(address >= HAL_HOST_NUM_DAC_CHANNELS) {
+		return;
+	}
+	hal_host_dac[address] = data;
+	if(hal_host_dac_hook) {
+		hal_host_dac_hook(address, data);
+	}
+}
+
+void dac8568c_enable_internal_ref(void) {
+}
+
+void dac8568c_disable_internal_ref(void) {
+}
+
+void sr74hc165_init(void) {
+}
+
+void sr74hc165_read(unsigned char* output_buffer, uint8_t num_modules) {
+	uint8_t i=0;
+	for(;i<num_modules && i<HAL_HOST_NUM_SHIFTIN_REG;i++) {
+		output_buffer[i] = hal_host_panel[i];
+	}
+}
+
+void uart_init(void) {
+}
+
+bool uart_putc(unsigned char c) {
+	if(hal_host_uart_tx_hook) {
+		hal_host_uart_tx_hook(c);
+	}
+	return true;
+}
+
+bool uart_try_putc(unsigned char c) {
+	return uart_putc(c);
+}
+
+bool uart_put_realtime(unsigned char c) {
+	return uart_putc(c);
+}
+
+bool uart_puts(char* s) {
+	while(*s) {
+		uart_putc(*s++);
+	}
+	return true;
+}
+
+bool uart_getc(char* out) {
+	*out = hal_host_uart_rx;
+	return true;
+}
+
+// analog_in runs as it is - each conversion gives the value set for its channel
+void hal_host_set_analog_in(uint8_t channel, uint16_t value) {
+	hal_host_analog_in[channel] = value;
+}
+
+void hal_host_adc_finish(void) {
+	while(ADCSRA & (1<<ADSC)) {
+		ADCSRA &= ~(1<<ADSC);
+		ADC_vect();
+	}
+}
+
+// eeprom_store runs as it is - only the EEPROM itself is a byte array
+uint8_t eeprom_read_byte(const uint8_t* address) {
+	return hal_host_eeprom[(uintptr_t)address];
+}
+
+void eeprom_update_byte(uint8_t* address, uint8_t value) {
+	hal_host_eeprom[(uintptr_t)address] = value;
+}
+
+// the same as in avr-libc
+uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+	uint8_t i=0;
+	crc ^= a;
+	for(;i<8;i++) {
+		if(crc & 1) {
+			crc = (crc >> 1) ^ 0xa001;
+		} else {
+			crc = (crc >> 1);
+		}
+	}
+	return crc;
+}
+
+void hal_host_eeprom_clear(void) {
+	memset(hal_host_eeprom, 0xff, sizeof(hal_host_eeprom));
+}
+
+void hal_host_eeprom_finish(void) {
+	while(EECR & (1<<EERIE)) {
+		EE_RDY_vect();
+	}
+}
+
+void hal_host_set_stack(uint16_t variables, uint16_t unused, uint16_t free_now) {
+	hal_host_ram_end = 0x60+variables;
+	hal_host_sp = hal_host_ram_end+free_now;
+	memset(hal_host_ram, 0, sizeof(hal_host_ram));
+	memset(hal_host_ram+hal_host_ram_end, STACK_MONITOR_CANARY, unused);
+}
@@ -0,0 +1,93 @@
+#include "latency.h"
+
+#ifdef LATENCY
+
+uint8_t latency_bucket(uint16_t ticks) {
+	uint8_t octave = LATENCY_FIRST_OCTAVE;
+	uint8_t bucket;
+	if(ticks < (1U<<LATENCY_FIRST_OCTAVE)) {
+		return 0;
+	}
+	while(octave < 15 && (ticks>>(octave+1))) {
+		octave++;
+	}
+	bucket = 1 + (octave-LATENCY_FIRST_OCTAVE)*2 + ((ticks>>(octave-1)) & 1);
+	return bucket < NUM_LATENCY_BUCKETS ? bucket : NUM_LATENCY_BUCKETS-1;
+}
+
+uint16_t latency_bucket_start(uint8_t bucket) {
+	uint8_t octave;
+	if(bucket == 0) {
+		return 0;
+	}
+	octave = LATENCY_FIRST_OCTAVE + (bucket-1)/2;
+	return (1U<<octave) + (((bucket-1) & 1) ? (1U<<(octave-1)) : 0);
+}
+
+latency_t latency[NUM_LATENCY_CLASSES];
+uint16_t latency_received[RINGBUFFER_SIZE];
+uint16_t latency_pending_received[LATENCY_PENDING];
+uint8_t latency_pending_class[LATENCY_PENDING];
+uint8_t latency_num_pending = 0;
+#ifndef __AVR__
+latency_hook_t latency_hook = 0;
+#endif
+
+void latency_reset(uint8_t c) {
+	stats_reset(&latency[c].stats, latency[c].histogram, NUM_LATENCY_BUCKETS);
+}
+
+void latency_init(void) {
+	uint8_t i=0;
+	for(;i<NUM_LATENCY_CLASSES;i++) {
+		latency_reset(i);
+	}
+	latency_num_pending = 0;
+}
+
+void latency_handled(uint8_t c, uint8_t position) {
+	if(latency_num_pending == LATENCY_PENDING) {
+		return;
+	}
+	latency_pending_received[latency_num_pending] = latency_received[position];
+	latency_pending_class[latency_num_pending] = c;
+	latency_num_pending++;
+}
+
+void latency_output(uint8_t classes) {
+	uint16_t now = (uint16_t)timebase_now();
+	uint8_t i=0;
+	uint8_t kept=0;
+	for(;i<latency_num_pending;i++) {
+		if(classes & LATENCY_CLASS_BIT(latency_pending_class[i])) {
+			latency_record(latency_pending_class[i], now - latency_pending_received[i]);
+		} else {
+			latency_pending_received[kept] = latency_pending_received[i];
+			latency_pending_class[kept] = latency_pending_class[i];
+			kept++;
+		}
+	}
+	latency_num_pending = kept;
+}
+
+void latency_record(uint8_t c, uint16_t ticks) {
+#ifndef __AVR__
+	if(latency_hook) {
+		latency_hook(c, ticks);
+	}
+#endif
+	stats_record(&latency[c].stats, latency[c].histogram, NUM_LATENCY_BUCKETS, latency_bucket(ticks), ticks);
+}
+
+uint8_t latency_sysex(uint8_t c, uint8_t* out) {
+	uint8_t* start = out;
+	*out++ = 0xf0;
+	*out++ = LATENCY_SYSEX_ID;
+	*out++ = LATENCY_SYSEX_TYPE;
+	*out++ = c;
+	out = stats_sysex(&latency[c].stats, latency[c].histogram, NUM_LATENCY_BUCKETS, out);
+	*out++ = 0xf7;
+	return out-start;
+}
+
+#endif
@@ -1,22 +1,281 @@
 #include "lfo.h"
+#include "progmem.h"
 
-uint16_t __get_rev_sawtooth(lfo_t* lfo) {
-	return 0xffff - (lfo->position%0xffff);
+static void lfo_group_shapes(lfo_bank_t* bank) {
+	uint8_t i=0;
+	for(;i<NUM_LFO_SHAPES;i++) {
+		bank->shape_count[i] = 0;
+	}
+	for(i=0;i<NUM_LFO;i++) {
+		uint8_t shape = bank->shape[i];
+		bank->shape_member[shape][bank->shape_count[shape]++] = i;
+	}
 }
 
-uint16_t __get_sawtooth(lfo_t* lfo) {
-	return lfo->position%0xffff;
+void lfo_bank_init(lfo_bank_t* bank) {
+	uint8_t i=0;
+	for(;i<NUM_LFO;i++) {
+		bank->position[i] = 0;
+		bank->stepwidth[i] = 1;
+		bank->value[i] = 0;
+		bank->clock_mode[i] = 0;
+		bank->shape[i] = TRIANGLE;
+	}
+	bank->clock_sync = 0;
+	bank->retrigger_on_new_note = 0;
+	bank->midiclock_period = 0;
+	// any value but 0 - xorshift would get stuck on it
+	bank->random_seed = 0xace1;
+	for(i=0;i<NUM_LFO;i++) {
+		bank->random_last[i] = lfo_random(bank);
+		bank->random_value[i] = lfo_random(bank);
+	}
+	bank->new_cycle = 0;
+	lfo_group_shapes(bank);
 }
 
-uint16_t __get_pulse(lfo_t* lfo) {
-	return (lfo->position%0xffff > LFO_HALF_TABLE_LENGTH) ? 0x0000 : 0xffff;
+void lfo_restart(lfo_bank_t* bank, uint8_t n) {
+	bank->position[n] = 0;
+	bank->new_cycle |= LFO_BIT(n);
 }
 
-uint16_t __get_triangle(lfo_t* lfo) {
-	return (lfo->position%0xffff > LFO_HALF_TABLE_LENGTH) ? (LFO_TABLE_LENGTH - lfo->position%0xffff)*2 : lfo->position%0xffff*2;
+uint16_t lfo_random(lfo_bank_t* bank) {
+	uint16_t x = bank->random_seed;
+	x ^= x<<7;
+	x ^= x>>9;
+	x ^= x<<8;
+	bank->random_seed = x;
+	return x;
 }
 
-get_lfo_value_t lfo_get_rev_sawtooth = &__get_rev_sawtooth;
-get_lfo_value_t lfo_get_sawtooth = &__get_sawtooth;
-get_lfo_value_t lfo_get_pulse = &__get_pulse;
-get_lfo_value_t lfo_get_triangle = &__get_triangle;
+void lfo_set_shape(lfo_bank_t* bank, uint8_t n, uint8_t shape) {
+	if(bank->shape[n] == shape || shape >= NUM_LFO_SHAPES) {
+		return;
+	}
+	bank->shape[n] = shape;
+	lfo_group_shapes(bank);
+}
+
+void lfo_set_clock_sync(lfo_bank_t* bank, uint8_t n, bool sync) {
+	if(sync == ((bank->clock_sync & LFO_BIT(n)) != 0)) {
+		return;
+	}
+	bank->clock_sync ^= LFO_BIT(n);
+	// have the stepwidth calculated on the next advance
+	bank->midiclock_period = 0;
+}
+
+void lfo_set_clock_mode(lfo_bank_t* bank, uint8_t n, uint8_t clock_mode) {
+	if(bank->clock_mode[n] == clock_mode) {
+		return;
+	}
+	bank->clock_mode[n] = clock_mode;
+	bank->midiclock_period = 0;
+}
+
+void lfo_bank_advance(lfo_bank_t* bank, uint8_t elapsed_ticks, uint32_t midiclock_period) {
+	uint8_t i=0;
+	// the division is by far the most expensive part - only do it on tempo changes
+	if(bank->clock_sync && midiclock_period != bank->midiclock_period) {
+		// no tempo (yet) - like after START or STOP - keeps the stepwidths.
+		// Below MAX_MIDICLOCK_PERIOD the cycle length fits 32 bits.
+		if(midiclock_period != 0 && midiclock_period < MAX_MIDICLOCK_PERIOD) {
+			for(;i<NUM_LFO;i++) {
+				if(bank->clock_sync & LFO_BIT(i)) {
+					uint32_t cycle_length = midiclock_period*pgm_read_word(clock_limit+bank->clock_mode[i]);
+					uint32_t stepwidth = ((uint32_t)LFO_TABLE_LENGTH*LFO_TICK) / cycle_length;
+					if(stepwidth > 0xffff) {
+						stepwidth = 0xffff;
+					} else if(stepwidth == 0) {
+						stepwidth = 1;
+					}
+					bank->stepwidth[i] = stepwidth;
+				}
+			}
+		}
+		bank->midiclock_period = midiclock_period;
+	}
+	for(i=0;i<NUM_LFO;i++) {
+		uint32_t step = (uint32_t)bank->stepwidth[i]*elapsed_ticks;
+		if(step >= LFO_TABLE_LENGTH) {
+			step %= LFO_TABLE_LENGTH;
+			bank->new_cycle |= LFO_BIT(i);
+		}
+		uint32_t position = bank->position[i] + step;
+		if(position >= LFO_TABLE_LENGTH) {
+			position -= LFO_TABLE_LENGTH;
+			bank->new_cycle |= LFO_BIT(i);
+		}
+		bank->position[i] = position;
+	}
+}
+
+void lfo_bank_render(lfo_bank_t* bank) {
+	uint8_t i;
+	uint8_t n;
+	uint8_t* member;
+
+	member = bank->shape_member[REV_SAWTOOTH];
+	for(i=0;i<bank->shape_count[REV_SAWTOOTH];i++) {
+		n = member[i];
+		bank->value[n] = 0xffff - bank->position[n];
+	}
+	member = bank->shape_member[TRIANGLE];
+	for(i=0;i<bank->shape_count[TRIANGLE];i++) {
+		n = member[i];
+		uint16_t position = bank->position[n];
+		bank->value[n] = (position > LFO_HALF_TABLE_LENGTH) ? (LFO_TABLE_LENGTH - position)*2 : position*2;
+	}
+	member = bank->shape_member[PULSE];
+	for(i=0;i<bank->shape_count[PULSE];i++) {
+		n = member[i];
+		bank->value[n] = (bank->position[n] > LFO_HALF_TABLE_LENGTH) ? 0x0000 : 0xffff;
+	}
+	member = bank->shape_member[SAWTOOTH];
+	for(i=0;i<bank->shape_count[SAWTOOTH];i++) {
+		n = member[i];
+		bank->value[n] = bank->position[n];
+	}
+	// the random shapes only touch the generator once per cycle
+	if(bank->new_cycle) {
+		for(n=0;n<NUM_LFO;n++) {
+			if((bank->new_cycle & LFO_BIT(n)) && bank->shape[n] >= SAMPLE_HOLD) {
+				bank->random_last[n] = bank->random_value[n];
+				bank->random_value[n] = lfo_random(bank);
+			}
+		}
+		bank->new_cycle = 0;
+	}
+	member = bank->shape_member[SAMPLE_HOLD];
+	for(i=0;i<bank->shape_count[SAMPLE_HOLD];i++) {
+		n = member[i];
+		bank->value[n] = bank->random_value[n];
+	}
+	member = bank->shape_member[SMOOTH_RANDOM];
+	for(i=0;i<bank->shape_count[SMOOTH_RANDOM];i++) {
+		n = member[i];
+		// glide from the last random value to the current one during the cycle
+		// (position taken down to 15 bit to keep the product within 32 bit)
+		int32_t delta = (int32_t)bank->random_value[n] - bank->random_last[n];
+		bank->value[n] = bank->random_last[n] + ((delta*(bank->position[n]>>1))>>15);
+	}
+	member = bank->shape_member[RANDOM_GATE];
+	for(i=0;i<bank->shape_count[RANDOM_GATE];i++) {
+		n = member[i];
+		// a coin flip per cycle whether or not there is a gate in its first half
+		bank->value[n] = ((bank->random_value[n] & 0x8000) && bank->position[n] <= LFO_HALF_TABLE_LENGTH) ? 0xffff : 0x0000;
+	}
+}
+
+#ifndef __AVR__
+
+// the block renderer works through this many samples at a time
+#define LFO_BLOCK_CHUNK	(64)
+
+static void lfo_render_chunk(lfo_bank_t* bank, uint8_t elapsed_ticks, uint16_t* out, uint16_t stride, uint16_t count) {
+	uint8_t new_cycle[LFO_BLOCK_CHUNK] = {0};
+	uint16_t random_value[NUM_LFO][LFO_BLOCK_CHUNK];
+	uint16_t random_last[NUM_LFO][LFO_BLOCK_CHUNK];
+	uint8_t random = 0;
+	uint16_t k;
+	uint8_t n=0;
+
+	// the positions go straight to the output, the shapes are applied on them
+	for(;n<NUM_LFO;n++) {
+		uint16_t* o = out + n*stride;
+		uint32_t step = (uint32_t)bank->stepwidth[n]*elapsed_ticks;
+		uint32_t position = bank->position[n];
+		uint8_t every_cycle = 0;
+		if(step >= LFO_TABLE_LENGTH) {
+			step %= LFO_TABLE_LENGTH;
+			every_cycle = LFO_BIT(n);
+		}
+		for(k=0;k<count;k++) {
+			position += step;
+			if(position >= LFO_TABLE_LENGTH) {
+				position -= LFO_TABLE_LENGTH;
+				new_cycle[k] |= LFO_BIT(n);
+			}
+			new_cycle[k] |= every_cycle;
+			o[k] = position;
+		}
+		bank->position[n] = position;
+		if(bank->shape[n] >= SAMPLE_HOLD) {
+			random |= LFO_BIT(n);
+		}
+	}
+	new_cycle[0] |= bank->new_cycle;
+	bank->new_cycle = 0;
+
+	// the random values get drawn sample by sample - all LFOs share the
+	// generator, so the order has to be the one of lfo_bank_render
+	if(random) {
+		for(k=0;k<count;k++) {
+			uint8_t draw = new_cycle[k] & random;
+			for(n=0;n<NUM_LFO;n++) {
+				if(draw & LFO_BIT(n)) {
+					bank->random_last[n] = bank->random_value[n];
+					bank->random_value[n] = lfo_random(bank);
+				}
+				random_value[n][k] = bank->random_value[n];
+				random_last[n][k] = bank->random_last[n];
+			}
+		}
+	}
+
+	for(n=0;n<NUM_LFO;n++) {
+		uint16_t* restrict o = out + n*stride;
+		const uint16_t* restrict value = random_value[n];
+		const uint16_t* restrict last = random_last[n];
+		switch(bank->shape[n]) {
+			case REV_SAWTOOTH:
+				for(k=0;k<count;k++) {
+					o[k] = 0xffff - o[k];
+				}
+				break;
+			case TRIANGLE:
+				for(k=0;k<count;k++) {
+					o[k] = (o[k] > LFO_HALF_TABLE_LENGTH) ? (LFO_TABLE_LENGTH - o[k])*2 : o[k]*2;
+				}
+				break;
+			case PULSE:
+				for(k=0;k<count;k++) {
+					o[k] = (o[k] > LFO_HALF_TABLE_LENGTH) ? 0x0000 : 0xffff;
+				}
+				break;
+			case SAMPLE_HOLD:
+				for(k=0;k<count;k++) {
+					o[k] = value[k];
+				}
+				break;
+			case SMOOTH_RANDOM:
+				for(k=0;k<count;k++) {
+					int32_t delta = (int32_t)value[k] - last[k];
+					o[k] = last[k] + ((delta*(o[k]>>1))>>15);
+				}
+				break;
+			case RANDOM_GATE:
+				for(k=0;k<count;k++) {
+					o[k] = ((value[k] & 0x8000) && o[k] <= LFO_HALF_TABLE_LENGTH) ? 0xffff : 0x0000;
+				}
+				break;
+			default:
+				// the sawtooth is the position itself
+				break;
+		}
+		bank->value[n] = o[count-1];
+	}
+}
+
+void lfo_bank_render_block(lfo_bank_t* bank, uint8_t elapsed_ticks, uint32_t midiclock_period, uint16_t* out, uint16_t length) {
+	uint16_t done = 0;
+	// only the first advance of the block can see a new tempo
+	lfo_bank_advance(bank, 0, midiclock_period);
+	while(done < length) {
+		uint16_t count = (length-done < LFO_BLOCK_CHUNK) ? length-done : LFO_BLOCK_CHUNK;
+		lfo_render_chunk(bank, elapsed_ticks, out+done, length, count);
+		done += count;
+	}
+}
+
+#endif
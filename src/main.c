@@ -10,12 +10,20 @@
 #include "polyphonic.h"
 #include "unison.h"
 #include "lfo.h"
+#include "envelope.h"
 #include "clock_trigger.h"
+#include "timebase.h"
+#include "scheduler.h"
+#include "profile.h"
+#include "latency.h"
+#include "eeprom_store.h"
+#include "calibration.h"
+#include "progmem.h"
+#include "stack_monitor.h"
+
+#include "hal.h"
 
 #include <string.h>
-#include <avr/io.h>
-#include <avr/eeprom.h>
-#include <avr/interrupt.h>
 
 #define GATE_PORT	PORTD
 #define GATE_DDR	DDRD
@@ -34,14 +42,16 @@
 #define LFO_RATE_POTI0	(4)
 
 #define CLOCK_RATE_POTI0	(2)
+// pots which moved but did not get applied yet - all of them to start with
+uint8_t pending_pots = ANALOG_IN_CHANNELS;
 
 #define NUM_PLAY_MODES	(2)
 #define POLYPHONIC_MODE	(0)
 #define UNISON_MODE		(1)
 
 // User Input defines
-#define ANALOG_READ_COUNTER (2)
-#define SHIFTIN_TRIGGER		(6)
+#define PANEL_READ_PERIOD	MS_TO_TIMEBASE(100)
+#define POTS_READ_PERIOD	MS_TO_TIMEBASE(50)
 #define NUM_SHIFTIN_REG		(2)
 
 /*
@@ -108,61 +118,40 @@ const uint8_t lfo_offset[2] = {
  * playing (but maybe on another channel...)
  */
 
-// those voltages created for the values by the DAC
-// will be ~doubled by a OpAmp
-// (not exactly doubled because it's 127 at 5V but the
-// 10th octave completes at 120 already - so we must
-// land at something like
-//		(10V/120semitones)*127semitones = 10.5833V
-// if we output 5V from the dac for the 127th semitone
-// - that makes a factor of amplification of 2.1166666)
-uint32_t voltage[NUM_PLAY_NOTES][11] = {
-	6192, // calculated: ((2^16)/127)*1*12
-	12385,// calculated: ((2^16)/127)*2*12
-	18577,// calculated: ((2^16)/127)*3*12
-	24769,// ... u get it :-)
-		  // one semitone is ((2^16)/127) round about 516
-	30962,
-	37154,
-	43347,
-	49539,
-	55731,
-	61924,
-	68116
-};
-
-// also put the values into eeprom
-// reason for doubling of variable: reading from eeprom only on boot (slow and 
-// disables and enables the interrupts - not nice while playing and relying on MIDI)
-// and writing only on calibration
-uint32_t voltage_eeprom[NUM_PLAY_NOTES][11] EEMEM = {
-	6192, // calculated: ((2^16)/127)*1*12
-	12385,// calculated: ((2^16)/127)*2*12
-	18577,// calculated: ((2^16)/127)*3*12
-	24769,// ... u get it :-)
-		  // one semitone is ((2^16)/127) round about 516
-	30962,
-	37154,
-	43347,
-	49539,
-	55731,
-	61924,
-	68116
-};
-
-uint8_t cc_message[4] = {
+const uint8_t default_cc_message[4] PROGMEM = {
 	16,
 	17,
 	18,
 	19
 };
 
-uint8_t cc_message_eeprom[4] EEMEM = {
-	16,
-	17,
-	18,
-	19
+// everything kept in the EEPROM - changed in CONTROL_MODE only
+// bump SETTINGS_VERSION on any change of this struct or its record
+#define SETTINGS_VERSION	(3)
+typedef struct settings_t settings_t;
+struct settings_t {
+	calibration_t calibration;
+	uint8_t cc_message[4];
+	uint8_t global_options;
 };
+#define SETTINGS_RECORD_SIZE	(CALIBRATION_PACKED_SIZE+4+1)
+settings_t settings_buffer[2];
+// the saved settings and the ones in use - the latter point to a working
+// copy of the former while in CONTROL_MODE
+settings_t* saved_settings = settings_buffer;
+settings_t* settings = settings_buffer;
+
+// each preset is a record of its own in the EEPROM - Program Change
+// switches over to another one
+#ifndef NUM_PRESETS
+#pragma message "NUM_PRESETS not defined - defaulting to 4"
+#define NUM_PRESETS	(4)
+#endif
+#if (NUM_PRESETS+1)*EEPROM_STORE_RECORD_SIZE(SETTINGS_RECORD_SIZE) > E2END+1 || NUM_PRESETS+1 > EEPROM_STORE_MAX_SLOTS
+#error "NUM_PRESETS+1 records do not fit into the EEPROM"
+#endif
+uint8_t preset = 0;
+uint8_t next_preset = 0;
 
 cc_t cc_value[4] = {
 	0,
@@ -172,14 +161,16 @@ cc_t cc_value[4] = {
 };
 
 #define CC_INSTEAD_OF_VELOCITY	(0)
-uint8_t global_options = 0x00;
-uint8_t EEMEM global_options_eeprom = 0x00;
+#define SEND_INTERNAL_CLOCK		(1)
+#define RANDOM_PANEL_LFO		(2)
+#define SHARED_ENVELOPE			(3)
 
 uint16_t pitchbend = 0x2000; // middle_position
 
 // 24 CLOCK_SIGNALs per Beat (Quarter note)
 // 768 - 8 bars; 96 - 1 bar or 1 full note; 48 - half note; ... 3 - 32th note
-uint16_t clock_limit[12] = {
+#define NUM_CLOCK_LIMITS	(12)
+const uint16_t clock_limit[NUM_CLOCK_LIMITS] PROGMEM = {
 	1536,
 	768,
 	384,
@@ -199,32 +190,91 @@ midinote_stack_t note_stack;
 playingnote_t playing_notes[NUM_PLAY_NOTES];
 playmode_t mode[NUM_PLAY_MODES];
 uint8_t playmode = POLYPHONIC_MODE;
-volatile bool must_update_dac = false;
-uint8_t shift_in_trigger_counter = SHIFTIN_TRIGGER;
-volatile bool get_shiftin = false;
-uint8_t analog_in_counter = ANALOG_READ_COUNTER;
-volatile bool get_analogin = false;
 
-volatile bool update_clock = false;
+// the main loop only runs these tasks - most urgent first
+#define TASK_MIDI			(0)
+#define TASK_DAC			(1)
+#define TASK_CLOCK			(2)
+#define TASK_CLOCK_OUTPUT	(3)
+#define TASK_LFO			(4)
+#define TASK_PANEL			(5)
+#define TASK_POTS			(6)
+#define TASK_PRESET			(7)
+#define TASK_STACK_MONITOR	(8)
+#ifdef PROFILING
+#define TASK_PROFILE		(9)
+#define NUM_PROFILE_TASKS	(1)
+#else
+#define NUM_PROFILE_TASKS	(0)
+#endif
+#ifdef LATENCY
+#define TASK_LATENCY		(9+NUM_PROFILE_TASKS)
+#define NUM_LATENCY_TASKS	(1)
+#else
+#define NUM_LATENCY_TASKS	(0)
+#endif
+#define NUM_TASKS			(9+NUM_PROFILE_TASKS+NUM_LATENCY_TASKS)
+task_t task[NUM_TASKS];
+
+// any value sends a SysEx message with the RAM and stack usage to MIDI OUT
+#define STACK_MONITOR_CC	(103)
+uint8_t stack_monitor_message[STACK_MONITOR_SYSEX_LENGTH];
+uint8_t stack_monitor_message_length = 0;
+uint8_t stack_monitor_message_sent = 0;
+
+#ifdef PROFILING
+// value 0 sends a SysEx message per hot path to MIDI OUT, 127 clears them all
+#define PROFILE_CC			(102)
+uint8_t profile_message[PROFILE_SYSEX_LENGTH];
+uint8_t profile_message_length = 0;
+uint8_t profile_message_sent = 0;
+uint8_t profile_next_path = NUM_PROFILE_PATHS;
+#endif
+
+#ifdef LATENCY
+// value 0 sends a SysEx message per message class to MIDI OUT, 127 clears them all
+#define LATENCY_CC			(104)
+uint8_t latency_message[LATENCY_SYSEX_LENGTH];
+uint8_t latency_message_length = 0;
+uint8_t latency_message_sent = 0;
+uint8_t latency_next_class = NUM_LATENCY_CLASSES;
+#endif
+// where the last byte of the message just taken from the MIDI input buffer was
+#define MIDI_BUFFER_LAST_READ	((midi_buffer.buffer.pos_read-1) & RINGBUFFER_MASK)
+
+// the times the last MIDI clocks came in, taken by the receive interrupt
+// together with their place in the MIDI input buffer - must be 2^n
+#define MIDI_CLOCK_STAMPS		(4)
+#define MIDI_CLOCK_STAMPS_MASK	(MIDI_CLOCK_STAMPS-1)
+typedef struct {
+	uint8_t position;
+	timebase_t time;
+} midi_clock_stamp_t;
+volatile midi_clock_stamp_t midi_clock_stamp[MIDI_CLOCK_STAMPS];
+volatile uint8_t midi_clock_stamp_write = 0;
+uint8_t midi_clock_stamp_read = 0;
 
 uint32_t midiclock_counter = 0;
-// avoid division by zero in clock synced lfo mode
-uint32_t current_midiclock_tick = 2;
-uint32_t last_midiclock_tick = 1;
-
-uint32_t last_single_bar_completed_tick = 0;
-uint32_t last_eight_bars_completed_tick = 0;
-
-uint8_t old_midi_channel = 7;
+// the last value of midiclock_counter seen by update_clock_trigger
+uint32_t triggered_midiclock = 0;
+timebase_t current_midiclock_time = 0;
+timebase_t last_midiclock_time = 0;
+
+timebase_t last_single_bar_completed_time = 0;
+timebase_t last_eight_bars_completed_time = 0;
+
+// the panel as it got applied the last time
+uint8_t panel_input[NUM_SHIFTIN_REG];
+bool panel_input_valid = false;
+uint8_t panel_global_options = 0;
 uint8_t midi_channel = 7;
 
-uint32_t ticks = 0;
-uint32_t last_led_toggle_tick = 0;
-uint32_t last_button_pressed_tick = 0;
+timebase_t last_led_toggle_time = 0;
 
-#define NUM_LFO		(2)
-lfo_t lfo[NUM_LFO];
-volatile bool must_update_lfo = false;
+// the first two LFOs are set up on the panel, all others by CC
+#define NUM_PANEL_LFO	(2)
+lfo_bank_t lfo;
+timebase_t last_lfo_update_time = 0;
 
 #define LFO_AND_CLOCK_OUT_ENABLE			(0x04)
 
@@ -236,7 +286,7 @@ uint8_t program_options = 0x00;
 
 uint8_t program_mode = NORMAL_MODE;
 uint8_t last_mode = NORMAL_MODE;
-uint32_t mode_enter_tick = 0;
+timebase_t mode_enter_time = 0;
 bool button_has_been_released = true;
 
 uint8_t current_tuning_voice = 0x00;
@@ -244,9 +294,56 @@ uint8_t current_tuning_octave = 0xff;
 uint8_t current_cc_learning = 0xff;
 
 #define NUM_CLOCK_OUTPUTS	(2)
-#define CLOCK_TRIGGER_COUNTDOWN_INIT	(3)
 clock_trigger_t clock_output[NUM_CLOCK_OUTPUTS];
-volatile bool must_update_clock_output = false;
+
+// the DAC8568 channels left over by the voices - each one plays any LFO,
+// clock output or envelope while LFO_AND_CLOCK_OUT_ENABLE is set
+#define NUM_AUX_OUTPUTS		(8-NUM_PLAY_NOTES)
+#define AUX_SOURCE_LFO0		(0)
+#define AUX_SOURCE_CLOCK0	(8)
+#define AUX_SOURCE_ENVELOPE0	(10)
+#define AUX_SOURCE_NONE		(0x7f)
+uint8_t aux_route[NUM_AUX_OUTPUTS];
+// CC numbers selecting the source of each aux output (value is the source)
+#define AUX_ROUTE_CC0		(21)
+// CC numbers setting up the LFOs which are not on the panel
+#define LFO_RATE_CC0		(25)
+#define LFO_SHAPE_CC0		(31)
+#define LFO_SYNC_CC0		(37)
+// CC numbers setting the stages of all envelopes
+#define ENVELOPE_ATTACK_CC	(43)
+#define ENVELOPE_DECAY_CC	(44)
+#define ENVELOPE_SUSTAIN_CC	(45)
+#define ENVELOPE_RELEASE_CC	(46)
+// CC value to stage length in LFO_TICKs - from 4ms up to ~16s
+#define ENVELOPE_TICKS(value)	(1+((uint16_t)(value)*(value))/4)
+envelope_bank_t envelope;
+
+// do not schedule a compare match closer than this to the current time
+#define TIMER1_MIN_LEAD			US_TO_TIMEBASE(16)
+
+// sub-clocks are counted from the MIDI clock but the ones in between two
+// MIDI clocks are played by the timer1 compare match interrupt
+volatile uint32_t subclock_counter = 0;
+volatile uint32_t subclock_interval = 0;
+volatile timebase_t next_subclock_time = 0;
+volatile uint8_t pending_subclocks = 0;
+
+// internal master clock - used whenever there is no MIDI clock coming in
+#define INTERNAL_CLOCK_TEMPO_CC		(20)
+#define INTERNAL_CLOCK_MIN_BPM		(60)
+#define INTERNAL_CLOCK_DEFAULT_BPM	(120)
+// period of one CLOCK_SIGNAL (24 per beat) in 1/256 timebase ticks
+#define INTERNAL_CLOCK_PERIOD(bpm)	((2500000UL*TIMEBASE_TICKS_PER_US*256)/(bpm))
+volatile uint32_t internal_clock_period = INTERNAL_CLOCK_PERIOD(INTERNAL_CLOCK_DEFAULT_BPM);
+volatile timebase_t internal_clock_next = 0;
+volatile uint8_t internal_clock_fraction = 0;
+volatile timebase_t internal_clock_time = 0;
+volatile uint8_t internal_clock_pending = 0;
+// the internal clock stays silent as long as the MIDI clock keeps coming
+volatile bool external_clock_seen = false;
+volatile timebase_t last_external_clock_time = 0;
+volatile uint32_t external_clock_timeout = MAX_MIDICLOCK_PERIOD;
 
 bool control_mode_midi_handler_function(midimessage_t* m);
 bool midi_handler_function(midimessage_t* m);
@@ -255,13 +352,38 @@ void update_dac(void);
 void update_lfo(void);
 void update_clock_output(void);
 void process_user_input(void);
+void apply_panel_input(uint8_t* input);
 void process_analog_in(void);
 void update_clock_trigger(void);
 void init_variables(void);
 void init_lfo(void);
+void init_tasks(void);
+void init_firmware(void);
+void midi_task(void);
+void clock_task(void);
+void preset_task(void);
+void stack_monitor_task(void);
+#ifdef PROFILING
+void profile_task(void);
+#endif
+#ifdef LATENCY
+void latency_task(void);
+#endif
+bool aux_control_change(uint8_t cc, uint8_t value);
 void init_io(void);
+void default_settings(settings_t* s);
+uint8_t settings_get(const void* data, uint16_t position);
+void settings_put(void* data, uint16_t position, uint8_t byte);
 void save_settings(void);
 void read_settings(void);
+void edit_settings(void);
+void rollback_settings(void);
+void midi_clock_signal(timebase_t time);
+void external_clock_received(timebase_t time);
+timebase_t midi_clock_received_time(void);
+void set_internal_clock_bpm(uint8_t bpm);
+void fire_subclock(timebase_t now);
+void schedule_timer1_compare(timebase_t now);
 
 bool control_mode_midi_handler_function(midimessage_t* m) {
 	midinote_t mnote;
@@ -279,26 +401,32 @@ bool control_mode_midi_handler_function(midimessage_t* m) {
 			if(mnote.note<4) { // first 4 notes are for assigning CC
 				current_cc_learning = mnote.note;
 			} else if (mnote.note == 4) { // toggle between CC and velocity output non lfo
-				global_options ^= (1<<CC_INSTEAD_OF_VELOCITY);
+				settings->global_options ^= (1<<CC_INSTEAD_OF_VELOCITY);
+			} else if (mnote.note == 5) { // toggle sending the internal clock to MIDI OUT
+				settings->global_options ^= (1<<SEND_INTERNAL_CLOCK);
+			} else if (mnote.note == 6) { // toggle random shapes for the panel lfos
+				settings->global_options ^= (1<<RANDOM_PANEL_LFO);
+			} else if (mnote.note == 7) { // toggle one shared envelope for all voices
+				settings->global_options ^= (1<<SHARED_ENVELOPE);
 			} 
 		} else if (current_tuning_octave != 0xff) {
 			if (((mnote.note-2) % 12) == 0) { // any note D
-				voltage[current_tuning_voice][current_tuning_octave]-=100;
+				calibration_adjust(&settings->calibration, current_tuning_voice, current_tuning_octave, -100);
 				return true;
 			} else if (((mnote.note-4) % 12) == 0) { // any note E
-				voltage[current_tuning_voice][current_tuning_octave]-=10;
+				calibration_adjust(&settings->calibration, current_tuning_voice, current_tuning_octave, -10);
 				return true;
 			} else if (((mnote.note-5) % 12) == 0) { // any note F
-				voltage[current_tuning_voice][current_tuning_octave]-=1;
+				calibration_adjust(&settings->calibration, current_tuning_voice, current_tuning_octave, -1);
 				return true;
 			} else if (((mnote.note-7) % 12) == 0) { // any note G
-				voltage[current_tuning_voice][current_tuning_octave]+=1;
+				calibration_adjust(&settings->calibration, current_tuning_voice, current_tuning_octave, 1);
 				return true;
 			} else if (((mnote.note-9) % 12) == 0) { // any note A
-				voltage[current_tuning_voice][current_tuning_octave]+=10;
+				calibration_adjust(&settings->calibration, current_tuning_voice, current_tuning_octave, 10);
 				return true;
 			} else if (((mnote.note-11) % 12) == 0) {// any note B
-				voltage[current_tuning_voice][current_tuning_octave]+=100;
+				calibration_adjust(&settings->calibration, current_tuning_voice, current_tuning_octave, 100);
 				return true;
 			}
 		} else { // any other note
@@ -322,7 +450,7 @@ bool control_mode_midi_handler_function(midimessage_t* m) {
 		}
 	} else if (m->byte[0] == CONTROL_CHANGE(midi_channel)) {
 		if(current_cc_learning != 0xff) {
-			cc_message[current_cc_learning] = m->byte[1];
+			settings->cc_message[current_cc_learning] = m->byte[1];
 		}
 	}
 	return false;
@@ -330,7 +458,9 @@ bool control_mode_midi_handler_function(midimessage_t* m) {
 
 bool midi_handler_function(midimessage_t* m) {
 	if(program_mode == CONTROL_MODE) {
-		must_update_dac = control_mode_midi_handler_function(m);
+		if(control_mode_midi_handler_function(m)) {
+			scheduler_post(TASK_DAC);
+		}
 		return false;
 	}
 	midinote_t mnote;
@@ -341,16 +471,25 @@ bool midi_handler_function(midimessage_t* m) {
 		if(mnote.velocity != 0x00) {
 			midinote_stack_push(&note_stack, mnote);
 			for(i=0;i<NUM_LFO;i++) {
-				if(lfo[i].retrigger_on_new_note)
-					lfo[i].position = 0;
+				if(lfo.retrigger_on_new_note & LFO_BIT(i))
+					lfo_restart(&lfo, i);
 			}
+			LATENCY_HANDLED(LATENCY_NOTE_ON, MIDI_BUFFER_LAST_READ);
 		} else {
 			midinote_stack_remove(&note_stack, mnote.note);
+			LATENCY_HANDLED(LATENCY_NOTE_OFF, MIDI_BUFFER_LAST_READ);
 		}
 		return true;
 	} else if (m->byte[0] == NOTE_OFF(midi_channel)) {
 		midinote_stack_remove(&note_stack, m->byte[1]);
+		LATENCY_HANDLED(LATENCY_NOTE_OFF, MIDI_BUFFER_LAST_READ);
 		return true;
+	} else if (m->byte[0] == PROGRAM_CHANGE(midi_channel)) {
+		if(m->byte[1] < NUM_PRESETS && program_mode == NORMAL_MODE) {
+			next_preset = m->byte[1];
+			scheduler_post(TASK_PRESET);
+		}
+		return false;
 	} else if (m->byte[0] == PITCH_BEND(midi_channel)) {
 		// TODO: implement some logic to really bend the pitch of the stack notes
 		pitchbend = (m->byte[2]<<7) | m->byte[1];
@@ -359,36 +498,72 @@ bool midi_handler_function(midimessage_t* m) {
 		if((m->byte[1]== 120 || m->byte[1] == 123) && m->byte[2] == 0) { // all sound off
 			midinote_stack_init(&note_stack);
 			return true;
-		} else if (m->byte[1] == MOD_WHEEL) {
+		}
+		// a learned CC wins over the fixed ones below - it has been asked for
+		for(i=0; i<4; i++) {
+			if(m->byte[1] == settings->cc_message[i]) {
+				cc_value[i] = m->byte[2];
+				LATENCY_HANDLED(LATENCY_CONTROL_CHANGE, MIDI_BUFFER_LAST_READ);
+				return true;
+			}
+		}
+		if (m->byte[1] == MOD_WHEEL) {
 			//TODO: do something special here(?)
 			return true;
-		} else {
-			for(i=0; i<4; i++) {
-				if(m->byte[1] == cc_message[i]) {
-					cc_value[i] = m->byte[2];
-					return true;
-				}
+		} else if (m->byte[1] == INTERNAL_CLOCK_TEMPO_CC) {
+			set_internal_clock_bpm(INTERNAL_CLOCK_MIN_BPM + m->byte[2]);
+			return false;
+		} else if (m->byte[1] == STACK_MONITOR_CC) {
+			if(stack_monitor_message_length == 0) {
+				scheduler_post(TASK_STACK_MONITOR);
 			}
+			return false;
+#ifdef PROFILING
+		} else if (m->byte[1] == PROFILE_CC) {
+			if(m->byte[2] == 127) {
+				cli();
+				profile_init();
+				sei();
+			} else if(profile_next_path == NUM_PROFILE_PATHS) {
+				profile_next_path = 0;
+				profile_message_length = 0;
+				scheduler_post(TASK_PROFILE);
+			}
+			return false;
+#endif
+#ifdef LATENCY
+		} else if (m->byte[1] == LATENCY_CC) {
+			if(m->byte[2] == 127) {
+				latency_init();
+			} else if(latency_next_class == NUM_LATENCY_CLASSES) {
+				latency_next_class = 0;
+				latency_message_length = 0;
+				scheduler_post(TASK_LATENCY);
+			}
+			return false;
+#endif
+		} else if (aux_control_change(m->byte[1], m->byte[2])) {
+			return false;
 		}
 		return false;
 	} else {
 		switch(m->byte[0]) {
 			case CLOCK_SIGNAL:
-				midiclock_counter++;
-				cli();
-				last_midiclock_tick = current_midiclock_tick;
-				current_midiclock_tick = ticks;
-				sei();
-				update_clock = true;
+				{
+					timebase_t received = midi_clock_received_time();
+					external_clock_received(received);
+					midi_clock_signal(received);
+					LATENCY_HANDLED(LATENCY_CLOCK, MIDI_BUFFER_LAST_READ);
+				}
 				break;
 			case CLOCK_START:
 			case CLOCK_STOP:
 				midiclock_counter = 0;
-				cli();
-				// avoid division by zero in clock synced lfo mode
-				last_midiclock_tick = 1;
-				current_midiclock_tick = 2;
-				sei();
+				triggered_midiclock = 0;
+				// the next clock starts measuring the tempo all over again
+				last_midiclock_time = 0;
+				current_midiclock_time = 0;
+				pending_subclocks = 0;
 				break;
 			case CLOCK_CONTINUE:
 				break;
@@ -399,20 +574,78 @@ bool midi_handler_function(midimessage_t* m) {
 	return false;
 }
 
+// both the MIDI clock and the internal clock end up here - so switching
+// between them keeps counting on and does not disturb LFOs or trigger dividers
+void midi_clock_signal(timebase_t time) {
+	midiclock_counter++;
+	last_midiclock_time = current_midiclock_time;
+	current_midiclock_time = time;
+	scheduler_post(TASK_CLOCK);
+}
+
+void external_clock_received(timebase_t time) {
+	cli();
+	uint32_t period = time - last_external_clock_time;
+	// give up on the MIDI clock if two of its clocks went missing
+	if(external_clock_seen && period < MAX_MIDICLOCK_PERIOD/2) {
+		external_clock_timeout = 2*period;
+	} else {
+		external_clock_timeout = MAX_MIDICLOCK_PERIOD;
+	}
+	external_clock_seen = true;
+	last_external_clock_time = time;
+	// the internal clock takes over in phase with the last MIDI clock
+	internal_clock_next = time + (internal_clock_period>>8);
+	internal_clock_fraction = 0;
+	OCR1B = (uint16_t)internal_clock_next;
+	sei();
+}
+
+// the time the clock just taken from the MIDI input buffer came in. Clocks
+// within a SysEx never get here, so older stamps are skipped until the one
+// at its place in the buffer. Falls back to now if it got overwritten.
+timebase_t midi_clock_received_time(void) {
+	timebase_t time = timebase_now();
+	uint8_t position = MIDI_BUFFER_LAST_READ;
+	cli();
+	if((uint8_t)(midi_clock_stamp_write - midi_clock_stamp_read) > MIDI_CLOCK_STAMPS) {
+		midi_clock_stamp_read = midi_clock_stamp_write - MIDI_CLOCK_STAMPS;
+	}
+	while(midi_clock_stamp_read != midi_clock_stamp_write) {
+		volatile midi_clock_stamp_t* stamp = midi_clock_stamp + (midi_clock_stamp_read++ & MIDI_CLOCK_STAMPS_MASK);
+		if(stamp->position == position) {
+			time = stamp->time;
+			break;
+		}
+	}
+	sei();
+	return time;
+}
+
+void set_internal_clock_bpm(uint8_t bpm) {
+	uint32_t period = INTERNAL_CLOCK_PERIOD(bpm);
+	cli();
+	internal_clock_period = period;
+	sei();
+}
+
 void get_voltage(uint8_t channel, uint8_t val, uint32_t* voltage_out) {
 	uint8_t i = (val/12); // which octave are we in?
 	float step = (val-(i*12))/12.0; // relative position in octave
 	if(i>0) {
-		*voltage_out = (voltage[channel][i]-voltage[channel][i-1])*step+voltage[channel][i-1];
+		uint32_t below = calibration_voltage(&settings->calibration, channel, i-1);
+		*voltage_out = (calibration_voltage(&settings->calibration, channel, i)-below)*step+below;
 	} else {
-		*voltage_out = (voltage[channel][i])*step;
+		*voltage_out = calibration_voltage(&settings->calibration, channel, i)*step;
 	}
 	if(*voltage_out > 65536)
 		*voltage_out = 65536;
 }
 
 void update_dac(void) {
+	PROFILE_BEGIN(PROFILE_UPDATE_DAC);
 	uint8_t i = 0;
+	uint8_t gates = 0;
 	for(; i<NUM_PLAY_NOTES; i++) {
 		note_t note = playing_notes[i].midinote.note;
 		uint32_t voltage = 0;
@@ -422,7 +655,7 @@ void update_dac(void) {
 		}
 		if(!ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
 			cc_t ccval = cc_value[i];
-			if(ISSET(global_options,CC_INSTEAD_OF_VELOCITY)) {
+			if(ISSET(settings->global_options,(1<<CC_INSTEAD_OF_VELOCITY))) {
 				// send CC
 				voltage = ccval<<9;
 			} else {
@@ -439,33 +672,191 @@ void update_dac(void) {
 		// implicitly here
 		if(note != EMPTY_NOTE) {
 			GATE_PORT |= (1<<(i+(GATE_OFFSET)));
+			gates |= (1<<i);
 		} else {
 			GATE_PORT &= ~(1<<(i+(GATE_OFFSET)));
 		}
 	}
+	envelope.shared = ISSET(settings->global_options, (1<<SHARED_ENVELOPE));
+	envelope_set_gates(&envelope, gates);
+	LATENCY_OUTPUT(LATENCY_CLASS_BIT(LATENCY_NOTE_ON)|LATENCY_CLASS_BIT(LATENCY_NOTE_OFF)|LATENCY_CLASS_BIT(LATENCY_CONTROL_CHANGE));
+	PROFILE_END(PROFILE_UPDATE_DAC);
 }
 
+// catches up with all the lfo ticks passed since the last call in one single step
 void update_lfo(void) {
+	uint8_t i=0;
+	uint8_t elapsed = 0;
+	timebase_t now = timebase_now();
+	while(now - last_lfo_update_time >= LFO_TICK) {
+		last_lfo_update_time += LFO_TICK;
+		// more than a second behind - there is nothing left to catch up with anyway
+		if(++elapsed == 0xff) {
+			last_lfo_update_time = now;
+			break;
+		}
+	}
+	if(elapsed == 0) {
+		return;
+	}
+	PROFILE_BEGIN(PROFILE_UPDATE_LFO);
+	lfo_bank_advance(&lfo, elapsed, current_midiclock_time - last_midiclock_time);
+	// the envelopes move on tick by tick - usually there is just a single one
+	for(;i<elapsed;i++) {
+		envelope_bank_tick(&envelope);
+	}
 	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
-		uint8_t i=0;
-		for(;i<NUM_LFO;i++) {
-			uint32_t voltage = lfo[i].get_value(lfo+i);
-			dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES, voltage);
+		lfo_bank_render(&lfo);
+		for(i=0;i<NUM_AUX_OUTPUTS;i++) {
+			uint8_t source = aux_route[i];
+			if(source < AUX_SOURCE_LFO0+NUM_LFO) {
+				dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES, lfo.value[source-AUX_SOURCE_LFO0]);
+			} else if(source >= AUX_SOURCE_ENVELOPE0 && source < AUX_SOURCE_ENVELOPE0+NUM_ENVELOPES) {
+				dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES, envelope_value(&envelope, source-AUX_SOURCE_ENVELOPE0));
+			}
 		}
 	}
+	PROFILE_END(PROFILE_UPDATE_LFO);
 }
 
+// takes care of all aux outputs not playing an LFO or envelope - unrouted ones stay at 0V
 void update_clock_output(void) {
 	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
 		uint8_t i=0;
-		for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
+		for(i=0;i<NUM_AUX_OUTPUTS;i++) {
+			uint8_t source = aux_route[i];
 			uint32_t voltage = 0x0000;
-			if(clock_output[i].active_countdown != 0) {
+			if(source < AUX_SOURCE_LFO0+NUM_LFO
+					|| (source >= AUX_SOURCE_ENVELOPE0 && source < AUX_SOURCE_ENVELOPE0+NUM_ENVELOPES)) {
+				continue;
+			}
+			if(source >= AUX_SOURCE_CLOCK0 && source < AUX_SOURCE_CLOCK0+NUM_CLOCK_OUTPUTS
+					&& clock_output[source-AUX_SOURCE_CLOCK0].active) {
 				voltage = 0xffff; //TODO: maybe adjustable clock trigger level instead?
 			}
-			dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES+NUM_LFO, voltage);
+			dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES, voltage);
+		}
+	}
+}
+
+bool aux_control_change(uint8_t cc, uint8_t value) {
+	if(cc >= AUX_ROUTE_CC0 && cc < AUX_ROUTE_CC0+NUM_AUX_OUTPUTS) {
+		aux_route[cc-AUX_ROUTE_CC0] = value;
+		// get a now unrouted output down to 0V
+		scheduler_post(TASK_CLOCK_OUTPUT);
+		return true;
+	}
+	if(cc >= LFO_RATE_CC0 && cc < LFO_RATE_CC0+NUM_LFO-NUM_PANEL_LFO) {
+		// same range as the rate pots on the panel
+		lfo.stepwidth[cc-LFO_RATE_CC0+NUM_PANEL_LFO] = ((value<<3)+1)*4;
+		return true;
+	}
+	if(cc >= LFO_SHAPE_CC0 && cc < LFO_SHAPE_CC0+NUM_LFO-NUM_PANEL_LFO) {
+		lfo_set_shape(&lfo, cc-LFO_SHAPE_CC0+NUM_PANEL_LFO, value);
+		return true;
+	}
+	if(cc >= LFO_SYNC_CC0 && cc < LFO_SYNC_CC0+NUM_LFO-NUM_PANEL_LFO) {
+		// 0 is free running, everything above selects the clock_mode
+		uint8_t n = cc-LFO_SYNC_CC0+NUM_PANEL_LFO;
+		if(value != 0 && value <= NUM_CLOCK_LIMITS) {
+			lfo_set_clock_mode(&lfo, n, value-1);
+		}
+		lfo_set_clock_sync(&lfo, n, value != 0 && value <= NUM_CLOCK_LIMITS);
+		return true;
+	}
+	switch(cc) {
+		case ENVELOPE_ATTACK_CC:
+			envelope_set_attack(&envelope, ENVELOPE_TICKS(value));
+			return true;
+		case ENVELOPE_DECAY_CC:
+			envelope_set_decay(&envelope, ENVELOPE_TICKS(value));
+			return true;
+		case ENVELOPE_SUSTAIN_CC:
+			envelope_set_sustain(&envelope, ((uint32_t)value*0xffff)/127);
+			return true;
+		case ENVELOPE_RELEASE_CC:
+			envelope_set_release(&envelope, ENVELOPE_TICKS(value));
+			return true;
+		default:
+			return false;
+	}
+}
+
+// applies only the switches which moved since the last call - everything on
+// the first call
+void apply_panel_input(uint8_t* input) {
+	uint8_t changed[NUM_SHIFTIN_REG];
+	uint8_t i=0;
+	for(;i<NUM_SHIFTIN_REG;i++) {
+		changed[i] = panel_input_valid ? (input[i] ^ panel_input[i]) : 0xff;
+		panel_input[i] = input[i];
+	}
+	panel_input_valid = true;
+	// the wave switches stand for other shapes now
+	if((settings->global_options ^ panel_global_options) & (1<<RANDOM_PANEL_LFO)) {
+		changed[1] |= (LFO_MASK<<lfo_offset[0])|(LFO_MASK<<lfo_offset[1]);
+	}
+	panel_global_options = settings->global_options;
+	if(changed[0] & MODE_BIT0) {
+		uint8_t new_playmode = ISSET(input[0], MODE_BIT0) ? POLYPHONIC_MODE : UNISON_MODE;
+		if(new_playmode != playmode) {
+			playmode = new_playmode;
+			mode[playmode].init();
 		}
 	}
+	if(changed[0] & LFO_CLOCK_ENABLE_BIT) {
+		if(ISSET(input[0], LFO_CLOCK_ENABLE_BIT)) {
+			SET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		} else {
+			UNSET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+			// velocity or CC on the aux outputs again
+			scheduler_post(TASK_DAC);
+		}
+		// the clock outputs take over or give back the aux outputs right away
+		scheduler_post(TASK_CLOCK_OUTPUT);
+	}
+	if((changed[0] & MIDI_CHANNEL_MASK) && (input[0] & MIDI_CHANNEL_MASK) != midi_channel) {
+		midi_channel = (input[0] & MIDI_CHANNEL_MASK);
+		cli();
+		init_variables();
+		scheduler_post(TASK_DAC);
+		sei();
+	}
+	if(changed[1] & LFO0_CLOCKSYNC) {
+		lfo_set_clock_sync(&lfo, 0, ISSET(input[1], LFO0_CLOCKSYNC));
+		// the rate pot means something else now
+		pending_pots |= ANALOG_IN_BIT(LFO_RATE_POTI0);
+	}
+	if(changed[1] & LFO1_CLOCKSYNC) {
+		lfo_set_clock_sync(&lfo, 1, ISSET(input[1], LFO1_CLOCKSYNC));
+		pending_pots |= ANALOG_IN_BIT(LFO_RATE_POTI0+1);
+	}
+	if(changed[1] & LFO0_RETRIGGER_ON_NEW_NOTE) {
+		if(ISSET(input[1], LFO0_RETRIGGER_ON_NEW_NOTE)) {
+			SET(lfo.retrigger_on_new_note, LFO_BIT(0));
+		} else {
+			UNSET(lfo.retrigger_on_new_note, LFO_BIT(0));
+		}
+	}
+	if(changed[1] & LFO1_RETRIGGER_ON_NEW_NOTE) {
+		if(ISSET(input[1], LFO1_RETRIGGER_ON_NEW_NOTE)) {
+			SET(lfo.retrigger_on_new_note, LFO_BIT(1));
+		} else {
+			UNSET(lfo.retrigger_on_new_note, LFO_BIT(1));
+		}
+	}
+	for(i=0;i<NUM_PANEL_LFO;i++) {
+		if(!(changed[1] & (LFO_MASK<<lfo_offset[i]))) {
+			continue;
+		}
+		// the wave switches are numbered just like the lfo shapes
+		uint8_t shape = (input[1]>>lfo_offset[i])& LFO_MASK;
+		if(ISSET(settings->global_options, (1<<RANDOM_PANEL_LFO))) {
+			// only 3 random shapes - the last switch position holds samples as well
+			shape = (shape == SAWTOOTH) ? SAMPLE_HOLD : shape+SAMPLE_HOLD;
+		}
+		lfo_set_shape(&lfo, i, shape);
+	}
 }
 
 void process_user_input(void) {
@@ -477,28 +868,28 @@ void process_user_input(void) {
 			switch(program_mode) {
 				case NORMAL_MODE:
 					last_mode = NORMAL_MODE;
-					mode_enter_tick = ticks;
+					mode_enter_time = timebase_now();
 					program_mode = BUTTON_PRESSED_MODE;
 					break;
 				case BUTTON_PRESSED_MODE:
 					// this is our debouncing
 					// you have to press the button long enough to enter control mode
-					if(ticks - mode_enter_tick > 500) {
+					if(timebase_now() - mode_enter_time > MS_TO_TIMEBASE(2000)) {
 						button_has_been_released = false;
 						if(last_mode == NORMAL_MODE) {
 							program_mode = CONTROL_MODE;
+							edit_settings();
 							// turn off all playing notes
 							memset(playing_notes, EMPTY_NOTE, sizeof(playingnote_t)*NUM_PLAY_NOTES);
 						} else {
 							save_settings();
-							read_settings();
 							program_mode = NORMAL_MODE;
 						}
 					}
 					break;
 				case CONTROL_MODE:
 					last_mode = CONTROL_MODE;
-					mode_enter_tick = ticks;
+					mode_enter_time = timebase_now();
 					program_mode = BUTTON_PRESSED_MODE;
 					break;
 				default:
@@ -509,7 +900,7 @@ void process_user_input(void) {
 		button_has_been_released = true;
 		// if button released before entering CONTROL_MODE - reset to NORMAL_MODE
 		if(program_mode == BUTTON_PRESSED_MODE) {
-			read_settings(); // reset changes made in CONTROL_MODE
+			rollback_settings(); // reset changes made in CONTROL_MODE
 			last_mode = NORMAL_MODE;
 			program_mode = NORMAL_MODE;
 		}
@@ -517,117 +908,141 @@ void process_user_input(void) {
 	if(program_mode == NORMAL_MODE) {
 		// NORMAL MODE - light up LED permanently
 		BUTTON_LED_PORT |= (1<<LED);
-
-		uint8_t old_playmode = playmode;
-		if(ISSET(input[0], MODE_BIT0)) {
-			playmode = POLYPHONIC_MODE;
-		} else {
-			playmode = UNISON_MODE;
-		}
-		if(playmode != old_playmode) {
-			mode[playmode].init();
-		}
-		if(ISSET(input[0], LFO_CLOCK_ENABLE_BIT)) {
-			SET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
-		} else {
-			UNSET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
-			must_update_dac = true;
-			// TODO: unset the voltages
-		}
-		midi_channel = (input[0] & MIDI_CHANNEL_MASK);
-		if(midi_channel != old_midi_channel) {
-			cli();
-			init_variables();
-			must_update_dac = true;
-			sei();
-			old_midi_channel = midi_channel;
-		}
-		lfo[0].clock_sync = ISSET(input[1], LFO0_CLOCKSYNC);
-		lfo[1].clock_sync = ISSET(input[1], LFO1_CLOCKSYNC);
-		lfo[0].retrigger_on_new_note = ISSET(input[1], LFO0_RETRIGGER_ON_NEW_NOTE);
-		lfo[1].retrigger_on_new_note = ISSET(input[1], LFO1_RETRIGGER_ON_NEW_NOTE);
-		uint8_t wave_settings;
-		uint8_t i= 0;
-		for(;i<NUM_LFO;i++) {
-			wave_settings = (input[1]>>lfo_offset[i])& LFO_MASK;
-			switch(wave_settings) {
-				case 0:
-					lfo[i].get_value = lfo_get_rev_sawtooth;
-					break;
-				case 1:
-					lfo[i].get_value = lfo_get_triangle;
-					break;
-				case 2:
-					lfo[i].get_value = lfo_get_pulse;
-					break;
-				case 3:
-					lfo[i].get_value = lfo_get_sawtooth;
-					break;
-				default:
-					break;
-			}
-		}
+		apply_panel_input(input);
 	} else if (program_mode == CONTROL_MODE) {
 		// CONTROL MODE - toggle LED as indicator
-		if(ticks-last_led_toggle_tick > 100) {
+		if(timebase_now()-last_led_toggle_time > MS_TO_TIMEBASE(400)) {
 			BUTTON_LED_PORT ^= (1<<LED);
-			last_led_toggle_tick = ticks;
+			last_led_toggle_time = timebase_now();
 		}
 	} else if (program_mode == BUTTON_PRESSED_MODE) {
-		if(ticks-last_led_toggle_tick > 20) {
+		if(timebase_now()-last_led_toggle_time > MS_TO_TIMEBASE(80)) {
 			BUTTON_LED_PORT ^= (1<<LED);
-			last_led_toggle_tick = ticks;
+			last_led_toggle_time = timebase_now();
 		}
 	}
 }
 
 void process_analog_in(void) {
+	pending_pots |= analog_in_changes();
+	analog_in_start_scan();
 	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
 		uint8_t i=0;
-		for(;i<NUM_LFO; i++) {
+		for(;i<NUM_PANEL_LFO; i++) {
+			if(!(pending_pots & ANALOG_IN_BIT(LFO_RATE_POTI0+i))) {
+				continue;
+			}
 			uint16_t analog_value = analog_read(LFO_RATE_POTI0+i);
-			if(lfo[i].clock_sync) {
+			if(lfo.clock_sync & LFO_BIT(i)) {
 				// analog_value/64 gives us 16 possible clock_modes
-				lfo[i].clock_mode = (analog_value/64 > sizeof(clock_limit)-1) ? sizeof(clock_limit)-1 : analog_value/64;
+				lfo_set_clock_mode(&lfo, i, (analog_value/64 > NUM_CLOCK_LIMITS-1) ? NUM_CLOCK_LIMITS-1 : analog_value/64);
 			} else {
-				lfo[i].stepwidth = ((analog_value+1)*4);
+				lfo.stepwidth[i] = ((analog_value+1)*4);
 			}
 		}
 		for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
+			if(!(pending_pots & ANALOG_IN_BIT(CLOCK_RATE_POTI0+i))) {
+				continue;
+			}
 			uint16_t analog_value = analog_read(CLOCK_RATE_POTI0+i);
 			clock_output[i].mode = analog_value/64; // make it 16 possible modes
 		}
+		pending_pots = 0;
 	}
 }
 
-// INFO: assure that this function is called on each increment of midiclock_counter
-//       otherwise we may lose trigger-points
+// catches up with all increments of midiclock_counter since the last call -
+// a burst of MIDI clocks may get handled before the clock task gets to run
 void update_clock_trigger(void) {
 	uint8_t i;
-	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
+	uint32_t clock;
+	while(triggered_midiclock != midiclock_counter) {
+		clock = ++triggered_midiclock;
+		if(!ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
+			continue;
+		}
 		for(i=0;i<NUM_LFO;i++) {
-			if((midiclock_counter % clock_limit[lfo[i].clock_mode]) == 0) {
-				lfo[i].last_cycle_completed_tick = ticks;
-				lfo[i].position = 0; // reset lfo position to always stay in sync with the clock
+			if((clock % pgm_read_word(clock_limit+lfo.clock_mode[i])) == 0) {
+				lfo_restart(&lfo, i); // reset lfo position to always stay in sync with the clock
 			}
 		}
-		if(midiclock_counter % SINGLE_BAR_COMPLETED == 0) {
-			last_single_bar_completed_tick = ticks;
+		if(clock % SINGLE_BAR_COMPLETED == 0) {
+			last_single_bar_completed_time = current_midiclock_time;
 		}
-		if(midiclock_counter % EIGHT_BARS_COMPLETED == 0) {
-			last_eight_bars_completed_tick = ticks;
+		if(clock % EIGHT_BARS_COMPLETED == 0) {
+			last_eight_bars_completed_time = current_midiclock_time;
 		}
-		for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
-			if((midiclock_counter % clock_limit[clock_output[i].mode]) == 0) {
-				clock_output[i].active_countdown = CLOCK_TRIGGER_COUNTDOWN_INIT;
-			}
+		uint32_t period = current_midiclock_time - last_midiclock_time;
+		cli();
+		timebase_t now = timebase_now();
+		// the clock got faster - play the rest of the last clock right away
+		while(pending_subclocks) {
+			fire_subclock(now);
+			pending_subclocks--;
+		}
+		subclock_counter = clock*CLOCK_MULTIPLIER;
+		if(period < MAX_MIDICLOCK_PERIOD) {
+			subclock_interval = period/CLOCK_MULTIPLIER;
+			next_subclock_time = current_midiclock_time + subclock_interval;
+			pending_subclocks = CLOCK_MULTIPLIER-1;
+		} else {
+			// no tempo to interpolate yet - only play on the MIDI clock
+			subclock_interval = 0;
+		}
+		fire_subclock(now);
+		schedule_timer1_compare(now);
+		sei();
+	}
+}
+
+// INFO: only call this with interrupts disabled
+void fire_subclock(timebase_t now) {
+	uint8_t i;
+	for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
+		if(clock_trigger_fires(clock_output+i, subclock_counter)) {
+			clock_output[i].active = true;
+			clock_output[i].off_time = now + clock_trigger_pulse_width(clock_output+i,
+					subclock_interval, US_TO_TIMEBASE(CLOCK_TRIGGER_PULSE_US));
+			scheduler_post(TASK_CLOCK_OUTPUT);
+		}
+	}
+	subclock_counter++;
+}
+
+// INFO: only call this with interrupts disabled
+void schedule_timer1_compare(timebase_t now) {
+	uint8_t i;
+	bool pending = false;
+	int32_t wait = INT32_MAX;
+	if(pending_subclocks) {
+		pending = true;
+		wait = (int32_t)(next_subclock_time - now);
+	}
+	for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
+		if(clock_output[i].active && (int32_t)(clock_output[i].off_time - now) < wait) {
+			pending = true;
+			wait = (int32_t)(clock_output[i].off_time - now);
 		}
 	}
+	if(!pending) {
+		TIMSK &= ~(1<<OCIE1A);
+		return;
+	}
+	// events already due or very close ones would be missed if the
+	// counter passes the compare value before it is set
+	if(wait < (int32_t)TIMER1_MIN_LEAD) {
+		wait = TIMER1_MIN_LEAD;
+	}
+	// events more than one timer1 period away just take one more compare match
+	OCR1A = (uint16_t)(now + wait);
+	TIFR = (1<<OCF1A);
+	TIMSK |= (1<<OCIE1A);
 }
 
 void init_variables(void) {
 	midinote_stack_init(&note_stack);
 	midibuffer_init(&midi_buffer, &midi_handler_function);
+	midi_clock_stamp_read = midi_clock_stamp_write;
 	// initializing to EMPTY_NOTE to be able to play note 0 as well
 	memset(playing_notes, EMPTY_NOTE, sizeof(playingnote_t)*NUM_PLAY_NOTES);
 	memset(mode, 0, sizeof(playmode_t)*NUM_PLAY_MODES);
@@ -639,26 +1054,170 @@ void init_variables(void) {
 
 void init_lfo(void) {
 	uint8_t i=0;
-	for(;i<NUM_LFO; i++) {
-		lfo[i].clock_sync = false;
-		lfo[i].stepwidth = 1;
-		lfo[i].get_value = lfo_get_triangle;
-		lfo[i].position = 0;
+	lfo_bank_init(&lfo);
+	envelope_bank_init(&envelope);
+	// the same outputs as ever: two LFOs followed by the two clock outputs
+	for(;i<NUM_AUX_OUTPUTS;i++) {
+		aux_route[i] = AUX_SOURCE_NONE;
+	}
+	aux_route[0] = AUX_SOURCE_LFO0;
+	aux_route[1] = AUX_SOURCE_LFO0+1;
+	aux_route[2] = AUX_SOURCE_CLOCK0;
+	aux_route[3] = AUX_SOURCE_CLOCK0+1;
+}
+
+// MIDI to CV latency only depends on the MIDI and DAC tasks - the LFO and
+// panel tasks only ever delay each other
+void init_tasks(void) {
+	task_init(task+TASK_MIDI, midi_task, 0, 0, US_TO_TIMEBASE(1000));
+	task_init(task+TASK_DAC, update_dac, 0, 0, US_TO_TIMEBASE(1000));
+	task_init(task+TASK_CLOCK, clock_task, 1, 0, US_TO_TIMEBASE(1000));
+	// the trigger pulses should not get any longer than necessary
+	task_init(task+TASK_CLOCK_OUTPUT, update_clock_output, 1, 0, US_TO_TIMEBASE(250));
+	task_init(task+TASK_LFO, update_lfo, 2, LFO_TICK, LFO_TICK);
+	task_init(task+TASK_PANEL, process_user_input, 3, PANEL_READ_PERIOD, PANEL_READ_PERIOD);
+	task_init(task+TASK_POTS, process_analog_in, 3, POTS_READ_PERIOD, POTS_READ_PERIOD);
+	task_init(task+TASK_PRESET, preset_task, 3, 0, MS_TO_TIMEBASE(100));
+	task_init(task+TASK_STACK_MONITOR, stack_monitor_task, 3, 0, MS_TO_TIMEBASE(100));
+#ifdef PROFILING
+	task_init(task+TASK_PROFILE, profile_task, 3, 0, MS_TO_TIMEBASE(100));
+#endif
+#ifdef LATENCY
+	task_init(task+TASK_LATENCY, latency_task, 3, 0, MS_TO_TIMEBASE(100));
+#endif
+	scheduler_init(task, NUM_TASKS);
+}
+
+// handles a single MIDI message per run so the DAC task gets a chance to
+// play each note before the next message is handled
+void midi_task(void) {
+	if(midibuffer_tick(&midi_buffer)) {
+		PROFILE_BEGIN(PROFILE_UPDATE_NOTES);
+		mode[playmode].update_notes(&note_stack, playing_notes);
+		PROFILE_END(PROFILE_UPDATE_NOTES);
+		scheduler_post(TASK_DAC);
+	}
+	if(!ringbuffer_empty(&midi_buffer.buffer)) {
+		scheduler_post(TASK_MIDI);
+	}
+}
+
+void clock_task(void) {
+	if(internal_clock_pending) {
+		cli();
+		internal_clock_pending--;
+		// when late for more than one clock each one still gets its own time -
+		// the ones still pending came one period after another
+		timebase_t time = internal_clock_time - internal_clock_pending*(internal_clock_period>>8);
+		sei();
+		midi_clock_signal(time);
+		if(internal_clock_pending) {
+			scheduler_post(TASK_CLOCK);
+		}
+	}
+	update_clock_trigger();
+	LATENCY_OUTPUT(LATENCY_CLASS_BIT(LATENCY_CLOCK));
+}
+
+// loads the preset into the spare settings buffer and switches over to it
+// in one go - the notes play with the new tuning from their next update on.
+// Comes back later while the EEPROM is busy saving.
+void preset_task(void) {
+	if(next_preset == preset || program_mode != NORMAL_MODE) {
+		next_preset = preset;
+		return;
+	}
+	if(eeprom_store_busy()) {
+		scheduler_post(TASK_PRESET);
+		return;
+	}
+	settings_t* spare = (saved_settings == settings_buffer) ? settings_buffer+1 : settings_buffer;
+	if(!eeprom_store_load(next_preset, spare)) {
+		default_settings(spare);
 	}
+	cli();
+	saved_settings = spare;
+	settings = spare;
+	sei();
+	preset = next_preset;
 }
 
+// the RAM free right now is what is left while running a task like this one -
+// sent the same way as the profiling results
+void stack_monitor_task(void) {
+	if(stack_monitor_message_length == 0) {
+		stack_monitor_message_length = stack_monitor_sysex(stack_monitor_message);
+		stack_monitor_message_sent = 0;
+	}
+	while(stack_monitor_message_sent < stack_monitor_message_length &&
+			uart_try_putc(stack_monitor_message[stack_monitor_message_sent])) {
+		stack_monitor_message_sent++;
+	}
+	if(stack_monitor_message_sent == stack_monitor_message_length) {
+		stack_monitor_message_length = 0;
+	} else {
+		scheduler_post(TASK_STACK_MONITOR);
+	}
+}
+
+#ifdef PROFILING
+// sends whatever the UART takes right now and comes back for the rest -
+// a dump takes ~100ms at 31250 baud without holding up anything else
+void profile_task(void) {
+	if(profile_message_length == 0) {
+		cli();
+		profile_message_length = profile_sysex(profile_next_path, profile_message);
+		sei();
+		profile_message_sent = 0;
+	}
+	while(profile_message_sent < profile_message_length &&
+			uart_try_putc(profile_message[profile_message_sent])) {
+		profile_message_sent++;
+	}
+	if(profile_message_sent == profile_message_length) {
+		profile_message_length = 0;
+		profile_next_path++;
+	}
+	if(profile_next_path < NUM_PROFILE_PATHS) {
+		scheduler_post(TASK_PROFILE);
+	}
+}
+#endif
+
+#ifdef LATENCY
+// the same as the profiling - all latencies get recorded by tasks so there
+// is nothing to lock here
+void latency_task(void) {
+	if(latency_message_length == 0) {
+		latency_message_length = latency_sysex(latency_next_class, latency_message);
+		latency_message_sent = 0;
+	}
+	while(latency_message_sent < latency_message_length &&
+			uart_try_putc(latency_message[latency_message_sent])) {
+		latency_message_sent++;
+	}
+	if(latency_message_sent == latency_message_length) {
+		latency_message_length = 0;
+		latency_next_class++;
+	}
+	if(latency_next_class < NUM_LATENCY_CLASSES) {
+		scheduler_post(TASK_LATENCY);
+	}
+}
+#endif
+
 void init_io(void) {
 	// setting gate and trigger pins as output pins
 	GATE_DDR |= (1<<GATE1)|(1<<GATE2)|(1<<GATE3)|(1<<GATE4);
 
-	// setting trigger timer
-	TCCR0 = (1<<CS02)|(1<<CS00); // set prescaler to 1024 -> ~16ms (@16MHz Clock)
-	// calculation: 16000000Hz/1024 = 15625Hz trigger-rate
-	//              15625Hz/256 = 61.035Hz overflow-rate (8-bit timer)
-	//              1/61.035Hz = 16.3ms per overflow
-	// setting lfo timer
-	TCCR2 = (1<<CS22)|(1<<CS21); // set prescaler to 256 -> 4,096ms (@16MHz Clock)
-	TIMSK |= (1<<TOIE0)|(1<<TOIE2); // enable overflow timer interrupt for timer 0 and 2
+	// timer1 is our timebase - its compare match A is scheduled for the
+	// sub-clocks and trigger pulse ends
+	timebase_init();
+	// setting internal clock - compare match B is moved on by one clock
+	// period on every match (what CTC mode would do without resetting timer1)
+	internal_clock_next = internal_clock_period>>8;
+	OCR1B = (uint16_t)internal_clock_next;
+	TIMSK |= (1<<OCIE1B);
 	dac8568c_init();
 	sr74hc165_init();
 	init_analogin();
@@ -669,108 +1228,160 @@ void init_io(void) {
 	BUTTON_LED_PORT |= (1<<BUTTON); // activate internal pullup
 }
 
+void default_settings(settings_t* s) {
+	uint8_t i=0;
+	calibration_init(&s->calibration);
+	for(;i<4;i++) {
+		s->cc_message[i] = pgm_read_byte(default_cc_message+i);
+	}
+	s->global_options = 0x00;
+}
+
+uint8_t settings_get(const void* data, uint16_t position) {
+	const settings_t* s = data;
+	if(position < CALIBRATION_PACKED_SIZE) {
+		return calibration_get_byte(&s->calibration, position);
+	}
+	position -= CALIBRATION_PACKED_SIZE;
+	if(position < 4) {
+		return s->cc_message[position];
+	}
+	return s->global_options;
+}
+
+void settings_put(void* data, uint16_t position, uint8_t byte) {
+	settings_t* s = data;
+	if(position < CALIBRATION_PACKED_SIZE) {
+		calibration_put_byte(&s->calibration, position, byte);
+		return;
+	}
+	position -= CALIBRATION_PACKED_SIZE;
+	if(position < 4) {
+		s->cc_message[position] = byte;
+	} else {
+		s->global_options = byte;
+	}
+}
+
+// the working copy becomes the saved settings and gets written to eeprom
+// in the background as the current preset
 void save_settings(void) {
-	// write settings to eeprom
-	eeprom_update_block((const void*)voltage, (void*)voltage_eeprom, sizeof(voltage));
-	eeprom_update_block((const void*)cc_message, (void*)cc_message_eeprom, sizeof(cc_message));
-	eeprom_update_byte(&global_options_eeprom, global_options);
+	saved_settings = settings;
+	eeprom_store_save(preset, saved_settings);
 }
 
 void read_settings(void) {
-	// read settings from eeprom
-	eeprom_read_block(voltage, voltage_eeprom, sizeof(voltage));
-	eeprom_read_block(cc_message, cc_message_eeprom, sizeof(cc_message));
-	global_options = eeprom_read_byte(&global_options_eeprom);
+	// read settings from eeprom - the defaults on a missing or broken record
+	if(!eeprom_store_load(preset, saved_settings)) {
+		default_settings(saved_settings);
+	}
+	settings = saved_settings;
+}
+
+void edit_settings(void) {
+	settings_t* copy = (saved_settings == settings_buffer) ? settings_buffer+1 : settings_buffer;
+	memcpy(copy, saved_settings, sizeof(settings_t));
+	cli();
+	settings = copy;
+	sei();
+}
+
+void rollback_settings(void) {
+	cli();
+	settings = saved_settings;
+	sei();
 }
 
 ISR(USART_RXC_vect) {
+	PROFILE_BEGIN(PROFILE_ISR_USART_RXC);
 	char a;
 	uart_getc(&a);
 	// this method only affects the writing position in the midibuffer
 	// therefor it's ISR-save as long as the buffer does not run out of
 	// space!!! prepare your buffers, everyone!
+	LATENCY_RECEIVED(midi_buffer.buffer.pos_write);
+	// the tempo gets measured from the time a clock came in, not from the
+	// time it got its turn in the MIDI task
+	if((unsigned char)a == CLOCK_SIGNAL) {
+		volatile midi_clock_stamp_t* stamp = midi_clock_stamp + (midi_clock_stamp_write & MIDI_CLOCK_STAMPS_MASK);
+		stamp->position = midi_buffer.buffer.pos_write;
+		stamp->time = timebase_now();
+		midi_clock_stamp_write++;
+	}
 	midibuffer_put(&midi_buffer, a);
+	scheduler_post(TASK_MIDI);
+	PROFILE_END(PROFILE_ISR_USART_RXC);
 }
 
-// ISR for timer 0 overflow - every ~16ms (calculation see init_io())
-ISR(TIMER0_OVF_vect) {
-	if(shift_in_trigger_counter-- == 0) {
-		shift_in_trigger_counter = SHIFTIN_TRIGGER;
-		get_shiftin = true;
+ISR(TIMER1_COMPA_vect) {
+	PROFILE_BEGIN(PROFILE_ISR_TIMER1_COMPA);
+	timebase_t now = timebase_now();
+	uint8_t i=0;
+	if(pending_subclocks && (int32_t)(now - next_subclock_time) >= 0) {
+		fire_subclock(now);
+		pending_subclocks--;
+		next_subclock_time += subclock_interval;
 	}
-	if(analog_in_counter-- == 0) {
-		analog_in_counter = ANALOG_READ_COUNTER;
-		get_analogin = true;
+	for(;i<NUM_CLOCK_OUTPUTS;i++) {
+		if(clock_output[i].active && (int32_t)(now - clock_output[i].off_time) >= 0) {
+			clock_output[i].active = false;
+			scheduler_post(TASK_CLOCK_OUTPUT);
+		}
 	}
+	schedule_timer1_compare(now);
+	PROFILE_END(PROFILE_ISR_TIMER1_COMPA);
 }
 
-ISR(TIMER2_OVF_vect) {
-	ticks++;
-	uint8_t i=0;
-	for(;i<NUM_LFO;i++) {
-		if(lfo[i].clock_sync) {
-			// recalculate stepwidth everytime to even out division errors
-			lfo[i].stepwidth = LFO_TABLE_LENGTH / ((current_midiclock_tick - last_midiclock_tick)*clock_limit[lfo[i].clock_mode]);
-			lfo[i].position += lfo[i].stepwidth;
-		} else {
-			lfo[i].position += lfo[i].stepwidth;
-		}
-		lfo[i].position %= LFO_TABLE_LENGTH;
+ISR(TIMER1_COMPB_vect) {
+	PROFILE_BEGIN(PROFILE_ISR_TIMER1_COMPB);
+	timebase_t now = timebase_now();
+	// next clock is more than one timer1 period away
+	if((int32_t)(now - internal_clock_next) < 0) {
+		PROFILE_END(PROFILE_ISR_TIMER1_COMPB);
+		return;
 	}
-	must_update_lfo = true;
-
-	for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
-		if(clock_output[i].active_countdown > 0) {
-			clock_output[i].active_countdown--;
-			must_update_clock_output = true;
+	if(!external_clock_seen || now - last_external_clock_time > external_clock_timeout) {
+		external_clock_seen = false;
+		internal_clock_time = internal_clock_next;
+		internal_clock_pending++;
+		scheduler_post(TASK_CLOCK);
+		if(ISSET(settings->global_options, (1<<SEND_INTERNAL_CLOCK))) {
+			uart_put_realtime(CLOCK_SIGNAL);
 		}
 	}
+	// keep the fractional part to get the tempo right to a fraction of a us
+	uint16_t fraction = internal_clock_fraction + (internal_clock_period & 0xff);
+	internal_clock_next += (internal_clock_period>>8) + (fraction>>8);
+	internal_clock_fraction = fraction & 0xff;
+	OCR1B = (uint16_t)internal_clock_next;
+	PROFILE_END(PROFILE_ISR_TIMER1_COMPB);
 }
 
-int main(int argc, char** argv) {
+void init_firmware(void) {
 	cli();
+	eeprom_store_init(SETTINGS_VERSION, SETTINGS_RECORD_SIZE, settings_get, settings_put);
 	read_settings();
 	init_variables();
 	init_lfo();
 	init_io();
 	mode[playmode].init();
+	init_tasks();
+#ifdef PROFILING
+	profile_init();
+#endif
+#ifdef LATENCY
+	latency_init();
+#endif
 	sei();
+}
+
+#ifndef HAL_HOST
+int main(int argc, char** argv) {
+	init_firmware();
 //	uint16_t j=0;
 	while(1) {
 		// <NORMAL FUNCTION>
-		// handle midibuffer - update playing_notes accordingly
-		if(midibuffer_tick(&midi_buffer)) {
-			mode[playmode].update_notes(&note_stack, playing_notes);
-			must_update_dac = true;
-		}
-
-		// as our TIMER_Interupt might change must_update_dac
-		// during update_dac() - which is fine - we have to
-		// eventually repeat update_dac() right away
-		while(must_update_dac) {
-			must_update_dac = false;
-			update_dac();
-		}
-		if(get_shiftin) {
-			get_shiftin = false;
-			process_user_input();
-		}
-		if(get_analogin) {
-			get_analogin = false;
-			process_analog_in();
-		}
-		if(update_clock) {
-			update_clock = false;
-			update_clock_trigger();
-		}
-		if(must_update_lfo) {
-			must_update_lfo = false;
-			update_lfo();
-		}
-		if(must_update_clock_output) {
-			must_update_clock_output = false;
-			update_clock_output();
-		}
+		scheduler_run_next();
 		// </NORMAL FUNCTION>
 
 //		// <RAMP UP TEST_CASE> - use to verify all DAC-channels work
@@ -789,7 +1400,7 @@ int main(int argc, char** argv) {
 //		cli();
 //		uint8_t i=0;
 //		for(i=0; i<8; i++) {
-//			dac8568c_write(DAC_WRITE_UPDATE_N, i, voltage[j]);
+//			dac8568c_write(DAC_WRITE_UPDATE_N, i, calibration_voltage(&settings->calibration, 0, j));
 //		}
 //		j++;
 //		j%=10;
@@ -801,4 +1412,4 @@ int main(int argc, char** argv) {
 	}
 	return 0;
 }
-
+#endif
@@ -1,4 +1,5 @@
 #include "midibuffer.h"
+#include "profile.h"
 
 bool midibuffer_issysex=false;
 midimessage_t current_message = {{0}};
@@ -6,6 +7,10 @@ uint8_t current_message_next_fillbyte = 0;
 
 bool midibuffer_init(midibuffer_t* b, midimessage_handler h) {
 	b->f = h;
+	// start without a status and outside of any SysEx
+	midibuffer_issysex = false;
+	current_message.byte[0] = 0;
+	current_message_next_fillbyte = 0;
 	return ringbuffer_init(&(b->buffer));
 }
 
@@ -112,8 +117,11 @@ bool midibuffer_get(midibuffer_t* b, midimessage_t* m) {
 
 bool midibuffer_tick(midibuffer_t* b) {
 	midimessage_t m = {{0}};
+	PROFILE_BEGIN(PROFILE_MIDIBUFFER_GET);
+	bool got_message = midibuffer_get(b, &m);
+	PROFILE_END(PROFILE_MIDIBUFFER_GET);
 	// if there is a message to dispatch
-	if(midibuffer_get(b, &m)) {
+	if(got_message) {
 		// dispatch it
 		return b->f(&m);
 	}
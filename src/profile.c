@@ -0,0 +1,45 @@
+#include "profile.h"
+
+#ifdef PROFILING
+
+profile_t profile[NUM_PROFILE_PATHS];
+uint16_t profile_overhead = 0;
+
+void profile_init(void) {
+	uint8_t i=0;
+	profile_overhead = 0;
+	for(;i<NUM_PROFILE_PATHS;i++) {
+		profile_reset(i);
+	}
+	// measure an empty path and throw it away again
+	PROFILE_BEGIN(PROFILE_UPDATE_DAC);
+	profile_overhead = (uint16_t)timebase_now() - profile_start_PROFILE_UPDATE_DAC;
+	profile_reset(PROFILE_UPDATE_DAC);
+}
+
+void profile_reset(uint8_t path) {
+	stats_reset(&profile[path].stats, profile[path].histogram, NUM_PROFILE_BUCKETS);
+}
+
+void profile_record(uint8_t path, uint16_t ticks) {
+	uint8_t i=0;
+	uint16_t rest;
+	ticks = (ticks > profile_overhead) ? ticks - profile_overhead : 0;
+	for(rest=ticks>>2; rest && i<NUM_PROFILE_BUCKETS-1; i++) {
+		rest >>= 2;
+	}
+	stats_record(&profile[path].stats, profile[path].histogram, NUM_PROFILE_BUCKETS, i, ticks);
+}
+
+uint8_t profile_sysex(uint8_t path, uint8_t* out) {
+	uint8_t* start = out;
+	*out++ = 0xf0;
+	*out++ = PROFILE_SYSEX_ID;
+	*out++ = PROFILE_SYSEX_TYPE;
+	*out++ = path;
+	out = stats_sysex(&profile[path].stats, profile[path].histogram, NUM_PROFILE_BUCKETS, out);
+	*out++ = 0xf7;
+	return out-start;
+}
+
+#endif
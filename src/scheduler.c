@@ -0,0 +1,78 @@
+#include "scheduler.h"
+
+task_t* scheduler_tasks;
+uint8_t scheduler_num_tasks = 0;
+
+void task_init(task_t* t, task_function_t run, uint8_t priority, timebase_t period, timebase_t deadline) {
+	t->run = run;
+	t->priority = priority;
+	t->period = period;
+	t->deadline = deadline;
+	t->pending = false;
+	t->release = 0;
+	t->overruns = 0;
+}
+
+void scheduler_init(task_t* tasks, uint8_t num_tasks) {
+	uint8_t i=0;
+	timebase_t now = timebase_now();
+	scheduler_tasks = tasks;
+	scheduler_num_tasks = num_tasks;
+	for(;i<num_tasks;i++) {
+		tasks[i].pending = false;
+		tasks[i].release = now + tasks[i].period;
+	}
+}
+
+// pending is a single byte - setting it needs no locking. release is only
+// written while the task is not pending, so reading it is safe while it is.
+void scheduler_post(uint8_t id) {
+	task_t* t = scheduler_tasks+id;
+	if(!t->pending) {
+		t->release = timebase_now();
+		t->pending = true;
+	}
+}
+
+bool scheduler_run_next(void) {
+	uint8_t i=0;
+	task_t* next = 0;
+	timebase_t now = timebase_now();
+	for(;i<scheduler_num_tasks;i++) {
+		task_t* t = scheduler_tasks+i;
+		if(t->period != 0) {
+			if(!t->pending && (int32_t)(now - t->release) >= 0) {
+				t->pending = true;
+			}
+			if(t->pending && (int32_t)(now - (t->release + t->period)) >= 0) {
+				// still waiting from the last period
+				t->overruns++;
+				t->release += t->period;
+			}
+		}
+		if(!t->pending) {
+			continue;
+		}
+		if(next == 0 || t->priority < next->priority ||
+				(t->priority == next->priority &&
+				(int32_t)((t->release + t->deadline) - (next->release + next->deadline)) < 0)) {
+			next = t;
+		}
+	}
+	if(next == 0) {
+		return false;
+	}
+	if((int32_t)(now - next->release) > (int32_t)next->deadline) {
+		next->overruns++;
+	}
+	if(next->period != 0) {
+		next->release += next->period;
+		// way behind - do not try to catch up with all the missed periods
+		if((int32_t)(now - next->release) >= 0) {
+			next->release = now + next->period;
+		}
+	}
+	next->pending = false;
+	next->run();
+	return true;
+}
@@ -1,4 +1,5 @@
 #include "spi.h"
+#include <avr/interrupt.h>
 
 void init_spi(void) {
 	// Setting Up SPI Mode 
@@ -19,3 +20,29 @@ uint8_t spi_transfer(uint8_t data) {
 	return SPDR;
 }
 
+
+void spi_device_init(spi_device_t* device, uint8_t mode, uint8_t divider, volatile uint8_t* cs_port, uint8_t cs_pin) {
+	device->spcr = (1<<SPE) | (1<<MSTR) | mode | (divider & 0x03);
+	device->spsr = (divider & 0x04) ? (1<<SPI2X) : 0;
+	device->cs_port = cs_port;
+	device->cs_mask = (1<<cs_pin);
+	*cs_port |= device->cs_mask;
+}
+
+uint8_t spi_begin(spi_device_t* device) {
+	uint8_t sreg = SREG;
+	cli();
+	if(SPCR != device->spcr) {
+		SPCR = device->spcr;
+	}
+	if((SPSR ^ device->spsr) & (1<<SPI2X)) {
+		SPSR = device->spsr;
+	}
+	*device->cs_port &= ~device->cs_mask;
+	return sreg;
+}
+
+void spi_end(spi_device_t* device, uint8_t sreg) {
+	*device->cs_port |= device->cs_mask;
+	SREG = sreg;
+}
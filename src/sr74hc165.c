@@ -1,28 +1,28 @@
 #include "sr74hc165.h"
 
+// mode 0 at 8MHz (@16MHz Clock) - CE is the chip select
+spi_device_t sr74hc165_spi;
+
 void sr74hc165_init(void) {
 	init_spi();
 	SR_PL_CE_DDR |= (1<<SR_CE_PIN)|(1<<SR_PL_PIN); // set as output
 	SR_PL_CE_PORT |= (1<<SR_PL_PIN);
-	SR_PL_CE_PORT |= (1<<SR_CE_PIN);
+	spi_device_init(&sr74hc165_spi, SPI_MODE0, SPI_CLOCK_DIV2, &SR_PL_CE_PORT, SR_CE_PIN);
 }
 
 void sr74hc165_read(unsigned char* output_buffer, uint8_t num_modules) {
-	// change to right clock phase for this chip
-	// ATTENTION: this is only save if this method cannot be interrupted by another method that might overwrite SPCR again!
-	SPCR &= ~(1<<CPHA);
 	// load inputs to shift register
 	SR_PL_CE_PORT &= ~(1<<SR_PL_PIN);
 	__asm("nop\n\t");
 	__asm("nop\n\t"); // ... just to make shure ...
 	SR_PL_CE_PORT |= (1<<SR_PL_PIN);
 	// chip select
-	SR_PL_CE_PORT &= ~(1<<SR_CE_PIN);
+	uint8_t sreg = spi_begin(&sr74hc165_spi);
 	// now shift our data into the output_buffer
 	uint8_t i=0;
 	for(; i<num_modules; i++) {
 		*(output_buffer+i) = spi_transfer(0x00);
 	}
-	SR_PL_CE_PORT |= (1<<SR_CE_PIN);
+	spi_end(&sr74hc165_spi, sreg);
 }
 
@@ -0,0 +1,50 @@
+#include "stack_monitor.h"
+#include "stats.h"
+#include "hal.h"
+
+#ifdef __AVR__
+// provided by the linker: end of .bss, top of the stack and start of .data
+extern uint8_t _end;
+extern uint8_t __stack;
+extern uint8_t __data_start;
+
+// runs right after the stack pointer has been set up and before the
+// variables get initialized - there is nothing on the stack yet
+void stack_monitor_paint(void) __attribute__((naked, used, section(".init3")));
+void stack_monitor_paint(void) {
+	uint8_t* p = &_end;
+	while(p <= &__stack) {
+		*p++ = STACK_MONITOR_CANARY;
+	}
+}
+#endif
+
+uint16_t stack_monitor_static(void) {
+	return &_end - &__data_start;
+}
+
+uint16_t stack_monitor_unused(void) {
+	const uint8_t* p = &_end;
+	while(p <= &__stack && *p == STACK_MONITOR_CANARY) {
+		p++;
+	}
+	return p - &_end;
+}
+
+uint16_t stack_monitor_free(void) {
+	return (uint8_t*)SP - &_end;
+}
+
+uint8_t stack_monitor_sysex(uint8_t* out) {
+	uint8_t* start = out;
+	uint16_t unused = stack_monitor_unused();
+	*out++ = 0xf0;
+	*out++ = STACK_MONITOR_SYSEX_ID;
+	*out++ = STACK_MONITOR_SYSEX_TYPE;
+	out = sysex_put16(out, stack_monitor_static());
+	out = sysex_put16(out, &__stack + 1 - &_end - unused);
+	out = sysex_put16(out, unused);
+	out = sysex_put16(out, stack_monitor_free());
+	*out++ = 0xf7;
+	return out-start;
+}
@@ -0,0 +1,56 @@
+#include "stats.h"
+
+uint8_t* sysex_put16(uint8_t* out, uint16_t value) {
+	*out++ = value>>14;
+	*out++ = (value>>7) & 0x7f;
+	*out++ = value & 0x7f;
+	return out;
+}
+
+// only the profiling and the latency measurement keep durations
+#if defined(PROFILING) || defined(LATENCY)
+
+void stats_reset(stats_t* s, uint16_t* histogram, uint8_t num_buckets) {
+	uint8_t i=0;
+	s->count = 0;
+	s->min = 0xffff;
+	s->max = 0;
+	s->sum = 0;
+	for(;i<num_buckets;i++) {
+		histogram[i] = 0;
+	}
+}
+
+void stats_record(stats_t* s, uint16_t* histogram, uint8_t num_buckets, uint8_t bucket, uint16_t ticks) {
+	uint8_t i=0;
+	if(s->count == 0xffff) {
+		s->count >>= 1;
+		s->sum >>= 1;
+		for(;i<num_buckets;i++) {
+			histogram[i] >>= 1;
+		}
+	}
+	s->count++;
+	s->sum += ticks;
+	if(ticks < s->min) {
+		s->min = ticks;
+	}
+	if(ticks > s->max) {
+		s->max = ticks;
+	}
+	histogram[bucket]++;
+}
+
+uint8_t* stats_sysex(const stats_t* s, const uint16_t* histogram, uint8_t num_buckets, uint8_t* out) {
+	uint8_t i=0;
+	out = sysex_put16(out, s->count);
+	out = sysex_put16(out, s->count ? s->min : 0);
+	out = sysex_put16(out, s->max);
+	out = sysex_put16(out, s->count ? s->sum/s->count : 0);
+	for(;i<num_buckets;i++) {
+		out = sysex_put16(out, histogram[i]);
+	}
+	return out;
+}
+
+#endif
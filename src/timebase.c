@@ -0,0 +1,28 @@
+#include "timebase.h"
+#include <avr/io.h>
+#include <avr/interrupt.h>
+
+volatile uint16_t timebase_overflows = 0;
+
+void timebase_init(void) {
+	TCCR1A = 0x00;
+	TCCR1B = (1<<CS11); // set prescaler to 8 -> 0.5us per tick, 32.768ms per overflow
+	TIMSK |= (1<<TOIE1);
+}
+
+timebase_t timebase_now(void) {
+	uint8_t sreg = SREG;
+	cli();
+	uint16_t low = TCNT1;
+	uint16_t high = timebase_overflows;
+	// overflow happened but its interrupt did not run yet
+	if((TIFR & (1<<TOV1)) && low < 0x8000) {
+		high++;
+	}
+	SREG = sreg;
+	return ((timebase_t)high<<16)|low;
+}
+
+ISR(TIMER1_OVF_vect) {
+	timebase_overflows++;
+}
@@ -1,5 +1,12 @@
 #include "uart.h"
 
+// filled by uart_try_putc and emptied by the UDRE interrupt
+volatile unsigned char uart_tx_buffer[UART_TX_BUFFER_SIZE];
+volatile uint8_t uart_tx_read = 0;
+volatile uint8_t uart_tx_write = 0;
+// 0 while there is no realtime message waiting - they all are 0xF8 and up
+volatile unsigned char uart_tx_realtime = 0;
+
 void uart_init(void) {
 	UBRRH = UBRR_VAL >> 8;
 	UBRRL = UBRR_VAL & 0xFF;
@@ -15,11 +22,51 @@ void uart_init(void) {
 }
 
 bool uart_putc(unsigned char c) {
-	while(!(UCSRA & (1<<UDRE)));
-	UDR = c;
+	while(!uart_try_putc(c));
 	return true;
 }
 
+bool uart_try_putc(unsigned char c) {
+	bool queued = false;
+	uint8_t sreg = SREG;
+	cli();
+	uint8_t next = (uart_tx_write+1) & UART_TX_BUFFER_MASK;
+	if(next != uart_tx_read) {
+		uart_tx_buffer[uart_tx_write] = c;
+		uart_tx_write = next;
+		UCSRB |= (1<<UDRIE);
+		queued = true;
+	}
+	SREG = sreg;
+	return queued;
+}
+
+bool uart_put_realtime(unsigned char c) {
+	bool queued = false;
+	uint8_t sreg = SREG;
+	cli();
+	if(!uart_tx_realtime) {
+		uart_tx_realtime = c;
+		UCSRB |= (1<<UDRIE);
+		queued = true;
+	}
+	SREG = sreg;
+	return queued;
+}
+
+ISR(USART_UDRE_vect) {
+	if(uart_tx_realtime) {
+		UDR = uart_tx_realtime;
+		uart_tx_realtime = 0;
+	} else if(uart_tx_read != uart_tx_write) {
+		UDR = uart_tx_buffer[uart_tx_read];
+		uart_tx_read = (uart_tx_read+1) & UART_TX_BUFFER_MASK;
+	} else {
+		// nothing left - off until the next byte gets queued
+		UCSRB &= ~(1<<UDRIE);
+	}
+}
+
 bool uart_puts(char* s) {
 	while(*s) {
 		uart_putc(*s);
@@ -0,0 +1,703 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "envelope.h"
+#include "lfo.h"
+#include "lru_cache.h"
+#include "midibuffer.h"
+#include "midinote_stack.h"
+#include "midi_stream.h"
+#include "polyphonic.h"
+#include "progmem.h"
+#include "unison.h"
+
+// microbenchmarks of the portable modules - see the usage below
+
+// the same table as in main.c
+const uint16_t clock_limit[12] PROGMEM = {
+	1536, 768, 384, 192, 96, 48, 24, 18, 12, 9, 6, 3
+};
+
+// every benchmark is run once to warm up and then this often - the fastest
+// run counts, the others only got disturbed by something else on the machine
+#define BENCH_REPEAT		(5)
+// times a benchmark slower than its baseline gets measured again
+#define BENCH_RETRY			(2)
+#define BENCH_SEED			(0x2545f491UL)
+#define BENCH_DEFAULT_TOLERANCE	(2.0)
+#define BENCH_MAX_BASELINE	(64)
+#define BENCH_NAME_LENGTH	(48)
+
+// as many of the data structures as fit into the first level cache - the
+// short operations are timed on all of them in a row instead of one by one
+#define BENCH_NUM_STACKS	(1024)
+#define BENCH_NUM_BUFFERS	(256)
+// notes played in the benchmarks - more than fit on the stack
+#define BENCH_NOTE_RANGE	(16)
+#define BENCH_STREAM_LENGTH	(4096)
+#define BENCH_NUM_SNAPSHOTS	(256)
+
+typedef struct {
+	double seconds;
+	uint32_t ops;
+	struct timespec start;
+} bench_t;
+
+typedef struct {
+	char name[BENCH_NAME_LENGTH];
+	void (*run)(bench_t* b);
+} bench_case_t;
+
+typedef struct {
+	char name[BENCH_NAME_LENGTH];
+	double ns_per_op;
+} bench_baseline_t;
+
+volatile uint32_t sink = 0;
+uint32_t bench_seed;
+
+// the same numbers on every run and every machine
+uint32_t bench_random(void) {
+	bench_seed = bench_seed*1664525UL + 1013904223UL;
+	return bench_seed>>8;
+}
+
+void bench_start(bench_t* b) {
+	clock_gettime(CLOCK_MONOTONIC, &b->start);
+}
+
+void bench_stop(bench_t* b, uint32_t ops) {
+	struct timespec end;
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	b->seconds += (end.tv_sec-b->start.tv_sec) + (end.tv_nsec-b->start.tv_nsec)/1e9;
+	b->ops += ops;
+}
+
+//
+// ringbuffer
+//
+
+ringbuffer_t bench_buffer[BENCH_NUM_BUFFERS];
+
+void bench_ringbuffer_fill(void) {
+	uint16_t i=0;
+	uint8_t j;
+	for(;i<BENCH_NUM_BUFFERS;i++) {
+		for(j=0;j<RINGBUFFER_SIZE-1;j++) {
+			ringbuffer_put(bench_buffer+i, bench_random());
+		}
+	}
+}
+
+void bench_ringbuffer_drain(void) {
+	unsigned char byte;
+	uint16_t i=0;
+	for(;i<BENCH_NUM_BUFFERS;i++) {
+		while(ringbuffer_get(bench_buffer+i, &byte)) {
+			sink += byte;
+		}
+	}
+}
+
+void bench_ringbuffer_put(bench_t* b) {
+	uint16_t round=0;
+	for(;round<64;round++) {
+		bench_start(b);
+		bench_ringbuffer_fill();
+		bench_stop(b, BENCH_NUM_BUFFERS*(RINGBUFFER_SIZE-1));
+		bench_ringbuffer_drain();
+	}
+}
+
+void bench_ringbuffer_get(bench_t* b) {
+	uint16_t round=0;
+	for(;round<64;round++) {
+		bench_ringbuffer_fill();
+		bench_start(b);
+		bench_ringbuffer_drain();
+		bench_stop(b, BENCH_NUM_BUFFERS*(RINGBUFFER_SIZE-1));
+	}
+}
+
+//
+// midibuffer
+//
+
+uint8_t bench_stream[BENCH_STREAM_LENGTH];
+uint16_t bench_stream_length;
+
+void bench_stream_add(uint8_t byte) {
+	if(bench_stream_length < BENCH_STREAM_LENGTH) {
+		bench_stream[bench_stream_length++] = byte;
+	}
+}
+
+// what a keyboard and a sequencer send: notes mostly in running status,
+// mod wheel movements, the MIDI clock in between and a SysEx now and then
+void bench_stream_init(void) {
+	uint8_t status = 0;
+	bench_stream_length = 0;
+	while(bench_stream_length < BENCH_STREAM_LENGTH-16) {
+		uint32_t r = bench_random();
+		uint8_t kind = r%16;
+		if(kind < 3) {
+			bench_stream_add(CLOCK_SIGNAL);
+		} else if(kind < 5) {
+			if(status != CONTROL_CHANGE(0)) {
+				status = CONTROL_CHANGE(0);
+				bench_stream_add(status);
+			}
+			bench_stream_add(MOD_WHEEL);
+			bench_stream_add((r>>8) & 0x7f);
+		} else if(kind == 5 && (r>>8)%8 == 0) {
+			uint8_t i=0;
+			bench_stream_add(SYSEX_BEGIN);
+			for(;i<8;i++) {
+				bench_stream_add(bench_random() & 0x7f);
+			}
+			bench_stream_add(SYSEX_END);
+		} else {
+			// note off as note on with velocity 0 half of the time
+			if(status != NOTE_ON(0)) {
+				status = NOTE_ON(0);
+				bench_stream_add(status);
+			}
+			bench_stream_add(48 + (r>>8)%BENCH_NOTE_RANGE);
+			bench_stream_add((r>>16) & 1 ? 0 : 1 + (r>>17)%127);
+		}
+	}
+}
+
+bool bench_midimessage_handler(midimessage_t* m) {
+	return true;
+}
+
+// the receive interrupt fills up the buffer, then the MIDI task reads all
+// there is - only the reading is timed. Returns the number of messages.
+uint32_t bench_midibuffer_read(bench_t* b, const uint8_t* stream, uint16_t length) {
+	midibuffer_t buffer;
+	midimessage_t m;
+	uint32_t messages = 0;
+	uint16_t i=0;
+	midibuffer_init(&buffer, bench_midimessage_handler);
+	while(i<length) {
+		while(i<length && midibuffer_put(&buffer, stream[i])) {
+			i++;
+		}
+		bench_start(b);
+		while(midibuffer_get(&buffer, &m)) {
+			sink += m.byte[0];
+			messages++;
+		}
+		bench_stop(b, 0);
+	}
+	return messages;
+}
+
+void bench_midibuffer_get(bench_t* b) {
+	uint16_t round=0;
+	for(;round<256;round++) {
+		b->ops += bench_midibuffer_read(b, bench_stream, bench_stream_length);
+	}
+}
+
+// the worst cases from midi_stream.h in ns per byte - so they compare to
+// the 320us a byte takes on the wire
+void bench_midibuffer_bytes(bench_t* b, uint8_t kind) {
+	uint8_t stream[BENCH_STREAM_LENGTH];
+	uint16_t round=0;
+	midi_stream_generate(kind, BENCH_SEED, stream, BENCH_STREAM_LENGTH);
+	for(;round<256;round++) {
+		bench_midibuffer_read(b, stream, BENCH_STREAM_LENGTH);
+		b->ops += BENCH_STREAM_LENGTH;
+	}
+}
+
+void bench_midibuffer_bytes_running_status(bench_t* b) {
+	bench_midibuffer_bytes(b, MIDI_STREAM_RUNNING_STATUS);
+}
+
+void bench_midibuffer_bytes_realtime(bench_t* b) {
+	bench_midibuffer_bytes(b, MIDI_STREAM_REALTIME);
+}
+
+void bench_midibuffer_bytes_unterminated_sysex(bench_t* b) {
+	bench_midibuffer_bytes(b, MIDI_STREAM_UNTERMINATED_SYSEX);
+}
+
+void bench_midibuffer_bytes_reserved(bench_t* b) {
+	bench_midibuffer_bytes(b, MIDI_STREAM_RESERVED);
+}
+
+void bench_midibuffer_bytes_mixed(bench_t* b) {
+	bench_midibuffer_bytes(b, MIDI_STREAM_MIXED);
+}
+
+//
+// midinote stack
+//
+
+midinote_stack_t bench_stack[BENCH_NUM_STACKS];
+// the notes pushed to each stack, in the order they get removed
+note_t bench_stack_note[BENCH_NUM_STACKS][MIDINOTE_STACK_SIZE];
+
+#define BENCH_STACK_DEPTH	(MIDINOTE_STACK_SIZE-2)
+
+void bench_stack_fill(void) {
+	uint16_t i=0;
+	uint8_t j;
+	for(;i<BENCH_NUM_STACKS;i++) {
+		for(j=0;j<BENCH_STACK_DEPTH;j++) {
+			midinote_t n = {bench_stack_note[i][j], 100};
+			midinote_stack_push(bench_stack+i, n);
+		}
+	}
+}
+
+void bench_stack_empty(void) {
+	uint16_t i=0;
+	uint8_t j;
+	for(;i<BENCH_NUM_STACKS;i++) {
+		for(j=0;j<BENCH_STACK_DEPTH;j++) {
+			midinote_stack_remove(bench_stack+i, bench_stack_note[i][BENCH_STACK_DEPTH-1-(j*3)%BENCH_STACK_DEPTH]);
+		}
+	}
+}
+
+void bench_stack_init(void) {
+	uint16_t i=0;
+	uint8_t j;
+	for(;i<BENCH_NUM_STACKS;i++) {
+		midinote_stack_init(bench_stack+i);
+		// different notes on each stack, released in a different order
+		for(j=0;j<BENCH_STACK_DEPTH;j++) {
+			uint8_t k;
+			note_t note;
+			do {
+				note = 48 + bench_random()%BENCH_NOTE_RANGE;
+				for(k=0;k<j && bench_stack_note[i][k] != note;k++);
+			} while(k<j);
+			bench_stack_note[i][j] = note;
+		}
+	}
+}
+
+void bench_midinote_stack_push(bench_t* b) {
+	uint16_t round=0;
+	bench_stack_init();
+	for(;round<64;round++) {
+		bench_start(b);
+		bench_stack_fill();
+		bench_stop(b, BENCH_NUM_STACKS*BENCH_STACK_DEPTH);
+		bench_stack_empty();
+	}
+}
+
+void bench_midinote_stack_remove(bench_t* b) {
+	uint16_t round=0;
+	bench_stack_init();
+	for(;round<64;round++) {
+		bench_stack_fill();
+		bench_start(b);
+		bench_stack_empty();
+		bench_stop(b, BENCH_NUM_STACKS*BENCH_STACK_DEPTH);
+	}
+}
+
+void bench_midinote_stack_peek_n(bench_t* b) {
+	midinote_t* first;
+	uint8_t num;
+	uint16_t round=0;
+	bench_stack_init();
+	bench_stack_fill();
+	bench_start(b);
+	for(;round<256;round++) {
+		uint16_t i=0;
+		for(;i<BENCH_NUM_STACKS;i++) {
+			midinote_stack_peek_n(bench_stack+i, 1 + (i+round)%NUM_PLAY_NOTES, &first, &num);
+			sink += first->note + num;
+		}
+	}
+	bench_stop(b, 256UL*BENCH_NUM_STACKS);
+}
+
+//
+// play modes
+//
+
+midinote_stack_t bench_snapshot[BENCH_NUM_SNAPSHOTS];
+
+// the note stack after each message of someone playing - chords and runs
+// with notes held over
+void bench_snapshot_init(void) {
+	midinote_stack_t s;
+	uint16_t i=0;
+	midinote_stack_init(&s);
+	for(;i<BENCH_NUM_SNAPSHOTS;i++) {
+		uint32_t r = bench_random();
+		midinote_t n = {48 + r%BENCH_NOTE_RANGE, 1 + (r>>8)%127};
+		if((r>>16)%3 == 0 || !midinote_stack_remove(&s, n.note)) {
+			midinote_stack_push(&s, n);
+		}
+		bench_snapshot[i] = s;
+	}
+}
+
+void bench_update_notes(bench_t* b, playmode_t* mode) {
+	playingnote_t playing_notes[NUM_PLAY_NOTES];
+	uint16_t round=0;
+	mode->init();
+	memset(playing_notes, EMPTY_NOTE, sizeof(playing_notes));
+	bench_snapshot_init();
+	bench_start(b);
+	for(;round<512;round++) {
+		uint16_t i=0;
+		for(;i<BENCH_NUM_SNAPSHOTS;i++) {
+			mode->update_notes(bench_snapshot+i, playing_notes);
+		}
+		sink += playing_notes[round%NUM_PLAY_NOTES].midinote.note;
+	}
+	bench_stop(b, 512UL*BENCH_NUM_SNAPSHOTS);
+}
+
+void bench_update_notes_polyphonic(bench_t* b) {
+	playmode_t mode = {update_notes_polyphonic, init_polyphonic};
+	bench_update_notes(b, &mode);
+}
+
+void bench_update_notes_unison(bench_t* b) {
+	playmode_t mode = {update_notes_unison, init_unison};
+	bench_update_notes(b, &mode);
+}
+
+void bench_lru_cache_use(bench_t* b) {
+	lru_cache cache[NUM_PLAY_NOTES];
+	uint8_t index[256];
+	uint16_t i=0;
+	uint16_t round=0;
+	lru_cache_init(cache, NUM_PLAY_NOTES);
+	for(;i<256;i++) {
+		index[i] = bench_random()%NUM_PLAY_NOTES;
+	}
+	bench_start(b);
+	for(;round<4096;round++) {
+		for(i=0;i<256;i++) {
+			lru_cache_use(cache, index[i], NUM_PLAY_NOTES);
+		}
+		sink += cache[0];
+	}
+	bench_stop(b, 4096UL*256);
+}
+
+//
+// LFOs - there are no lfo_get_* functions anymore, the bank renders all LFOs
+// of a shape in one loop. Each shape gets timed on a bank of that shape only.
+//
+
+#define BENCH_LFO_SAMPLES	(200000UL)
+
+void bench_lfo_bank_setup(lfo_bank_t* bank, int8_t shape) {
+	uint8_t i=0;
+	lfo_bank_init(bank);
+	for(;i<NUM_LFO;i++) {
+		// mix all the shapes and have every second one synced
+		lfo_set_shape(bank, i, shape < 0 ? i%NUM_LFO_SHAPES : shape);
+		lfo_set_clock_sync(bank, i, i%2);
+		lfo_set_clock_mode(bank, i, i);
+		bank->stepwidth[i] = 100+i*37;
+	}
+}
+
+void bench_lfo_bank_run(bench_t* b, int8_t shape) {
+	lfo_bank_t bank;
+	uint32_t k=0;
+	bench_lfo_bank_setup(&bank, shape);
+	bench_start(b);
+	for(;k<BENCH_LFO_SAMPLES;k++) {
+		lfo_bank_advance(&bank, 1, 41666);
+		lfo_bank_render(&bank);
+		sink += bank.value[k%NUM_LFO];
+	}
+	bench_stop(b, BENCH_LFO_SAMPLES*NUM_LFO);
+}
+
+void bench_lfo_bank(bench_t* b) {
+	bench_lfo_bank_run(b, -1);
+}
+
+#define BENCH_LFO_SHAPE(name, shape) \
+	void bench_lfo_##name(bench_t* b) { \
+		bench_lfo_bank_run(b, shape); \
+	}
+
+BENCH_LFO_SHAPE(rev_sawtooth, REV_SAWTOOTH)
+BENCH_LFO_SHAPE(triangle, TRIANGLE)
+BENCH_LFO_SHAPE(pulse, PULSE)
+BENCH_LFO_SHAPE(sawtooth, SAWTOOTH)
+BENCH_LFO_SHAPE(sample_hold, SAMPLE_HOLD)
+BENCH_LFO_SHAPE(smooth_random, SMOOTH_RANDOM)
+BENCH_LFO_SHAPE(random_gate, RANDOM_GATE)
+
+// the same bank rendered a block of BENCH_BLOCK_LENGTH samples at a time
+#define BENCH_BLOCK_LENGTH	(256)
+#define BENCH_LFO_BLOCKS	(BENCH_LFO_SAMPLES/BENCH_BLOCK_LENGTH)
+
+void bench_lfo_block(bench_t* b) {
+	lfo_bank_t bank;
+	uint16_t out[NUM_LFO*BENCH_BLOCK_LENGTH];
+	uint32_t k=0;
+	bench_lfo_bank_setup(&bank, -1);
+	bench_start(b);
+	for(;k<BENCH_LFO_BLOCKS;k++) {
+		lfo_bank_render_block(&bank, 1, 41666, out, BENCH_BLOCK_LENGTH);
+		sink += out[k%(NUM_LFO*BENCH_BLOCK_LENGTH)];
+	}
+	bench_stop(b, BENCH_LFO_BLOCKS*BENCH_BLOCK_LENGTH*NUM_LFO);
+}
+
+// one LFO the way it used to be: a function pointer called per LFO and sample
+typedef struct ref_lfo_t ref_lfo_t;
+typedef uint16_t (*ref_get_value_t)(ref_lfo_t* lfo);
+struct ref_lfo_t {
+	uint16_t stepwidth;
+	uint32_t position;
+	ref_get_value_t get_value;
+};
+
+uint16_t ref_get_rev_sawtooth(ref_lfo_t* lfo) {
+	return 0xffff - (lfo->position%0xffff);
+}
+
+uint16_t ref_get_triangle(ref_lfo_t* lfo) {
+	return (lfo->position%0xffff > LFO_HALF_TABLE_LENGTH) ? (LFO_TABLE_LENGTH - lfo->position%0xffff)*2 : lfo->position%0xffff*2;
+}
+
+uint16_t ref_get_pulse(ref_lfo_t* lfo) {
+	return (lfo->position%0xffff > LFO_HALF_TABLE_LENGTH) ? 0x0000 : 0xffff;
+}
+
+uint16_t ref_get_sawtooth(ref_lfo_t* lfo) {
+	return lfo->position%0xffff;
+}
+
+// the old implementation only knew the 4 regular shapes
+#define NUM_REF_SHAPES	(4)
+ref_get_value_t ref_shape[NUM_REF_SHAPES] = {
+	ref_get_rev_sawtooth,
+	ref_get_triangle,
+	ref_get_pulse,
+	ref_get_sawtooth
+};
+
+void bench_lfo_function_pointer(bench_t* b) {
+	ref_lfo_t ref[NUM_LFO];
+	uint32_t k=0;
+	uint8_t i=0;
+	for(;i<NUM_LFO;i++) {
+		ref[i].stepwidth = 100+i*37;
+		ref[i].position = 0;
+		ref[i].get_value = ref_shape[i%NUM_REF_SHAPES];
+	}
+	bench_start(b);
+	for(;k<BENCH_LFO_SAMPLES;k++) {
+		for(i=0;i<NUM_LFO;i++) {
+			ref[i].position = (ref[i].position + ref[i].stepwidth) % LFO_TABLE_LENGTH;
+			sink += ref[i].get_value(ref+i);
+		}
+	}
+	bench_stop(b, BENCH_LFO_SAMPLES*NUM_LFO);
+}
+
+//
+// envelopes - ticked one by one the way the firmware does and in blocks
+//
+
+#define BENCH_ENVELOPE_TICKS	(200704UL)
+// the gates change this often - a multiple of BENCH_BLOCK_LENGTH
+#define BENCH_GATE_TICKS		(1024)
+
+void bench_envelope_setup(envelope_bank_t* bank) {
+	envelope_bank_init(bank);
+	envelope_set_attack(bank, 100);
+	envelope_set_decay(bank, 200);
+	envelope_set_sustain(bank, 0x8000);
+	envelope_set_release(bank, 300);
+}
+
+void bench_envelope_tick(bench_t* b) {
+	envelope_bank_t bank;
+	uint32_t k=0;
+	uint8_t i;
+	bench_envelope_setup(&bank);
+	bench_start(b);
+	for(;k<BENCH_ENVELOPE_TICKS;k++) {
+		if(k%BENCH_GATE_TICKS == 0) {
+			envelope_set_gates(&bank, bench_random());
+		}
+		envelope_bank_tick(&bank);
+		for(i=0;i<NUM_ENVELOPES;i++) {
+			sink += envelope_value(&bank, i);
+		}
+	}
+	bench_stop(b, BENCH_ENVELOPE_TICKS*NUM_ENVELOPES);
+}
+
+void bench_envelope_block(bench_t* b) {
+	envelope_bank_t bank;
+	uint16_t out[NUM_ENVELOPES*BENCH_BLOCK_LENGTH];
+	uint32_t k=0;
+	bench_envelope_setup(&bank);
+	bench_start(b);
+	for(;k<BENCH_ENVELOPE_TICKS;k+=BENCH_BLOCK_LENGTH) {
+		if(k%BENCH_GATE_TICKS == 0) {
+			envelope_set_gates(&bank, bench_random());
+		}
+		envelope_bank_render_block(&bank, out, BENCH_BLOCK_LENGTH);
+		sink += out[k%(NUM_ENVELOPES*BENCH_BLOCK_LENGTH)];
+	}
+	bench_stop(b, BENCH_ENVELOPE_TICKS*NUM_ENVELOPES);
+}
+
+#define BENCH_STRINGIFY(x)	#x
+#define BENCH_LFO_NAME(name, n)	"lfo_" name "_n" BENCH_STRINGIFY(n)
+
+bench_case_t bench_case[] = {
+	{"ringbuffer_put", bench_ringbuffer_put},
+	{"ringbuffer_get", bench_ringbuffer_get},
+	{"midibuffer_get", bench_midibuffer_get},
+	{"midibuffer_bytes_running_status", bench_midibuffer_bytes_running_status},
+	{"midibuffer_bytes_realtime", bench_midibuffer_bytes_realtime},
+	{"midibuffer_bytes_unterminated_sysex", bench_midibuffer_bytes_unterminated_sysex},
+	{"midibuffer_bytes_reserved", bench_midibuffer_bytes_reserved},
+	{"midibuffer_bytes_mixed", bench_midibuffer_bytes_mixed},
+	{"midinote_stack_push", bench_midinote_stack_push},
+	{"midinote_stack_remove", bench_midinote_stack_remove},
+	{"midinote_stack_peek_n", bench_midinote_stack_peek_n},
+	{"update_notes_polyphonic", bench_update_notes_polyphonic},
+	{"update_notes_unison", bench_update_notes_unison},
+	{"lru_cache_use", bench_lru_cache_use},
+	{BENCH_LFO_NAME("bank", NUM_LFO), bench_lfo_bank},
+	{BENCH_LFO_NAME("block", NUM_LFO), bench_lfo_block},
+	{BENCH_LFO_NAME("function_pointer", NUM_LFO), bench_lfo_function_pointer},
+	{BENCH_LFO_NAME("rev_sawtooth", NUM_LFO), bench_lfo_rev_sawtooth},
+	{BENCH_LFO_NAME("triangle", NUM_LFO), bench_lfo_triangle},
+	{BENCH_LFO_NAME("pulse", NUM_LFO), bench_lfo_pulse},
+	{BENCH_LFO_NAME("sawtooth", NUM_LFO), bench_lfo_sawtooth},
+	{BENCH_LFO_NAME("sample_hold", NUM_LFO), bench_lfo_sample_hold},
+	{BENCH_LFO_NAME("smooth_random", NUM_LFO), bench_lfo_smooth_random},
+	{BENCH_LFO_NAME("random_gate", NUM_LFO), bench_lfo_random_gate},
+	{"envelope_tick", bench_envelope_tick},
+	{"envelope_block", bench_envelope_block}
+};
+#define NUM_BENCH_CASES	(sizeof(bench_case)/sizeof(bench_case[0]))
+
+// the fastest of BENCH_REPEAT runs in ns per operation
+double bench_measure(bench_case_t* c) {
+	double best = 0;
+	uint8_t i=0;
+	for(;i<=BENCH_REPEAT;i++) {
+		bench_t b = {0, 0};
+		bench_seed = BENCH_SEED;
+		bench_stream_init();
+		c->run(&b);
+		// the first run is the warmup
+		if(i > 0 && b.ops && (best == 0 || b.seconds*1e9/b.ops < best)) {
+			best = b.seconds*1e9/b.ops;
+		}
+	}
+	return best;
+}
+
+// the baseline is a saved output of this program - lines of name and ns/op
+uint8_t bench_read_baseline(const char* path, bench_baseline_t* baseline) {
+	FILE* f = fopen(path, "r");
+	char line[128];
+	uint8_t n = 0;
+	if(!f) {
+		perror(path);
+		exit(2);
+	}
+	while(n < BENCH_MAX_BASELINE && fgets(line, sizeof(line), f)) {
+		if(line[0] == '#') {
+			continue;
+		}
+		if(sscanf(line, "%47s %lf", baseline[n].name, &baseline[n].ns_per_op) == 2) {
+			n++;
+		}
+	}
+	fclose(f);
+	return n;
+}
+
+void usage(const char* name) {
+	fprintf(stderr,
+			"usage: %s [-f prefix] [-b baseline] [-t tolerance]\n"
+			"Runs the microbenchmarks and prints a line per benchmark: its name,\n"
+			"ns per operation and operations per second.\n"
+			"  -f prefix     only the benchmarks whose name starts with prefix\n"
+			"  -b baseline   compare against a saved output and fail if anything\n"
+			"                got slower than the tolerance allows\n"
+			"  -t tolerance  how many times slower than the baseline is still fine\n"
+			"                (default %.1f)\n",
+			name, BENCH_DEFAULT_TOLERANCE);
+}
+
+int main(int argc, char** argv) {
+	bench_baseline_t baseline[BENCH_MAX_BASELINE];
+	uint8_t num_baseline = 0;
+	const char* prefix = "";
+	double tolerance = BENCH_DEFAULT_TOLERANCE;
+	uint8_t regressions = 0;
+	uint8_t i=0;
+	int opt;
+	while((opt = getopt(argc, argv, "f:b:t:h")) != -1) {
+		switch(opt) {
+			case 'f':
+				prefix = optarg;
+				break;
+			case 'b':
+				num_baseline = bench_read_baseline(optarg, baseline);
+				break;
+			case 't':
+				tolerance = atof(optarg);
+				break;
+			default:
+				usage(argv[0]);
+				return 2;
+		}
+	}
+
+	printf("# name ns_per_op ops_per_s\n");
+	for(;i<NUM_BENCH_CASES;i++) {
+		bench_case_t* c = bench_case+i;
+		uint8_t j=0;
+		if(strncmp(c->name, prefix, strlen(prefix))) {
+			continue;
+		}
+		uint8_t retry=0;
+		double ns = bench_measure(c);
+		for(;j<num_baseline && strcmp(baseline[j].name, c->name);j++);
+		// only count it if it is slow again - a busy machine is no regression
+		for(;j<num_baseline && ns > baseline[j].ns_per_op*tolerance && retry<BENCH_RETRY;retry++) {
+			double again = bench_measure(c);
+			if(again < ns) {
+				ns = again;
+			}
+		}
+		printf("%s %.3f %.0f\n", c->name, ns, 1e9/ns);
+		fflush(stdout);
+		if(j<num_baseline && ns > baseline[j].ns_per_op*tolerance) {
+			fprintf(stderr, "REGRESSION %s: %.3f ns/op, baseline %.3f ns/op (%.2fx)\n",
+					c->name, ns, baseline[j].ns_per_op, ns/baseline[j].ns_per_op);
+			regressions++;
+		}
+	}
+	if(regressions) {
+		fprintf(stderr, "%u benchmarks slower than %.2fx their baseline\n", regressions, tolerance);
+		return 1;
+	}
+	return 0;
+}
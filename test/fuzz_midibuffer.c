@@ -0,0 +1,256 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "midibuffer.h"
+#include "midi_stream.h"
+
+// feeds arbitrary bytes to midibuffer_get and checks every message against
+// a reference parser. The first byte of an input sets how many bytes the
+// receive interrupt puts into the buffer before the MIDI task reads it all.
+// Built with clang -fsanitize=fuzzer this is a libFuzzer target, built with
+// FUZZ_STANDALONE it runs the generated streams and mutations of them.
+
+#define FUZZ_STREAM_LENGTH		(2048)
+#define FUZZ_DEFAULT_ITERATIONS	(100000UL)
+#define FUZZ_SEED				(0x6d1d1b5fUL)
+
+// the rules midibuffer_get follows, written down byte by byte
+typedef struct {
+	bool sysex;
+	uint8_t status;
+	uint8_t count;
+	uint8_t data[2];
+} fuzz_reference_t;
+
+// the number of bytes of a message including its status byte
+uint8_t fuzz_length(uint8_t status) {
+	if(status >= CLOCK_SIGNAL) {
+		return 1;
+	}
+	if((status & 0xe0) == 0xc0 || status == 0xf1 || status == 0xf3) {
+		return 2;
+	}
+	return 3;
+}
+
+bool fuzz_reference_byte(fuzz_reference_t* r, uint8_t byte, midimessage_t* m) {
+	if(byte == SYSEX_BEGIN) {
+		r->sysex = true;
+		return false;
+	}
+	if(byte == SYSEX_END) {
+		r->sysex = false;
+		return false;
+	}
+	// everything in a SysEx is dropped - even the realtime messages
+	if(r->sysex) {
+		return false;
+	}
+	if(byte >= CLOCK_SIGNAL) {
+		if(byte == 0xf9 || byte == 0xfd) {
+			return false;
+		}
+		m->byte[0] = byte;
+		return true;
+	}
+	// 0xf4 to 0xf6 leave the running status alone
+	if(byte >= 0xf4) {
+		return false;
+	}
+	if(byte & 0x80) {
+		r->status = byte;
+		r->count = 0;
+		return false;
+	}
+	if(r->status == 0) {
+		return false;
+	}
+	r->data[r->count++] = byte;
+	if(r->count < fuzz_length(r->status)-1) {
+		return false;
+	}
+	m->byte[0] = r->status;
+	m->byte[1] = r->data[0];
+	m->byte[2] = r->data[1];
+	r->count = 0;
+	// no running status for system common messages
+	if(r->status >= 0xf0) {
+		r->status = 0;
+	}
+	return true;
+}
+
+bool fuzz_handler(midimessage_t* m) {
+	return true;
+}
+
+void fuzz_fail(const char* what, uint32_t position, midimessage_t* got, midimessage_t* expected) {
+	fprintf(stderr, "%s after byte %u: got %02x %02x %02x, expected %02x %02x %02x\n", what, position,
+			got->byte[0], got->byte[1], got->byte[2], expected->byte[0], expected->byte[1], expected->byte[2]);
+	abort();
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+	midibuffer_t buffer;
+	fuzz_reference_t reference;
+	midimessage_t expected[RINGBUFFER_SIZE];
+	midimessage_t got;
+	uint8_t chunk;
+	size_t i=1;
+	if(size == 0) {
+		return 0;
+	}
+	chunk = 1 + data[0]%(RINGBUFFER_SIZE-1);
+	midibuffer_init(&buffer, fuzz_handler);
+	memset(&reference, 0, sizeof(reference));
+	while(i<size) {
+		uint8_t num_expected = 0;
+		uint8_t k=0;
+		uint8_t j=0;
+		for(;j<chunk && i<size;j++,i++) {
+			if(!midibuffer_put(&buffer, data[i])) {
+				fprintf(stderr, "buffer full after byte %u\n", (unsigned)i);
+				abort();
+			}
+			if(fuzz_reference_byte(&reference, data[i], expected+num_expected)) {
+				num_expected++;
+			}
+		}
+		memset(&got, 0, sizeof(got));
+		while(midibuffer_get(&buffer, &got)) {
+			if(k == num_expected) {
+				fuzz_fail("message too many", i, &got, &got);
+			}
+			if(memcmp(got.byte, expected[k].byte, fuzz_length(expected[k].byte[0]))) {
+				fuzz_fail("wrong message", i, &got, expected+k);
+			}
+			k++;
+			memset(&got, 0, sizeof(got));
+		}
+		if(k != num_expected) {
+			fuzz_fail("message missing", i, &got, expected+k);
+		}
+	}
+	return 0;
+}
+
+#ifdef FUZZ_STANDALONE
+
+uint32_t fuzz_seed = FUZZ_SEED;
+
+uint32_t fuzz_random(void) {
+	fuzz_seed = fuzz_seed*1664525UL + 1013904223UL;
+	return fuzz_seed>>8;
+}
+
+// the bytes the parser treats specially
+const uint8_t fuzz_interesting[] = {
+	0x00, 0x7f, 0x80, 0x90, 0xb0, 0xc0, 0xe0, 0xf0, 0xf1, 0xf2, 0xf3, 0xf4,
+	0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfd, 0xfe, 0xff
+};
+
+// a generated stream with a chunk size in front, mutated a few times
+size_t fuzz_mutate(uint8_t* data, uint8_t kind) {
+	size_t size = 1+FUZZ_STREAM_LENGTH;
+	uint8_t i=0;
+	uint8_t mutations = fuzz_random()%8;
+	data[0] = fuzz_random();
+	midi_stream_generate(kind, fuzz_random(), data+1, FUZZ_STREAM_LENGTH);
+	for(;i<mutations && size>1;i++) {
+		uint32_t r = fuzz_random();
+		size_t position = 1 + (r>>8)%(size-1);
+		switch(r%4) {
+			case 0:
+				data[position] = fuzz_interesting[(r>>20)%sizeof(fuzz_interesting)];
+				break;
+			case 1:
+				data[position] = r>>20;
+				break;
+			case 2:
+				data[position] ^= 1<<((r>>20)%8);
+				break;
+			default:
+				size = position;
+				break;
+		}
+	}
+	return size;
+}
+
+bool fuzz_write_corpus(const char* dir) {
+	uint8_t data[1+FUZZ_STREAM_LENGTH];
+	char path[1024];
+	uint8_t kind=0;
+	for(;kind<NUM_MIDI_STREAMS;kind++) {
+		FILE* f;
+		snprintf(path, sizeof(path), "%s/%s", dir, midi_stream_name[kind]);
+		f = fopen(path, "wb");
+		if(!f) {
+			perror(path);
+			return false;
+		}
+		// reading it all at once and byte by byte
+		data[0] = RINGBUFFER_SIZE-2;
+		midi_stream_generate(kind, FUZZ_SEED+kind, data+1, FUZZ_STREAM_LENGTH);
+		fwrite(data, 1, sizeof(data), f);
+		fclose(f);
+	}
+	return true;
+}
+
+bool fuzz_run_file(const char* path) {
+	FILE* f = fopen(path, "rb");
+	uint8_t* data;
+	long size;
+	if(!f) {
+		perror(path);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = malloc(size ? size : 1);
+	if(!data || fread(data, 1, size, f) != (size_t)size) {
+		fprintf(stderr, "%s: could not be read\n", path);
+		fclose(f);
+		free(data);
+		return false;
+	}
+	fclose(f);
+	LLVMFuzzerTestOneInput(data, size);
+	free(data);
+	return true;
+}
+
+int main(int argc, char** argv) {
+	uint8_t data[1+FUZZ_STREAM_LENGTH];
+	unsigned long iterations = FUZZ_DEFAULT_ITERATIONS;
+	unsigned long k=0;
+	int i=1;
+	if(argc > 2 && strcmp(argv[1], "-w") == 0) {
+		return fuzz_write_corpus(argv[2]) ? 0 : 1;
+	}
+	if(argc > 2 && strcmp(argv[1], "-n") == 0) {
+		iterations = strtoul(argv[2], 0, 10);
+		i = 3;
+	}
+	if(i < argc) {
+		// replay the inputs given - like crashes found by libFuzzer
+		for(;i<argc;i++) {
+			if(!fuzz_run_file(argv[i])) {
+				return 1;
+			}
+		}
+		printf("%d inputs fine\n", argc-1);
+		return 0;
+	}
+	for(;k<iterations;k++) {
+		size_t size = fuzz_mutate(data, k%NUM_MIDI_STREAMS);
+		LLVMFuzzerTestOneInput(data, size);
+	}
+	printf("%lu inputs fine\n", iterations);
+	return 0;
+}
+
+#endif
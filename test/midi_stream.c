@@ -0,0 +1,140 @@
+#include "midi_stream.h"
+#include "midi_datatypes.h"
+
+const char* midi_stream_name[NUM_MIDI_STREAMS] = {
+	"running_status",
+	"realtime",
+	"unterminated_sysex",
+	"reserved",
+	"mixed"
+};
+
+// the realtime messages which get through to the handler
+const uint8_t midi_stream_realtime[] = {
+	CLOCK_SIGNAL, CLOCK_START, CLOCK_CONTINUE, CLOCK_STOP, 0xfe, 0xff
+};
+const uint8_t midi_stream_reserved[] = {
+	0xf4, 0xf5, 0xf6, 0xf9, 0xfd
+};
+// every status with data bytes - the last 3 are system common
+const uint8_t midi_stream_status[] = {
+	0x80, 0x90, 0xa0, 0xb0, 0xc0, 0xd0, 0xe0, 0xf1, 0xf2, 0xf3
+};
+
+typedef struct {
+	uint32_t seed;
+	uint8_t* out;
+	uint32_t length;
+	uint32_t pos;
+} midi_stream_t;
+
+uint32_t midi_stream_random(midi_stream_t* s) {
+	s->seed = s->seed*1664525UL + 1013904223UL;
+	return s->seed>>8;
+}
+
+void midi_stream_put(midi_stream_t* s, uint8_t byte) {
+	if(s->pos < s->length) {
+		s->out[s->pos++] = byte;
+	}
+}
+
+uint8_t midi_stream_data(midi_stream_t* s) {
+	return midi_stream_random(s) & 0x7f;
+}
+
+// a message of a random status, on any channel
+void midi_stream_message(midi_stream_t* s) {
+	uint32_t r = midi_stream_random(s);
+	uint8_t status = midi_stream_status[r%sizeof(midi_stream_status)];
+	uint8_t i=0;
+	uint8_t length = (status == 0xf1 || status == 0xf3 || (status & 0xe0) == 0xc0) ? 1 : 2;
+	if(status < 0xf0) {
+		status |= (r>>8) & 0x0f;
+	}
+	midi_stream_put(s, status);
+	for(;i<length;i++) {
+		midi_stream_put(s, midi_stream_data(s));
+	}
+}
+
+void midi_stream_generate(uint8_t kind, uint32_t seed, uint8_t* out, uint32_t length) {
+	midi_stream_t s = {seed, out, length, 0};
+	uint32_t r;
+	switch(kind) {
+		case MIDI_STREAM_RUNNING_STATUS:
+			// note on, CC and channel pressure - each one for a long while
+			while(s.pos < s.length) {
+				uint32_t i=0;
+				r = midi_stream_random(&s);
+				midi_stream_put(&s, (r%3 == 0 ? 0xd0 : r%3 == 1 ? 0xb0 : 0x90) | ((r>>8) & 0x0f));
+				for(;i<256;i++) {
+					midi_stream_put(&s, midi_stream_data(&s));
+				}
+			}
+			break;
+		case MIDI_STREAM_REALTIME:
+			midi_stream_put(&s, NOTE_ON(0));
+			while(s.pos < s.length) {
+				r = midi_stream_random(&s);
+				midi_stream_put(&s, midi_stream_realtime[r%sizeof(midi_stream_realtime)]);
+				midi_stream_put(&s, midi_stream_data(&s));
+			}
+			break;
+		case MIDI_STREAM_UNTERMINATED_SYSEX:
+			while(s.pos < s.length) {
+				uint32_t i=0;
+				uint32_t sysex_length;
+				r = midi_stream_random(&s);
+				sysex_length = r%64;
+				midi_stream_put(&s, SYSEX_BEGIN);
+				for(;i<sysex_length;i++) {
+					midi_stream_put(&s, midi_stream_data(&s));
+				}
+				if((r>>8)%4 == 0) {
+					midi_stream_put(&s, SYSEX_END);
+				}
+				midi_stream_message(&s);
+			}
+			break;
+		case MIDI_STREAM_RESERVED:
+			midi_stream_put(&s, NOTE_ON(0));
+			while(s.pos < s.length) {
+				r = midi_stream_random(&s);
+				if(r%3 == 0) {
+					midi_stream_put(&s, midi_stream_reserved[(r>>8)%sizeof(midi_stream_reserved)]);
+				}
+				midi_stream_put(&s, midi_stream_data(&s));
+				if((r>>16)%32 == 0) {
+					midi_stream_put(&s, NOTE_ON((r>>8) & 0x0f));
+				}
+			}
+			break;
+		default:
+			while(s.pos < s.length) {
+				r = midi_stream_random(&s);
+				switch(r%8) {
+					case 0:
+						midi_stream_put(&s, midi_stream_realtime[(r>>8)%sizeof(midi_stream_realtime)]);
+						break;
+					case 1:
+						midi_stream_put(&s, midi_stream_reserved[(r>>8)%sizeof(midi_stream_reserved)]);
+						break;
+					case 2:
+						midi_stream_put(&s, SYSEX_BEGIN);
+						break;
+					case 3:
+						midi_stream_put(&s, SYSEX_END);
+						break;
+					case 4:
+					case 5:
+						midi_stream_message(&s);
+						break;
+					default:
+						midi_stream_put(&s, midi_stream_data(&s));
+						break;
+				}
+			}
+			break;
+	}
+}
@@ -0,0 +1,34 @@
+#ifndef _MIDI_STREAM_H_
+#define _MIDI_STREAM_H_
+#include <stdint.h>
+
+/**
+ * Generates MIDI byte streams of the kind that are hard on the parser in
+ * midibuffer.c - legal, but as dense and as interleaved as the wire allows.
+ * The same seed always gives the same stream.
+ */
+
+// a single status byte followed by nothing but data bytes
+#define MIDI_STREAM_RUNNING_STATUS		(0)
+// a realtime byte between any two bytes of a running status stream
+#define MIDI_STREAM_REALTIME			(1)
+// SysEx ended by the next status byte rather than by an F7 most of the time
+#define MIDI_STREAM_UNTERMINATED_SYSEX	(2)
+// the undefined 0xF4, 0xF5, 0xF9 and 0xFD and the tune request in between
+#define MIDI_STREAM_RESERVED			(3)
+// all of the above plus every other message type
+#define MIDI_STREAM_MIXED				(4)
+#define NUM_MIDI_STREAMS				(5)
+
+extern const char* midi_stream_name[NUM_MIDI_STREAMS];
+
+/**
+ * \brief Function to generate a stream
+ * \param in kind one of the MIDI_STREAMs above
+ * \param in seed anything - the same seed gives the same bytes
+ * \param out out the stream
+ * \param in length the number of bytes to generate
+ */
+void midi_stream_generate(uint8_t kind, uint32_t seed, uint8_t* out, uint32_t length);
+
+#endif
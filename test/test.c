@@ -2,199 +2,8 @@
 #include <stdio.h>
 #include <string.h>
 
-#include "datatypes.h"
-#include "midi_datatypes.h"
-#include "midibuffer.h"
-#include "midinote_stack.h"
-#include "playmode.h"
-#include "polyphonic.h"
-#include "unison.h"
-#include "lfo.h"
-#include "clock_trigger.h"
-
-#define DAC_WRITE_UPDATE_N			(3)
-
-#define GATE_PORT	gate_port
-#define GATE_DDR	DDRC
-#define GATE1		PC0
-#define GATE2		PC1
-#define GATE3		PC2
-#define GATE4		PC3
-#define GATE_OFFSET	(0)
-
-#define BUTTON_LED_PORT	button_led_port
-#define BUTTON_LED_DDR	DDRC
-#define BUTTON			(0)
-#define LED				(1)
-#define BUTTON_PIN		button_pin
-
-#define LFO_RATE_POTI0	(4)
-
-#define CLOCK_RATE_POTI0	(2)
-
-#define NUM_PLAY_MODES	(2)
-#define POLYPHONIC_MODE	(0)
-#define UNISON_MODE		(1)
-
-// User Input defines
-#define ANALOG_READ_COUNTER (2)
-#define SHIFTIN_TRIGGER		(6)
-#define NUM_SHIFTIN_REG		(2)
-
-/*
- 00000000
- \\\\\\\\_MIDI_CHANNEL_BIT0 \
-  \\\\\\\_MIDI_CHANNEL_BIT1  \_MIDI_CHANNEL
-   \\\\\\_MIDI_CHANNEL_BIT2  /
-    \\\\\_MIDI_CHANNEL_BIT3 /
-     \\\\_reserved
-      \\\_MODE_BIT0 - polyphonic unison mode
-       \\_MODE_BIT1 - yet only reserved
-        \_LFO_CLOCK_ENABLE_BIT - lfo enable/velocity disable
-*/
-
-// bits in the bytes to represent certain modes
-#define MODE_BIT0				(0x20)
-#define MODE_BIT1				(0x40)
-#define LFO_CLOCK_ENABLE_BIT	(0x80)
-
-#define MIDI_CHANNEL_MASK		(0x0f)
-
-/*
- 00000000
- \\\\\\\\_LFO0_WAVE_BIT0 \_LFO0_WAVE_SETTINGS
-  \\\\\\\_LFO0_WAVE_BIT1 /
-   \\\\\\_LFO0_CLOCKSYNC - clocksync enable/disable for LFO0
-    \\\\\_LFO0_RETRIGGER_ON_NEW_NOTE - enable/disable retrigger of LFO0 on new note
-     \\\\_LFO1_WAVE_BIT0 \_LFO1_WAVE_SETTINGS
-      \\\_LFO1_WAVE_BIT1 /
-       \\_LFO1_CLOCKSYNC - clocksync enable/disable for LFO1
-        \_LFO1_RETRIGGER_ON_NEW_NOTE - enable/disable retrigger of LFO1 on new note
-*/
-
-#define LFO0_WAVE_BIT0		(0x01)
-#define LFO0_WAVE_BIT1		(0x02)
-#define LFO0_CLOCKSYNC		(0x04)
-#define LFO0_RETRIGGER_ON_NEW_NOTE	(0x08)
-#define LFO1_WAVE_BIT0		(0x10)
-#define LFO1_WAVE_BIT1		(0x20)
-#define LFO1_CLOCKSYNC		(0x40)
-#define LFO1_RETRIGGER_ON_NEW_NOTE	(0x80)
-
-#define LFO_MASK	(0x03)
-#define LFO0_OFFSET	(0)
-#define LFO1_OFFSET	(3)
-
-const uint8_t lfo_offset[2] = {
-	0,
-	4
-};
-
-#define SINGLE_BAR_COMPLETED	(96)
-#define EIGHT_BARS_COMPLETED	(768)
-
-/**
- * The whole trick about playing 4 notes at a time is the usage of a
- * peek_n-method on the note-stack: if a new (5th) note "overwrites" the oldest
- * playing note it is not specifically "overwritten" - it just doesn't
- * peek anymore from the stack - but now the new note does. As it is not peeked
- * anymore it gets erased from the playing notes array and the new note gets
- * inserted on that empty spot instead.
- * If any playing note stops playing (before a new one comes in), the newest
- * non-playing note will come back into the peek_n-return and continues
- * playing (but maybe on another channel...)
- */
-
-// those voltages created for the values by the DAC
-// will be ~doubled by a OpAmp
-// (not exactly doubled because it's 127 at 5V but the
-// 10th octave completes at 120 already - so we must
-// land at something like
-//		(10V/120semitones)*127semitones = 10.5833V
-// if we output 5V from the dac for the 127th semitone
-// - that makes a factor of amplification of 2.1166666)
-uint32_t voltage[11] = {
-	6192, // calculated: ((2^16)/127)*1*12
-	12385,// calculated: ((2^16)/127)*2*12
-	18577,// calculated: ((2^16)/127)*3*12
-	24769,// ... u get it :-)
-		  // one semitone is ((2^16)/127) round about 516
-	30962,
-	37154,
-	43347,
-	49539,
-	55731,
-	61924,
-	68116
-};
-
-uint16_t pitchbend = 0x2000; // middle_position
-
-// 24 CLOCK_SIGNALs per Beat (Quarter note)
-// 768 - 8 bars; 96 - 1 bar or 1 full note; 48 - half note; ... 3 - 32th note
-uint16_t clock_limit[12] = {
-	1536,
-	768,
-	384,
-	192,
-	96,
-	48,
-	24,
-	18,
-	12,
-	9,
-	6,
-	3
-};
-
-midibuffer_t midi_buffer;
-midinote_stack_t note_stack;
-playingnote_t playing_notes[NUM_PLAY_NOTES];
-playmode_t mode[NUM_PLAY_MODES];
-uint8_t playmode = POLYPHONIC_MODE;
-volatile bool must_update_dac = false;
-uint8_t shift_in_trigger_counter = SHIFTIN_TRIGGER;
-volatile bool get_shiftin = false;
-uint8_t analog_in_counter = ANALOG_READ_COUNTER;
-volatile bool get_analogin = false;
-
-volatile bool update_clock = false;
-
-uint32_t midiclock_counter = 0;
-// avoid division by zero in clock synced lfo mode
-uint32_t current_midiclock_tick = 2;
-uint32_t last_midiclock_tick = 1;
-
-uint32_t last_single_bar_completed_tick = 0;
-uint32_t last_eight_bars_completed_tick = 0;
-
-uint8_t old_midi_channel = 7;
-uint8_t midi_channel = 7;
-
-uint32_t ticks = 0;
-uint32_t last_led_toggle_tick = 0;
-
-#define NUM_LFO		(2)
-lfo_t lfo[NUM_LFO];
-volatile bool must_update_lfo = false;
-
-#define LFO_AND_CLOCK_OUT_ENABLE			(0x04)
-
-uint8_t program_options = 0x00;
-
-#define NUM_CLOCK_OUTPUTS	(2)
-#define CLOCK_TRIGGER_COUNTDOWN_INIT	(3)
-clock_trigger_t clock_output[NUM_CLOCK_OUTPUTS];
-volatile bool must_update_clock_output = false;
-
-// additional variables to emulate hardware I/O
-uint8_t button_led_port = 0x00;
-uint8_t gate_port = 0x00;
-uint8_t trigger_port = 0x00;
-uint8_t button_pin = (1<<BUTTON);
-uint8_t input_buffer[NUM_SHIFTIN_REG];
-uint16_t analog_input_value[4] = {0x00};
-// ----------------------------------------------
+// the real firmware - built against the mocked hardware in hal_host.c
+#include "../src/main.c"
 
 // some additional variables needed for our tests
 typedef struct {
@@ -207,300 +16,22 @@ testnote_t d;
 testnote_t e;
 // ----------------------------------------------
 
-bool midi_handler_function(midimessage_t* m);
-void get_voltage(uint8_t val, uint32_t* voltage_out);
-void update_dac(void);
-void update_lfo(void);
-void update_clock_output(void);
-void process_user_input(void);
-void process_analog_in(void);
-void update_clock_trigger(void);
-void init_variables(void);
-void init_lfo(void);
-void init_io(void);
-
 // some additional functions needed for our tests
-void dac8568c_write(uint8_t command, uint8_t address, uint32_t data);
-void cli() {}
-void sei() {}
-void sr74hc165_read(uint8_t* buffer, uint8_t numsr);
 void init_input_buffer(void);
 void init_notes(void);
 void prepare_four_notes_on_stack(void);
 void insert_midibuffer_test(testnote_t n);
-void timer1_overflow_function(void);
+void record_task_a(void);
+void record_task_b(void);
+void record_task_c(void);
+void busy_task(void);
+void record_uart(uint8_t byte);
+void receive_clock(timebase_t time);
+uint8_t store_get(const void* data, uint16_t position);
+void store_put(void* data, uint16_t position, uint8_t byte);
+uint32_t store_sequence(uint8_t slot);
 // ----------------------------------------------
 
-bool midi_handler_function(midimessage_t* m) {
-	midinote_t mnote;
-	uint8_t i=0;
-	if(m->byte[0] == NOTE_ON(midi_channel)) {
-		mnote.note = m->byte[1];
-		mnote.velocity = m->byte[2];
-		if(mnote.velocity != 0x00) {
-			midinote_stack_push(&note_stack, mnote);
-			for(i=0;i<NUM_LFO;i++) {
-				if(lfo[i].retrigger_on_new_note)
-					lfo[i].position = 0;
-			}
-		} else {
-			midinote_stack_remove(&note_stack, m->byte[1]);
-		}
-		return true;
-	} else if (m->byte[0] == NOTE_OFF(midi_channel)) {
-		midinote_stack_remove(&note_stack, m->byte[1]);
-		return true;
-	} else if (m->byte[0] == PITCH_BEND(midi_channel)) {
-		// TODO: implement some logic to really bend the pitch of the stack notes
-		pitchbend = (m->byte[2]<<7) | m->byte[1];
-		return true;
-	} else if (m->byte[0] == CONTROL_CHANGE(midi_channel)) {
-		if((m->byte[1]== 120 || m->byte[1] == 123) && m->byte[2] == 0) { // all sound off
-			midinote_stack_init(&note_stack);
-			return true;
-		} else if (m->byte[1] == MOD_WHEEL) {
-			//TODO: do something special here(?)
-			return true;
-		}
-		return false;
-	}
-	switch(m->byte[0]) {
-		case CLOCK_SIGNAL:
-			midiclock_counter++;
-			cli();
-			last_midiclock_tick = current_midiclock_tick;
-			current_midiclock_tick = ticks;
-			sei();
-			update_clock = true;
-			break;
-		case CLOCK_START:
-		case CLOCK_STOP:
-			midiclock_counter = 0;
-			cli();
-			// avoid division by zero in clock synced lfo mode
-			last_midiclock_tick = 1;
-			current_midiclock_tick = 2;
-			sei();
-			break;
-		case CLOCK_CONTINUE:
-			break;
-		default:
-			return false;
-	}
-	return false;
-}
-
-void get_voltage(uint8_t val, uint32_t* voltage_out) {
-	uint8_t i = (val/12); // which octave are we in?
-	float step = (val-(i*12))/12.0; // relative position in octave
-	if(i>0) {
-		*voltage_out = (voltage[i]-voltage[i-1])*step+voltage[i-1];
-	} else {
-		*voltage_out = (voltage[i])*step;
-	}
-	if(*voltage_out > 65536)
-		*voltage_out = 65536;
-}
-
-void update_dac(void) {
-	uint8_t i = 0;
-	for(; i<NUM_PLAY_NOTES; i++) {
-		note_t note = playing_notes[i].midinote.note;
-		vel_t velocity = playing_notes[i].midinote.velocity;
-		uint32_t voltage;
-		get_voltage(note, &voltage);
-		if(voltage != 0x00) { // do not reset the oscillators pitch
-			dac8568c_write(DAC_WRITE_UPDATE_N, i, voltage);
-		}
-		if(!ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
-			// Send velocity
-			get_voltage(velocity, &voltage);
-			dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES, voltage);
-		}
-
-		// not putting this if-clause at start because we would have to reset all
-		// other pins/dac-outputs anyway... but as of memset to EMPTY_NOTE in update_notes
-		// they are already EMPTY_NOTE here if this note is not playing and will get reset
-		// implicitly here
-		if(playing_notes[i].midinote.note != EMPTY_NOTE) {
-			GATE_PORT |= (1<<(i+(GATE_OFFSET)));
-		} else {
-			GATE_PORT &= ~(1<<(i+(GATE_OFFSET)));
-		}
-	}
-}
-
-void update_lfo(void) {
-	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
-		uint8_t i=0;
-		for(;i<NUM_LFO;i++) {
-			uint32_t voltage = lfo[i].get_value(lfo+i);
-			dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES, voltage);
-		}
-	}
-}
-
-void update_clock_output(void) {
-	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
-		uint8_t i=0;
-		for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
-			uint32_t voltage = 0x0000;
-			if(clock_output[i].active_countdown != 0) {
-				voltage = 0xffff; //TODO: maybe adjustable clock trigger level instead?
-			}
-			dac8568c_write(DAC_WRITE_UPDATE_N, i+NUM_PLAY_NOTES+NUM_LFO, voltage);
-		}
-	}
-}
-
-void process_user_input(void) {
-	uint8_t input[NUM_SHIFTIN_REG];
-	sr74hc165_read(input, NUM_SHIFTIN_REG);
-	// no need to debounce butten
-	if(!(BUTTON_PIN & (1<<BUTTON)) ) {
-		// CONTROL MODE
-		if(ticks-last_led_toggle_tick > 100) {
-			BUTTON_LED_PORT ^= (1<<LED);
-			last_led_toggle_tick = ticks;
-		}
-//		// otherwise turn it off
-//		BUTTON_LED_PORT &= ~(1<<LED);
-	} else {
-		// PLAY MODE
-		// if button not pressed - light up LED permanently
-		BUTTON_LED_PORT |= (1<<LED);
-
-		uint8_t old_playmode = playmode;
-		if(ISSET(input[0], MODE_BIT0)) {
-			playmode = POLYPHONIC_MODE;
-		} else {
-			playmode = UNISON_MODE;
-		}
-		if(playmode != old_playmode) {
-			mode[playmode].init();
-		}
-		if(ISSET(input[0], LFO_CLOCK_ENABLE_BIT)) {
-			SET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
-		} else {
-			UNSET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
-			must_update_dac = true;
-			// TODO: unset the voltages
-		}
-		midi_channel = (input[0] & MIDI_CHANNEL_MASK);
-		if(midi_channel != old_midi_channel) {
-			cli();
-			init_variables();
-			must_update_dac = true;
-			sei();
-			old_midi_channel = midi_channel;
-		}
-		lfo[0].clock_sync = ISSET(input[1], LFO0_CLOCKSYNC);
-		lfo[1].clock_sync = ISSET(input[1], LFO1_CLOCKSYNC);
-		lfo[0].retrigger_on_new_note = ISSET(input[1], LFO0_RETRIGGER_ON_NEW_NOTE);
-		lfo[1].retrigger_on_new_note = ISSET(input[1], LFO1_RETRIGGER_ON_NEW_NOTE);
-		uint8_t wave_settings;
-		uint8_t i= 0;
-		for(;i<NUM_LFO;i++) {
-			wave_settings = (input[1]>>lfo_offset[i])& LFO_MASK;
-			switch(wave_settings) {
-				case 0:
-					lfo[i].get_value = lfo_get_rev_sawtooth;
-					break;
-				case 1:
-					lfo[i].get_value = lfo_get_triangle;
-					break;
-				case 2:
-					lfo[i].get_value = lfo_get_pulse;
-					break;
-				case 3:
-					lfo[i].get_value = lfo_get_sawtooth;
-					break;
-				default:
-					break;
-			}
-		}
-	}
-}
-
-uint16_t analog_read(uint8_t channel) {
-	assert(channel<sizeof(analog_input_value));
-	return analog_input_value[channel];
-}
-
-void process_analog_in(void) {
-	int helper_i = 0;
-	for(; helper_i<sizeof(analog_input_value); helper_i++) {
-		assert(analog_input_value[helper_i]<1024);
-	}
-	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
-		uint8_t i=0;
-		for(;i<NUM_LFO; i++) {
-			uint16_t analog_value = analog_read(LFO_RATE_POTI0+i);
-			if(lfo[i].clock_sync) {
-				// analog_value/64 gives us 16 possible clock_modes
-				lfo[i].clock_mode = (analog_value/64 > sizeof(clock_limit)-1) ? sizeof(clock_limit)-1 : analog_value/64;
-			} else {
-				lfo[i].stepwidth = ((analog_value+1)*4);
-			}
-		}
-		for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
-			uint16_t analog_value = analog_read(CLOCK_RATE_POTI0+i);
-			clock_output[i].mode = analog_value/64; // make it 16 possible modes
-		}
-	}
-}
-
-// INFO: assure that this function is called on each increment of midiclock_counter
-//       otherwise we may lose trigger-points
-void update_clock_trigger(void) {
-	uint8_t i;
-	if(ISSET(program_options, LFO_AND_CLOCK_OUT_ENABLE)) {
-		for(i=0;i<NUM_LFO;i++) {
-			if((midiclock_counter % clock_limit[lfo[i].clock_mode]) == 0) {
-				lfo[i].last_cycle_completed_tick = ticks;
-				lfo[i].position = 0; // reset lfo position to always stay in sync with the clock
-			}
-		}
-		if(midiclock_counter % SINGLE_BAR_COMPLETED == 0) {
-			last_single_bar_completed_tick = ticks;
-		}
-		if(midiclock_counter % EIGHT_BARS_COMPLETED == 0) {
-			last_eight_bars_completed_tick = ticks;
-		}
-		for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
-			if((midiclock_counter % clock_limit[clock_output[i].mode]) == 0) {
-				clock_output[i].active_countdown = CLOCK_TRIGGER_COUNTDOWN_INIT;
-			}
-		}
-	}
-}
-
-void init_variables(void) {
-	midinote_stack_init(&note_stack);
-	midibuffer_init(&midi_buffer, &midi_handler_function);
-	// initializing to EMPTY_NOTE to be able to play note 0 as well
-	memset(playing_notes, EMPTY_NOTE, sizeof(playingnote_t)*NUM_PLAY_NOTES);
-	memset(mode, 0, sizeof(playmode_t)*NUM_PLAY_MODES);
-	mode[POLYPHONIC_MODE].update_notes = update_notes_polyphonic;
-	mode[POLYPHONIC_MODE].init = init_polyphonic;
-	mode[UNISON_MODE].update_notes = update_notes_unison;
-	mode[UNISON_MODE].init = init_unison;
-}
-
-void init_lfo(void) {
-	uint8_t i=0;
-	for(;i<NUM_LFO; i++) {
-		lfo[i].clock_sync = false;
-		lfo[i].stepwidth = 1;
-		lfo[i].get_value = lfo_get_triangle;
-		lfo[i].position = 0;
-	}
-}
-
-void init_io(void) {
-	// don't have no hardware - nothing to do here...
-}
-
 void init_notes(void) {
 	a.byte[0] = NOTE_ON(midi_channel);
 	a.byte[1] = 0x6f;
@@ -547,60 +78,87 @@ void insert_midibuffer_test(testnote_t n) {
 		}
 	}
 }
-void sr74hc165_read(uint8_t* buffer, uint8_t numsr) {
-	uint8_t i=0;
-	for(;i<numsr;i++) {
-		*(buffer+i) = *(input_buffer+i);
-	}
+void init_input_buffer(void) {
+	memset(hal_host_panel, 0, NUM_SHIFTIN_REG);
+	hal_host_panel[1] = midi_channel;
 }
 
-void init_input_buffer(void) {
-	memset(input_buffer, 0, NUM_SHIFTIN_REG);
-	input_buffer[1] = midi_channel;
+// the scheduler tests note down which task ran when
+char task_log[16];
+uint8_t task_log_length = 0;
+timebase_t task_run_time[3];
+timebase_t busy_task_duration = 0;
+
+void record_task_a(void) {
+	task_log[task_log_length++] = 'a';
+	task_run_time[0] = hal_host_time;
 }
 
-void dac8568c_write(uint8_t command, uint8_t address, uint32_t data) {
-	// don't have no hardware here - hard to test
+void record_task_b(void) {
+	task_log[task_log_length++] = 'b';
+	task_run_time[1] = hal_host_time;
 }
 
-void timer1_overflow_function(void) {
-	if(shift_in_trigger_counter-- == 0) {
-		shift_in_trigger_counter = SHIFTIN_TRIGGER;
-		get_shiftin = true;
-	}
-	if(analog_in_counter-- == 0) {
-		analog_in_counter = ANALOG_READ_COUNTER;
-		get_analogin = true;
+void record_task_c(void) {
+	task_log[task_log_length++] = 'c';
+	task_run_time[2] = hal_host_time;
+}
+
+// takes its time and gets a MIDI byte coming in half way through
+void busy_task(void) {
+	task_log[task_log_length++] = 'x';
+	hal_host_time += busy_task_duration/2;
+	scheduler_post(0);
+	hal_host_time += busy_task_duration/2;
+}
+
+uint8_t uart_sent[16];
+uint8_t uart_sent_length = 0;
+
+void record_uart(uint8_t byte) {
+	if(uart_sent_length < sizeof(uart_sent)) {
+		uart_sent[uart_sent_length++] = byte;
 	}
 }
 
-void timer2_overflow_function(void) {
-	ticks++;
+// records of this size make 5 slots - one more than the firmware uses
+#define STORE_TEST_SIZE		(94)
+#define STORE_TEST_RECORD	EEPROM_STORE_RECORD_SIZE(STORE_TEST_SIZE)
+
+uint8_t store_get(const void* data, uint16_t position) {
+	return ((const uint8_t*)data)[position];
+}
+
+void store_put(void* data, uint16_t position, uint8_t byte) {
+	((uint8_t*)data)[position] = byte;
+}
+
+// the sequence of the record in a slot
+uint32_t store_sequence(uint8_t slot) {
+	uint32_t sequence = 0;
 	uint8_t i=0;
-	for(;i<NUM_LFO;i++) {
-		if(lfo[i].clock_sync) {
-			// recalculate stepwidth everytime to even out division errors
-			lfo[i].stepwidth = LFO_TABLE_LENGTH / ((current_midiclock_tick - last_midiclock_tick)*clock_limit[lfo[i].clock_mode]);
-			lfo[i].position += lfo[i].stepwidth;
-		} else {
-			lfo[i].position += lfo[i].stepwidth;
-		}
-		lfo[i].position %= LFO_TABLE_LENGTH;
+	for(;i<4;i++) {
+		sequence |= (uint32_t)hal_host_eeprom[slot*STORE_TEST_RECORD+1+i]<<(8*i);
 	}
-	must_update_lfo = true;
+	return sequence;
+}
 
-	for(i=0;i<NUM_CLOCK_OUTPUTS;i++) {
-		if(clock_output[i].active_countdown > 0) {
-			clock_output[i].active_countdown--;
-			must_update_clock_output = true;
-		}
-	}
+// a MIDI clock coming in at time and handled right away
+void receive_clock(timebase_t time) {
+	hal_host_time = time;
+	hal_host_uart_rx = CLOCK_SIGNAL;
+	USART_RXC_vect();
+	midi_task();
 }
 
 int main(int argc, char** argv) {
 	uint8_t i=0;
 	init_notes();
 	init_input_buffer();
+	// button released and no settings saved yet
+	PINC = (1<<BUTTON);
+	hal_host_eeprom_clear();
+	init_firmware();
 	printf("testing init_variables() ");
 	{
 		init_variables();
@@ -680,6 +238,8 @@ int main(int argc, char** argv) {
 	printf(" success\n");
 	printf("testing peek does not pop");
 	{
+		// start over so the note lands on the first voice again
+		mode[playmode].init();
 		memset(playing_notes, EMPTY_NOTE, sizeof(playingnote_t)*NUM_PLAY_NOTES);
 		assert(playing_notes[0].midinote.note == EMPTY_NOTE && playing_notes[0].midinote.velocity == EMPTY_NOTE);
 		mode[playmode].update_notes(&note_stack, playing_notes);
@@ -1152,6 +712,42 @@ int main(int argc, char** argv) {
 		assert(midibuffer_tick(&midi_buffer) == true);
 	}
 	printf(" success\n");
+	printf("testing reserved bytes in running status");
+	{
+		midimessage_t m = {{0}};
+		assert(midibuffer_put(&midi_buffer, NOTE_ON(midi_channel)) == true);
+		assert(midibuffer_put(&midi_buffer, a.byte[1]) == true);
+		assert(midibuffer_put(&midi_buffer, 0xf4) == true);
+		assert(midibuffer_put(&midi_buffer, a.byte[2]) == true);
+		assert(midibuffer_put(&midi_buffer, 0xf9) == true);
+		assert(midibuffer_put(&midi_buffer, b.byte[1]) == true);
+		assert(midibuffer_put(&midi_buffer, 0xf5) == true);
+		assert(midibuffer_put(&midi_buffer, 0xfd) == true);
+		assert(midibuffer_put(&midi_buffer, b.byte[2]) == true);
+		assert(midibuffer_get(&midi_buffer, &m) == true);
+		assert(m.byte[0] == NOTE_ON(midi_channel) && m.byte[1] == a.byte[1] && m.byte[2] == a.byte[2]);
+		assert(midibuffer_get(&midi_buffer, &m) == true);
+		assert(m.byte[0] == NOTE_ON(midi_channel) && m.byte[1] == b.byte[1] && m.byte[2] == b.byte[2]);
+		assert(midibuffer_get(&midi_buffer, &m) == false);
+	}
+	printf(" success\n");
+	printf("testing unterminated SysEx swallowing everything up to SYSEX_END");
+	{
+		midimessage_t m = {{0}};
+		assert(midibuffer_put(&midi_buffer, SYSEX_BEGIN) == true);
+		assert(midibuffer_put(&midi_buffer, 0x11) == true);
+		assert(midibuffer_put(&midi_buffer, CLOCK_SIGNAL) == true);
+		insert_midibuffer_test(b);
+		assert(midibuffer_get(&midi_buffer, &m) == false);
+		assert(midibuffer_put(&midi_buffer, SYSEX_END) == true);
+		assert(midibuffer_put(&midi_buffer, CLOCK_SIGNAL) == true);
+		insert_midibuffer_test(a);
+		assert(midibuffer_get(&midi_buffer, &m) == true);
+		assert(m.byte[0] == CLOCK_SIGNAL);
+		assert(midibuffer_get(&midi_buffer, &m) == true);
+		assert(m.byte[0] == a.byte[0] && m.byte[1] == a.byte[1] && m.byte[2] == a.byte[2]);
+	}
+	printf(" success\n");
 	printf("testing gate-setting process");
 	{
 		init_notes();
@@ -1172,16 +768,47 @@ int main(int argc, char** argv) {
 				HARDWARE_GATEPORT &= ~(1<<(i+(GATE_OFFSET)));
 			}
 		}
-		assert(HARDWARE_GATEPORT == 15);
+		assert(HARDWARE_GATEPORT == (0x0f<<GATE_OFFSET));
 	}
 	printf(" success\n");
 	printf("testing user-input");
 	{
 		init_input_buffer();
-		input_buffer[0] = (input_buffer[0] & 0xf0) | midi_channel;
-		SET(input_buffer[0], MODE_BIT0);
+		hal_host_panel[0] = (hal_host_panel[0] & 0xf0) | midi_channel;
+		SET(hal_host_panel[0], MODE_BIT0);
 		process_user_input();
 		assert(playmode == POLYPHONIC_MODE);
+		// nothing moved - nothing to do
+		task[TASK_DAC].pending = false;
+		lfo.shape[0] = SAMPLE_HOLD;
+		process_user_input();
+		assert(task[TASK_DAC].pending == false);
+		assert(lfo.shape[0] == SAMPLE_HOLD);
+		// only the moved wave switch gets applied
+		hal_host_panel[1] ^= (LFO_MASK<<lfo_offset[1]);
+		process_user_input();
+		assert(lfo.shape[0] == SAMPLE_HOLD);
+		assert(lfo.shape[1] == ((hal_host_panel[1]>>lfo_offset[1]) & LFO_MASK));
+		hal_host_panel[1] ^= (LFO_MASK<<lfo_offset[1]);
+		process_user_input();
+		lfo_set_shape(&lfo, 0, REV_SAWTOOTH);
+		// turning the LFO and clock outputs off refreshes the DAC once,
+		// switching them either way refreshes the clock outputs
+		task[TASK_CLOCK_OUTPUT].pending = false;
+		SET(hal_host_panel[0], LFO_CLOCK_ENABLE_BIT);
+		process_user_input();
+		assert(task[TASK_DAC].pending == false);
+		assert(task[TASK_CLOCK_OUTPUT].pending == true);
+		task[TASK_CLOCK_OUTPUT].pending = false;
+		UNSET(hal_host_panel[0], LFO_CLOCK_ENABLE_BIT);
+		process_user_input();
+		assert(task[TASK_DAC].pending == true);
+		assert(task[TASK_CLOCK_OUTPUT].pending == true);
+		task[TASK_DAC].pending = false;
+		task[TASK_CLOCK_OUTPUT].pending = false;
+		process_user_input();
+		assert(task[TASK_DAC].pending == false);
+		assert(task[TASK_CLOCK_OUTPUT].pending == false);
 	}
 	printf(" success\n");
 	printf("testing get_voltage ");
@@ -1193,19 +820,61 @@ int main(int argc, char** argv) {
 			uint8_t j=0;
 			for(;j<12; j++) {
 				out = 1;
-				get_voltage(val, &out);
+				get_voltage(0, val, &out);
 				val++;
-				assert(out<voltage[i]);
+				assert(out<calibration_voltage(&settings->calibration, 0, i));
 			}
 		}
-		get_voltage(127,&out);
+		get_voltage(0, 127, &out);
 		assert(out<=65536);
 		// test impossibly high value - though it will never occur in 7-Bit MIDI-Data...
 		// but who knows...
-		get_voltage(255, &out);
+		get_voltage(0, 255, &out);
 		assert(out<=65536);
 	}
 	printf(" success\n");
+	printf("testing calibration round trip ");
+	{
+		calibration_t c;
+		calibration_t d;
+		uint8_t packed[CALIBRATION_PACKED_SIZE];
+		uint16_t k=0;
+		uint8_t voice=0;
+		calibration_init(&c);
+		for(; voice<NUM_PLAY_NOTES; voice++) {
+			uint8_t point=0;
+			for(; point<NUM_CALIBRATION_POINTS; point++) {
+				assert(calibration_voltage(&c, voice, point) == calibration_default[point]);
+				calibration_adjust(&c, voice, point, (voice*NUM_CALIBRATION_POINTS+point)*1499-30000);
+			}
+		}
+		// the differences stick at their limits
+		calibration_adjust(&c, 0, 0, INT16_MAX);
+		calibration_adjust(&c, 0, 0, INT16_MAX);
+		assert(c.delta[0][0] == INT16_MAX);
+		calibration_adjust(&c, 0, 1, INT16_MIN);
+		calibration_adjust(&c, 0, 1, INT16_MIN);
+		assert(c.delta[0][1] == INT16_MIN);
+		calibration_adjust(&c, 1, 0, -1);
+		for(k=0; k<CALIBRATION_PACKED_SIZE; k++) {
+			packed[k] = calibration_get_byte(&c, k);
+		}
+		// little endian whatever the host is
+		assert(packed[0] == 0xff && packed[1] == 0x7f);
+		assert(packed[2] == 0x00 && packed[3] == 0x80);
+		memset(&d, 0xa5, sizeof(calibration_t));
+		for(k=0; k<CALIBRATION_PACKED_SIZE; k++) {
+			calibration_put_byte(&d, k, packed[k]);
+		}
+		for(voice=0; voice<NUM_PLAY_NOTES; voice++) {
+			uint8_t point=0;
+			for(; point<NUM_CALIBRATION_POINTS; point++) {
+				assert(calibration_voltage(&d, voice, point) == calibration_voltage(&c, voice, point));
+			}
+		}
+		assert(memcmp(&c, &d, sizeof(calibration_t)) == 0);
+	}
+	printf(" success\n");
 	printf("testing some hardcoded note ");
 	{
 		init_variables();
@@ -1217,17 +886,17 @@ int main(int argc, char** argv) {
 		z.byte[2] = 0x72;
 		insert_midibuffer_test(z);
 		assert(midibuffer_tick(&midi_buffer) == true);
-		must_update_dac = true; // because midibuffer_tick returned true
+		scheduler_post(TASK_DAC); // just like midi_task does
 		midinote_t* it;
 		uint8_t num_notes = 0;
 		assert(midinote_stack_peek_n(&note_stack, 1, &it, &num_notes) == true);
 		assert(playing_notes[0].midinote.note == EMPTY_NOTE);
 		mode[playmode].update_notes(&note_stack, playing_notes);
-		assert(must_update_dac == true);
+		assert(task[TASK_DAC].pending == true);
 		assert(playing_notes[0].midinote.note == 0x3c);
-		assert(gate_port == 0x00);
+		assert((GATE_PORT & (0x0f<<GATE_OFFSET)) == 0x00);
 		update_dac();
-		assert(gate_port == 0x01);
+		assert((GATE_PORT & (0x0f<<GATE_OFFSET)) == (0x01<<GATE_OFFSET));
 	}
 	printf(" success\n");
 	printf("testing velocity 0 instead of NOTE_OFF");
@@ -1287,8 +956,8 @@ int main(int argc, char** argv) {
 		mode[playmode].update_notes(&note_stack, playing_notes);
 		assert(playing_notes[0].midinote.note == a.byte[1]);
 		// set MIDI_CHANEL to 5, preserving the rest of the byte
-		input_buffer[0] = (input_buffer[0] & 0xf0) | 0x05;
-		SET(input_buffer[0], MODE_BIT0);
+		hal_host_panel[0] = (hal_host_panel[0] & 0xf0) | 0x05;
+		SET(hal_host_panel[0], MODE_BIT0);
 		process_user_input();
 		assert(playmode == POLYPHONIC_MODE);
 		assert(midi_channel == 5);
@@ -1303,9 +972,1236 @@ int main(int argc, char** argv) {
 		mode[playmode].update_notes(&note_stack, playing_notes);
 		assert(playing_notes[0].midinote.note == a.byte[1]);
 		// reset to channel 7 - not to confuse the following tests
-		input_buffer[0] = (input_buffer[0] & 0xf0) | 0x07;
+		hal_host_panel[0] = (hal_host_panel[0] & 0xf0) | 0x07;
 		process_user_input();
 	}
 	printf(" success\n");
+	printf("testing clock trigger divisions {\n");
+	{
+		clock_trigger_t t;
+		uint32_t subclock = 0;
+		uint8_t num_triggers = 0;
+		printf("\tdivisions getting shorter ");
+		for(i=1; i<NUM_CLOCK_TRIGGER_MODES; i++) {
+			assert(clock_trigger_division[i] < clock_trigger_division[i-1]);
+		}
+		printf("success\n");
+		printf("\t96 ppq fires on each sub-clock ");
+		t.mode = NUM_CLOCK_TRIGGER_MODES-1;
+		for(subclock=0; subclock<CLOCK_MULTIPLIER*24; subclock++) {
+			assert(clock_trigger_fires(&t, subclock) == true);
+		}
+		printf("success\n");
+		printf("\tdotted 32th note fires in between MIDI clocks ");
+		t.mode = 10;
+		assert(clock_trigger_division[t.mode] == 18);
+		for(subclock=0; subclock<CLOCK_MULTIPLIER*24; subclock++) {
+			if(clock_trigger_fires(&t, subclock)) {
+				num_triggers++;
+			}
+		}
+		// on sub-clocks 0, 18, 36, 54, 72 and 90 of a quarter note
+		assert(num_triggers == 6);
+		assert(clock_trigger_fires(&t, 18) == true);
+		assert(18 % CLOCK_MULTIPLIER != 0);
+		printf("success\n");
+		printf("\tpulse width limited to half the trigger interval ");
+		t.mode = NUM_CLOCK_TRIGGER_MODES-1;
+		assert(clock_trigger_pulse_width(&t, 0, 10000) == 10000);
+		assert(clock_trigger_pulse_width(&t, 1000, 10000) == 500);
+		t.mode = 3;
+		assert(clock_trigger_pulse_width(&t, 1000, 10000) == 10000);
+		printf("success\n");
+		printf("\toverdue sub-clocks get the next compare match possible ");
+		for(i=0; i<NUM_CLOCK_OUTPUTS; i++) {
+			clock_output[i].active = false;
+		}
+		pending_subclocks = 1;
+		next_subclock_time = hal_host_time - 100;
+		schedule_timer1_compare(hal_host_time);
+		assert(OCR1A == (uint16_t)(hal_host_time + TIMER1_MIN_LEAD));
+		assert(TIMSK & (1<<OCIE1A));
+		next_subclock_time = hal_host_time + 2*TIMER1_MIN_LEAD;
+		schedule_timer1_compare(hal_host_time);
+		assert(OCR1A == (uint16_t)(hal_host_time + 2*TIMER1_MIN_LEAD));
+		pending_subclocks = 0;
+		schedule_timer1_compare(hal_host_time);
+		assert(!(TIMSK & (1<<OCIE1A)));
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing lfo catch-up {\n");
+	{
+		lfo_bank_t single;
+		lfo_bank_t catch_up;
+		midimessage_t m;
+		uint8_t j=0;
+		printf("\tfree running lfo ");
+		lfo_bank_init(&single);
+		single.stepwidth[0] = 1023*4;
+		single.position[0] = 60000;
+		catch_up = single;
+		for(i=0; i<37; i++) {
+			lfo_bank_advance(&single, 1, 0);
+		}
+		lfo_bank_advance(&catch_up, 37, 0);
+		assert(single.position[0] == catch_up.position[0]);
+		assert(single.position[0] < LFO_TABLE_LENGTH);
+		printf("success\n");
+		printf("\tclock synced lfo ");
+		lfo_set_clock_sync(&single, 0, true);
+		lfo_set_clock_mode(&single, 0, 11);
+		catch_up = single;
+		for(j=0; j<200; j++) {
+			lfo_bank_advance(&single, 1, 5*LFO_TICK);
+		}
+		lfo_bank_advance(&catch_up, 200, 5*LFO_TICK);
+		assert(single.stepwidth[0] == LFO_TABLE_LENGTH/(5*3));
+		assert(single.position[0] == catch_up.position[0]);
+		// the free running ones are left alone
+		assert(single.stepwidth[1] == 1);
+		printf("success\n");
+		printf("\tsynced stepwidth follows the clock mode ");
+		lfo_set_clock_mode(&single, 0, 10);
+		lfo_bank_advance(&single, 1, 5*LFO_TICK);
+		assert(single.stepwidth[0] == LFO_TABLE_LENGTH/(5*6));
+		printf("success\n");
+		printf("\tno division by zero without MIDI clock ");
+		lfo_bank_advance(&catch_up, 1, 0);
+		printf("success\n");
+		printf("\tno tempo after START or STOP keeps the synced stepwidth ");
+		// the time of the first clock minus last_midiclock_time reset to 0
+		lfo_bank_advance(&single, 1, 0xf0000000UL);
+		assert(single.stepwidth[0] == LFO_TABLE_LENGTH/(5*6));
+		lfo_set_clock_mode(&single, 0, 0);
+		lfo_bank_advance(&single, 1, MAX_MIDICLOCK_PERIOD);
+		assert(single.stepwidth[0] == LFO_TABLE_LENGTH/(5*6));
+		printf("success\n");
+		printf("\tsynced stepwidth saturates ");
+		lfo_bank_advance(&single, 1, MAX_MIDICLOCK_PERIOD-1);
+		assert(single.stepwidth[0] == 1);
+		lfo_set_clock_mode(&single, 0, 11);
+		lfo_bank_advance(&single, 1, 1);
+		assert(single.stepwidth[0] == 0xffff);
+		printf("success\n");
+		printf("\tlfos only move on whole LFO_TICKs ");
+		init_lfo();
+		lfo.stepwidth[0] = 100;
+		lfo.stepwidth[1] = 200;
+		last_lfo_update_time = hal_host_time;
+		hal_host_time += 10*LFO_TICK + LFO_TICK/2;
+		update_lfo();
+		assert(lfo.position[0] == 1000 && lfo.position[1] == 2000);
+		update_lfo();
+		assert(lfo.position[0] == 1000 && lfo.position[1] == 2000);
+		hal_host_time += LFO_TICK/2;
+		update_lfo();
+		assert(lfo.position[0] == 1100 && lfo.position[1] == 2200);
+		printf("success\n");
+		printf("\tcatch-up survives the timebase wrapping around ");
+		hal_host_time = 0xffffffff - LFO_TICK/2;
+		last_lfo_update_time = hal_host_time;
+		hal_host_time += 3*LFO_TICK;
+		update_lfo();
+		assert(lfo.position[0] == 1400 && lfo.position[1] == 2800);
+		printf("success\n");
+		printf("\tmidi clock period measured on the timebase ");
+		midiclock_counter = 0;
+		triggered_midiclock = 0;
+		hal_host_time = 0xffffffff - 1000;
+		m.byte[0] = CLOCK_SIGNAL;
+		midi_handler_function(&m);
+		hal_host_time += MS_TO_TIMEBASE(20);
+		midi_handler_function(&m);
+		assert(current_midiclock_time - last_midiclock_time == 40000);
+		printf("success\n");
+		printf("\tthe LFO task catches up every tick it came late for ");
+		init_lfo();
+		lfo.stepwidth[0] = 1;
+		last_lfo_update_time = hal_host_time;
+		timebase_t begin = hal_host_time;
+		uint32_t k=0;
+		// the main loop gets to the LFOs anywhere from early to 7 ticks late
+		for(k=0; k<1000; k++) {
+			hal_host_time += (k*37%8)*LFO_TICK + (k*13%LFO_TICK);
+			update_lfo();
+		}
+		assert(lfo.position[0] == (hal_host_time - begin)/LFO_TICK);
+		assert(last_lfo_update_time == begin + lfo.position[0]*LFO_TICK);
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing lfo bank {\n");
+	{
+		uint32_t position;
+		midimessage_t m;
+		printf("\tshapes grouped by the setter ");
+		lfo_bank_init(&lfo);
+		assert(lfo.shape_count[TRIANGLE] == NUM_LFO);
+		lfo_set_shape(&lfo, 1, PULSE);
+		lfo_set_shape(&lfo, 0, SAWTOOTH);
+		lfo_set_shape(&lfo, 0, SAWTOOTH);
+		lfo_set_shape(&lfo, 1, NUM_LFO_SHAPES);
+		assert(lfo.shape_count[TRIANGLE] == NUM_LFO-2);
+		assert(lfo.shape_count[PULSE] == 1 && lfo.shape_member[PULSE][0] == 1);
+		assert(lfo.shape_count[SAWTOOTH] == 1 && lfo.shape_member[SAWTOOTH][0] == 0);
+		printf("success\n");
+		printf("\tshapes render the same values as ever ");
+		for(position=0; position<LFO_TABLE_LENGTH; position+=7) {
+			for(i=0; i<NUM_LFO; i++) {
+				lfo_set_shape(&lfo, i, (i+position)%NUM_LFO_SHAPES);
+				lfo.position[i] = position;
+			}
+			lfo_bank_render(&lfo);
+			for(i=0; i<NUM_LFO; i++) {
+				uint16_t expected = 0;
+				switch(lfo.shape[i]) {
+					case REV_SAWTOOTH:
+						expected = 0xffff - position;
+						break;
+					case TRIANGLE:
+						expected = (position > LFO_HALF_TABLE_LENGTH) ? (LFO_TABLE_LENGTH - position)*2 : position*2;
+						break;
+					case PULSE:
+						expected = (position > LFO_HALF_TABLE_LENGTH) ? 0x0000 : 0xffff;
+						break;
+					case SAWTOOTH:
+						expected = position;
+						break;
+				}
+				assert(lfo.value[i] == expected);
+			}
+		}
+		printf("success\n");
+		printf("\taux outputs routed by CC ");
+		init_lfo();
+		SET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		m.byte[0] = CONTROL_CHANGE(midi_channel);
+		m.byte[1] = AUX_ROUTE_CC0;
+		m.byte[2] = AUX_SOURCE_LFO0+1;
+		midi_handler_function(&m);
+		m.byte[1] = AUX_ROUTE_CC0+2;
+		m.byte[2] = AUX_SOURCE_NONE;
+		midi_handler_function(&m);
+		lfo_set_shape(&lfo, 1, SAWTOOTH);
+		lfo.stepwidth[0] = 100;
+		lfo.stepwidth[1] = 300;
+		clock_output[1].active = true;
+		hal_host_dac[NUM_PLAY_NOTES+2] = 0x1234;
+		last_lfo_update_time = hal_host_time;
+		hal_host_time += LFO_TICK;
+		update_lfo();
+		update_clock_output();
+		assert(hal_host_dac[NUM_PLAY_NOTES] == 300);
+		assert(hal_host_dac[NUM_PLAY_NOTES+1] == 300);
+		assert(hal_host_dac[NUM_PLAY_NOTES+2] == 0);
+		assert(hal_host_dac[NUM_PLAY_NOTES+3] == 0xffff);
+		UNSET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		clock_output[1].active = false;
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing random lfo shapes {\n");
+	{
+		lfo_bank_t bank;
+		uint16_t held;
+		uint16_t last;
+		uint32_t k;
+		printf("\txorshift never gets stuck ");
+		lfo_bank_init(&bank);
+		bank.random_seed = 1;
+		for(k=1; k<0x10000; k++) {
+			assert(lfo_random(&bank) != 0);
+			if(bank.random_seed == 1) {
+				break;
+			}
+		}
+		// full period of a 16 bit xorshift
+		assert(k == 0xffff);
+		printf("success\n");
+		printf("\tsample and hold changes on new cycles only ");
+		lfo_bank_init(&bank);
+		lfo_set_shape(&bank, 0, SAMPLE_HOLD);
+		bank.stepwidth[0] = 0x1000;
+		lfo_bank_render(&bank);
+		held = bank.value[0];
+		for(k=0; k<15; k++) {
+			lfo_bank_advance(&bank, 1, 0);
+			lfo_bank_render(&bank);
+			assert(bank.value[0] == held);
+		}
+		lfo_bank_advance(&bank, 1, 0);
+		lfo_bank_render(&bank);
+		assert(bank.value[0] != held);
+		held = bank.value[0];
+		lfo_restart(&bank, 0);
+		lfo_bank_render(&bank);
+		assert(bank.value[0] != held);
+		printf("success\n");
+		printf("\tsmoothed random glides to the next value ");
+		lfo_set_shape(&bank, 0, SMOOTH_RANDOM);
+		lfo_restart(&bank, 0);
+		lfo_bank_render(&bank);
+		last = bank.random_last[0];
+		held = bank.random_value[0];
+		assert(bank.value[0] == last);
+		for(k=0; k<15; k++) {
+			uint16_t before = bank.value[0];
+			lfo_bank_advance(&bank, 1, 0);
+			lfo_bank_render(&bank);
+			assert(held > last ? bank.value[0] >= before : bank.value[0] <= before);
+		}
+		assert(held > last ? held - bank.value[0] <= (held-last)/15 : bank.value[0] - held <= (last-held)/15);
+		lfo_bank_advance(&bank, 1, 0);
+		lfo_bank_render(&bank);
+		assert(bank.random_last[0] == held);
+		printf("success\n");
+		printf("\trandom gate is either open or closed ");
+		lfo_set_shape(&bank, 0, RANDOM_GATE);
+		uint16_t num_gates = 0;
+		for(k=0; k<16*100; k++) {
+			lfo_bank_advance(&bank, 1, 0);
+			lfo_bank_render(&bank);
+			assert(bank.value[0] == 0x0000 || bank.value[0] == 0xffff);
+			if(bank.value[0] == 0xffff) {
+				assert(bank.position[0] <= LFO_HALF_TABLE_LENGTH);
+				num_gates++;
+			}
+		}
+		// roughly every second cycle - 8 steps each
+		assert(num_gates > 8*30 && num_gates < 8*70);
+		printf("success\n");
+		printf("\tsynced random shapes draw on each clock cycle ");
+		midimessage_t m;
+		init_lfo();
+		SET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		lfo_set_shape(&lfo, 0, SAMPLE_HOLD);
+		lfo_set_clock_sync(&lfo, 0, true);
+		lfo_set_clock_mode(&lfo, 0, NUM_CLOCK_LIMITS-1);
+		lfo_bank_render(&lfo);
+		held = lfo.value[0];
+		midiclock_counter = 0;
+		triggered_midiclock = 0;
+		m.byte[0] = CLOCK_SIGNAL;
+		for(k=0; k<clock_limit[NUM_CLOCK_LIMITS-1]; k++) {
+			midi_handler_function(&m);
+			update_clock_trigger();
+		}
+		lfo_bank_render(&lfo);
+		assert(lfo.value[0] != held);
+		UNSET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		printf("success\n");
+		printf("\tpanel switches pick the random shapes ");
+		settings->global_options |= (1<<RANDOM_PANEL_LFO);
+		hal_host_panel[0] = midi_channel;
+		hal_host_panel[1] = (SAWTOOTH<<lfo_offset[0])|(TRIANGLE<<lfo_offset[1]);
+		process_user_input();
+		assert(lfo.shape[0] == SAMPLE_HOLD && lfo.shape[1] == SMOOTH_RANDOM);
+		settings->global_options = 0x00;
+		process_user_input();
+		assert(lfo.shape[0] == SAWTOOTH && lfo.shape[1] == TRIANGLE);
+		hal_host_panel[1] = 0x00;
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing envelopes {\n");
+	{
+		envelope_bank_t env;
+		uint32_t k;
+		printf("\tstages take their time ");
+		envelope_bank_init(&env);
+		envelope_set_attack(&env, 10);
+		envelope_set_decay(&env, 20);
+		envelope_set_sustain(&env, 0x8000);
+		envelope_set_release(&env, 40);
+		envelope_set_gates(&env, 0x01);
+		assert(env.stage[0] == ENVELOPE_ATTACK && env.stage[1] == ENVELOPE_IDLE);
+		for(k=0; k<9; k++) {
+			envelope_bank_tick(&env);
+		}
+		assert(env.stage[0] == ENVELOPE_ATTACK);
+		envelope_bank_tick(&env);
+		assert(env.stage[0] == ENVELOPE_DECAY && envelope_value(&env, 0) == 0xffff);
+		assert(envelope_value(&env, 1) == 0);
+		// full decay would take 20 ticks - down to half is 10
+		for(k=0; k<9; k++) {
+			envelope_bank_tick(&env);
+		}
+		assert(env.stage[0] == ENVELOPE_DECAY);
+		envelope_bank_tick(&env);
+		assert(env.stage[0] == ENVELOPE_SUSTAIN && envelope_value(&env, 0) == 0x8000);
+		for(k=0; k<100; k++) {
+			envelope_bank_tick(&env);
+		}
+		assert(envelope_value(&env, 0) == 0x8000);
+		printf("success\n");
+		printf("\trelease and retrigger ");
+		envelope_set_gates(&env, 0x00);
+		assert(env.stage[0] == ENVELOPE_RELEASE);
+		for(k=0; k<10; k++) {
+			envelope_bank_tick(&env);
+		}
+		uint16_t level = envelope_value(&env, 0);
+		assert(level < 0x8000 && level > 0x3f00);
+		// attack starts right from where the release is
+		envelope_set_gates(&env, 0x01);
+		envelope_bank_tick(&env);
+		assert(envelope_value(&env, 0) > level);
+		envelope_set_gates(&env, 0x00);
+		for(k=0; k<40; k++) {
+			envelope_bank_tick(&env);
+		}
+		assert(env.stage[0] == ENVELOPE_IDLE && envelope_value(&env, 0) == 0);
+		printf("success\n");
+		printf("\tshared envelope follows any voice ");
+		env.shared = true;
+		envelope_set_gates(&env, 0x04);
+		for(k=0; k<NUM_ENVELOPES; k++) {
+			assert(env.stage[k] == ENVELOPE_ATTACK);
+		}
+		envelope_set_gates(&env, 0x06);
+		envelope_set_gates(&env, 0x02);
+		assert(env.stage[0] == ENVELOPE_ATTACK);
+		envelope_set_gates(&env, 0x00);
+		assert(env.stage[0] == ENVELOPE_RELEASE);
+		printf("success\n");
+		printf("\tvoice gates drive the routed envelopes ");
+		midimessage_t m;
+		init_lfo();
+		init_variables();
+		SET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		m.byte[0] = CONTROL_CHANGE(midi_channel);
+		m.byte[1] = AUX_ROUTE_CC0+3;
+		m.byte[2] = AUX_SOURCE_ENVELOPE0;
+		midi_handler_function(&m);
+		m.byte[1] = ENVELOPE_ATTACK_CC;
+		m.byte[2] = 6; // 10 ticks
+		midi_handler_function(&m);
+		m.byte[1] = ENVELOPE_SUSTAIN_CC;
+		m.byte[2] = 127;
+		midi_handler_function(&m);
+		m.byte[0] = NOTE_ON(midi_channel);
+		m.byte[1] = 60;
+		m.byte[2] = 100;
+		midi_handler_function(&m);
+		mode[playmode].update_notes(&note_stack, playing_notes);
+		update_dac();
+		last_lfo_update_time = hal_host_time;
+		hal_host_time += 5*LFO_TICK;
+		update_lfo();
+		assert(hal_host_dac[NUM_PLAY_NOTES+3] > 0x7000 && hal_host_dac[NUM_PLAY_NOTES+3] < 0x9000);
+		hal_host_time += 5*LFO_TICK;
+		update_lfo();
+		assert(hal_host_dac[NUM_PLAY_NOTES+3] == 0xffff);
+		m.byte[0] = NOTE_OFF(midi_channel);
+		midi_handler_function(&m);
+		mode[playmode].update_notes(&note_stack, playing_notes);
+		update_dac();
+		hal_host_time += LFO_TICK;
+		update_lfo();
+		assert(hal_host_dac[NUM_PLAY_NOTES+3] == 0);
+		UNSET(program_options, LFO_AND_CLOCK_OUT_ENABLE);
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing block rendering {\n");
+	{
+		const uint16_t lengths[] = {1, 63, 64, 65, 300};
+		const uint8_t elapsed[] = {1, 3, 200};
+		const uint16_t ticks[] = {1, 3, 7, 10, 17, 20, 33, 51, 64, 85, 100};
+		uint16_t out[NUM_LFO*300];
+		lfo_bank_t scalar;
+		lfo_bank_t block;
+		envelope_bank_t scalar_env;
+		envelope_bank_t block_env;
+		uint16_t round;
+		uint16_t k;
+		uint8_t n;
+		printf("\tLFO blocks match rendering sample by sample ");
+		lfo_bank_init(&scalar);
+		for(round=0; round<120; round++) {
+			uint16_t length = lengths[round%5];
+			uint8_t e = elapsed[round%3];
+			// every shape on every LFO, free running and synced
+			for(n=0; n<NUM_LFO; n++) {
+				lfo_set_shape(&scalar, n, (round/5+n*3)%NUM_LFO_SHAPES);
+				lfo_set_clock_sync(&scalar, n, (round/7+n)%3 == 0);
+				lfo_set_clock_mode(&scalar, n, (round+n)%12);
+				scalar.stepwidth[n] = 0x10 << ((round+n)%12);
+			}
+			if(round%4 == 0) {
+				lfo_restart(&scalar, round%NUM_LFO);
+			}
+			block = scalar;
+			lfo_bank_render_block(&block, e, 400+(round/10)*50, out, length);
+			for(k=0; k<length; k++) {
+				lfo_bank_advance(&scalar, e, 400+(round/10)*50);
+				lfo_bank_render(&scalar);
+				for(n=0; n<NUM_LFO; n++) {
+					assert(out[n*length+k] == scalar.value[n]);
+				}
+			}
+			for(n=0; n<NUM_LFO; n++) {
+				assert(block.position[n] == scalar.position[n]);
+				assert(block.stepwidth[n] == scalar.stepwidth[n]);
+				assert(block.value[n] == scalar.value[n]);
+				assert(block.random_value[n] == scalar.random_value[n]);
+				assert(block.random_last[n] == scalar.random_last[n]);
+			}
+			assert(block.random_seed == scalar.random_seed);
+			assert(block.new_cycle == scalar.new_cycle);
+			assert(block.midiclock_period == scalar.midiclock_period);
+		}
+		printf("success\n");
+		printf("\tenvelope blocks match ticking one by one ");
+		envelope_bank_init(&scalar_env);
+		for(round=0; round<500; round++) {
+			uint16_t length = lengths[round%5];
+			// lengths dividing ENVELOPE_MAX end their stage right on a tick
+			envelope_set_attack(&scalar_env, ticks[round%11]);
+			envelope_set_decay(&scalar_env, ticks[(round/3)%11]);
+			envelope_set_sustain(&scalar_env, (round%3) ? (round*0x1234) & 0xffff : 0);
+			envelope_set_release(&scalar_env, ticks[(round/7)%11]);
+			scalar_env.shared = (round%9 == 0);
+			envelope_set_gates(&scalar_env, (round*5)%(1<<NUM_ENVELOPES));
+			block_env = scalar_env;
+			envelope_bank_render_block(&block_env, out, length);
+			for(k=0; k<length; k++) {
+				envelope_bank_tick(&scalar_env);
+				for(n=0; n<NUM_ENVELOPES; n++) {
+					assert(out[n*length+k] == envelope_value(&scalar_env, n));
+				}
+			}
+			for(n=0; n<NUM_ENVELOPES; n++) {
+				assert(block_env.level[n] == scalar_env.level[n]);
+				assert(block_env.stage[n] == scalar_env.stage[n]);
+			}
+		}
+		// short blocks, so every tick is the last one of a block sometime
+		envelope_bank_init(&scalar_env);
+		envelope_set_attack(&scalar_env, 10);
+		envelope_set_decay(&scalar_env, 20);
+		envelope_set_sustain(&scalar_env, 0);
+		envelope_set_release(&scalar_env, 17);
+		block_env = scalar_env;
+		for(round=0; round<2000; round++) {
+			uint16_t length = 1+round%7;
+			// the release runs from full level once the sustain is there too
+			if(round == 1000) {
+				envelope_set_sustain(&scalar_env, 0xffff);
+				envelope_set_sustain(&block_env, 0xffff);
+			}
+			if(round%50 == 0) {
+				envelope_set_gates(&scalar_env, (round/50)%(1<<NUM_ENVELOPES));
+				envelope_set_gates(&block_env, (round/50)%(1<<NUM_ENVELOPES));
+			}
+			envelope_bank_render_block(&block_env, out, length);
+			for(k=0; k<length; k++) {
+				envelope_bank_tick(&scalar_env);
+			}
+			for(n=0; n<NUM_ENVELOPES; n++) {
+				assert(block_env.level[n] == scalar_env.level[n]);
+				assert(block_env.stage[n] == scalar_env.stage[n]);
+			}
+		}
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing scheduler {\n");
+	{
+		task_t t[4];
+		uint8_t k=0;
+		printf("\tmost urgent task runs first ");
+		hal_host_time = 1000;
+		task_init(t+0, record_task_a, 2, 0, US_TO_TIMEBASE(1000));
+		task_init(t+1, record_task_b, 0, 0, US_TO_TIMEBASE(1000));
+		task_init(t+2, record_task_c, 1, 0, US_TO_TIMEBASE(1000));
+		scheduler_init(t, 3);
+		task_log_length = 0;
+		assert(scheduler_run_next() == false);
+		scheduler_post(0);
+		scheduler_post(2);
+		scheduler_post(1);
+		// posting twice still runs it only once
+		scheduler_post(1);
+		while(scheduler_run_next());
+		assert(task_log_length == 3 && memcmp(task_log, "bca", 3) == 0);
+		printf("success\n");
+		printf("\tearliest deadline first on the same priority ");
+		task_init(t+0, record_task_a, 1, 0, US_TO_TIMEBASE(1000));
+		task_init(t+1, record_task_b, 1, 0, US_TO_TIMEBASE(200));
+		task_init(t+2, record_task_c, 1, 0, US_TO_TIMEBASE(500));
+		scheduler_init(t, 3);
+		task_log_length = 0;
+		scheduler_post(0);
+		hal_host_time += US_TO_TIMEBASE(100);
+		scheduler_post(2);
+		scheduler_post(1);
+		while(scheduler_run_next());
+		assert(task_log_length == 3 && memcmp(task_log, "bca", 3) == 0);
+		printf("success\n");
+		printf("\tperiodic tasks get released each period ");
+		task_init(t+0, record_task_a, 2, MS_TO_TIMEBASE(4), MS_TO_TIMEBASE(4));
+		scheduler_init(t, 1);
+		task_log_length = 0;
+		hal_host_time += MS_TO_TIMEBASE(4) - 1;
+		assert(scheduler_run_next() == false);
+		for(k=0; k<10; k++) {
+			hal_host_time += MS_TO_TIMEBASE(4);
+			assert(scheduler_run_next() == true);
+			assert(scheduler_run_next() == false);
+		}
+		assert(task_log_length == 10 && t[0].overruns == 0);
+		printf("success\n");
+		printf("\toverruns get counted ");
+		// started too late after being posted
+		task_init(t+1, record_task_b, 0, 0, US_TO_TIMEBASE(500));
+		scheduler_init(t, 2);
+		scheduler_post(1);
+		hal_host_time += US_TO_TIMEBASE(600);
+		assert(scheduler_run_next() == true);
+		assert(t[1].overruns == 1);
+		// a periodic task missing 3 whole periods
+		hal_host_time += MS_TO_TIMEBASE(4);
+		for(k=0; k<3; k++) {
+			hal_host_time += MS_TO_TIMEBASE(4);
+			scheduler_post(1);
+			scheduler_run_next();
+		}
+		assert(t[0].overruns == 3);
+		// and back in time again
+		scheduler_run_next();
+		task_log_length = 0;
+		hal_host_time += MS_TO_TIMEBASE(4);
+		assert(scheduler_run_next() == true && task_log_length == 1);
+		printf("success\n");
+		printf("\tmidi latency bounded by a busy panel and lfo ");
+		// MIDI, panel and LFO just like in main.c
+		task_init(t+0, record_task_a, 0, 0, US_TO_TIMEBASE(1000));
+		task_init(t+1, record_task_b, 2, LFO_TICK, LFO_TICK);
+		task_init(t+2, busy_task, 3, MS_TO_TIMEBASE(10), MS_TO_TIMEBASE(10));
+		busy_task_duration = US_TO_TIMEBASE(800);
+		scheduler_init(t, 3);
+		task_log_length = 0;
+		for(k=0; k<200; k++) {
+			timebase_t posted = hal_host_time;
+			hal_host_time += US_TO_TIMEBASE(100);
+			if(!scheduler_run_next()) {
+				continue;
+			}
+			if(task_log[task_log_length-1] == 'x') {
+				posted = hal_host_time - busy_task_duration/2;
+				// the MIDI task goes before the LFO waiting for ages now
+				assert(scheduler_run_next() == true);
+				assert(task_log[task_log_length-1] == 'a');
+				assert(task_run_time[0] - posted <= busy_task_duration/2);
+			}
+			if(task_log_length > sizeof(task_log)-2) {
+				task_log_length = 0;
+			}
+		}
+		assert(t[0].overruns == 0);
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing profiling {\n");
+	{
+		uint8_t message[PROFILE_SYSEX_LENGTH];
+		uint8_t k=0;
+		printf("\tdurations end up in min, max, mean and histogram ");
+		hal_host_time = 0;
+		profile_init();
+		profile_record(PROFILE_UPDATE_DAC, 3);
+		profile_record(PROFILE_UPDATE_DAC, 4);
+		profile_record(PROFILE_UPDATE_DAC, 100);
+		profile_record(PROFILE_UPDATE_DAC, 0xffff);
+		assert(profile[PROFILE_UPDATE_DAC].stats.count == 4);
+		assert(profile[PROFILE_UPDATE_DAC].stats.min == 3);
+		assert(profile[PROFILE_UPDATE_DAC].stats.max == 0xffff);
+		assert(profile[PROFILE_UPDATE_DAC].histogram[0] == 1);
+		assert(profile[PROFILE_UPDATE_DAC].histogram[1] == 1);
+		assert(profile[PROFILE_UPDATE_DAC].histogram[3] == 1);
+		assert(profile[PROFILE_UPDATE_DAC].histogram[NUM_PROFILE_BUCKETS-1] == 1);
+		assert(profile[PROFILE_UPDATE_NOTES].stats.count == 0);
+		printf("success\n");
+		printf("\tcounts get halved instead of running over ");
+		profile_reset(PROFILE_UPDATE_DAC);
+		for(k=0; k<2; k++) {
+			uint16_t n=0;
+			for(; n<0xffff; n++) {
+				profile_record(PROFILE_UPDATE_DAC, 10+k*90);
+			}
+		}
+		assert(profile[PROFILE_UPDATE_DAC].stats.count > 0x8000);
+		assert(profile[PROFILE_UPDATE_DAC].stats.sum/profile[PROFILE_UPDATE_DAC].stats.count > 75);
+		assert(profile[PROFILE_UPDATE_DAC].histogram[3] > profile[PROFILE_UPDATE_DAC].histogram[1]);
+		printf("success\n");
+		printf("\tsysex message carries 7 bit data only ");
+		profile_reset(PROFILE_UPDATE_DAC);
+		profile_record(PROFILE_UPDATE_DAC, 0xabcd);
+		assert(profile_sysex(PROFILE_UPDATE_DAC, message) == PROFILE_SYSEX_LENGTH);
+		assert(message[0] == 0xf0 && message[PROFILE_SYSEX_LENGTH-1] == 0xf7);
+		assert(message[1] == PROFILE_SYSEX_ID && message[3] == PROFILE_UPDATE_DAC);
+		for(k=1; k<PROFILE_SYSEX_LENGTH-1; k++) {
+			assert(message[k] < 0x80);
+		}
+		// the maximum follows count and min
+		assert(((message[10]<<14)|(message[11]<<7)|message[12]) == 0xabcd);
+		printf("success\n");
+		printf("\tmidibuffer_get gets measured ");
+		init_variables();
+		profile_init();
+		testnote_t z;
+		z.byte[0] = NOTE_ON(midi_channel);
+		z.byte[1] = 0x3c;
+		z.byte[2] = 0x72;
+		insert_midibuffer_test(z);
+		midibuffer_tick(&midi_buffer);
+		assert(profile[PROFILE_MIDIBUFFER_GET].stats.count == 1);
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing pots {\n");
+	{
+		uint8_t k;
+		printf("\ta scan picks up every pot ");
+		init_lfo();
+		for(k=0; k<NUM_ANALOG_IN_CHANNELS; k++) {
+			hal_host_set_analog_in(k, 100*k);
+		}
+		init_analogin();
+		hal_host_adc_finish();
+		hal_host_panel[0] = midi_channel | LFO_CLOCK_ENABLE_BIT;
+		hal_host_panel[1] = 0;
+		process_user_input();
+		pending_pots = 0;
+		assert(analog_in_changes() == ANALOG_IN_CHANNELS);
+		assert(analog_read(LFO_RATE_POTI0) == 400 && analog_read(CLOCK_RATE_POTI0+1) == 300);
+		printf("success\n");
+		printf("\tonly moved pots get applied ");
+		// anything not moved keeps what it has
+		lfo.stepwidth[0] = 1;
+		lfo.stepwidth[1] = 1;
+		clock_output[0].mode = 15;
+		clock_output[1].mode = 15;
+		hal_host_set_analog_in(LFO_RATE_POTI0+1, 700);
+		hal_host_set_analog_in(CLOCK_RATE_POTI0, 640);
+		process_analog_in();
+		hal_host_adc_finish();
+		process_analog_in();
+		assert(lfo.stepwidth[0] == 1 && lfo.stepwidth[1] == (700+1)*4);
+		assert(clock_output[0].mode == 10 && clock_output[1].mode == 15);
+		// within the hysteresis nothing moved at all
+		lfo.stepwidth[1] = 1;
+		hal_host_set_analog_in(LFO_RATE_POTI0+1, 702);
+		process_analog_in();
+		hal_host_adc_finish();
+		process_analog_in();
+		assert(lfo.stepwidth[1] == 1);
+		printf("success\n");
+		printf("\tmoves are kept while the LFO and clock outputs are off ");
+		UNSET(hal_host_panel[0], LFO_CLOCK_ENABLE_BIT);
+		process_user_input();
+		hal_host_set_analog_in(LFO_RATE_POTI0, 200);
+		process_analog_in();
+		hal_host_adc_finish();
+		process_analog_in();
+		assert(lfo.stepwidth[0] == 1);
+		SET(hal_host_panel[0], LFO_CLOCK_ENABLE_BIT);
+		process_user_input();
+		process_analog_in();
+		assert(lfo.stepwidth[0] == (200+1)*4);
+		assert(lfo.stepwidth[1] == 1 && clock_output[0].mode == 10 && clock_output[1].mode == 15);
+		printf("success\n");
+		printf("\tthe clock sync switch has the rate pot applied again ");
+		SET(hal_host_panel[1], LFO0_CLOCKSYNC);
+		process_user_input();
+		process_analog_in();
+		assert(lfo.clock_mode[0] == 200/64 && lfo.clock_mode[1] == 0);
+		assert(lfo.stepwidth[1] == 1);
+		UNSET(hal_host_panel[1], LFO0_CLOCKSYNC);
+		process_user_input();
+		lfo.stepwidth[0] = 1;
+		process_analog_in();
+		assert(lfo.stepwidth[0] == (200+1)*4);
+		assert(lfo.stepwidth[1] == 1);
+		printf("success\n");
+		UNSET(hal_host_panel[0], LFO_CLOCK_ENABLE_BIT);
+		process_user_input();
+	}
+	printf("} success\n");
+	printf("testing internal clock {\n");
+	{
+		timebase_t start = 100000;
+		timebase_t t;
+		uint32_t counter;
+		uint8_t k;
+		printf("\truns on its own without a MIDI clock ");
+		init_variables();
+		init_tasks();
+		external_clock_seen = false;
+		internal_clock_pending = 0;
+		set_internal_clock_bpm(INTERNAL_CLOCK_DEFAULT_BPM);
+		internal_clock_next = start;
+		internal_clock_fraction = 0;
+		counter = midiclock_counter;
+		// matches of compare B before the clock is due do nothing
+		hal_host_time = start-10;
+		TIMER1_COMPB_vect();
+		assert(internal_clock_pending == 0 && internal_clock_next == start);
+		for(k=0; k<24; k++) {
+			hal_host_time = internal_clock_next;
+			TIMER1_COMPB_vect();
+			assert(internal_clock_pending == 1);
+			clock_task();
+			assert(internal_clock_pending == 0);
+		}
+		assert(midiclock_counter == counter+24);
+		// a quarter note at 120 bpm takes 500ms - to a fraction of a tick
+		t = internal_clock_next - start;
+		assert(t >= MS_TO_TIMEBASE(500)-1 && t <= MS_TO_TIMEBASE(500)+1);
+		assert(current_midiclock_time - last_midiclock_time >= 41666);
+		assert(current_midiclock_time - last_midiclock_time <= 41667);
+		printf("success\n");
+		printf("\ta late clock task plays each clock at its own time ");
+		hal_host_time = internal_clock_next;
+		t = internal_clock_next;
+		TIMER1_COMPB_vect();
+		hal_host_time = internal_clock_next;
+		TIMER1_COMPB_vect();
+		assert(internal_clock_pending == 2);
+		hal_host_time += 1000;
+		clock_task();
+		// to the fraction of a tick the period is apart from whole ticks
+		assert(current_midiclock_time - t <= 1);
+		clock_task();
+		assert(internal_clock_pending == 0);
+		assert(current_midiclock_time - last_midiclock_time >= (internal_clock_period>>8) - 1);
+		assert(current_midiclock_time - last_midiclock_time <= (internal_clock_period>>8) + 1);
+		assert(current_midiclock_time == internal_clock_time);
+		printf("success\n");
+		printf("\tgets sent to MIDI OUT if wanted ");
+		hal_host_uart_tx_hook = record_uart;
+		uart_sent_length = 0;
+		hal_host_time = internal_clock_next;
+		TIMER1_COMPB_vect();
+		assert(uart_sent_length == 0);
+		SET(settings->global_options, (1<<SEND_INTERNAL_CLOCK));
+		hal_host_time = internal_clock_next;
+		TIMER1_COMPB_vect();
+		assert(uart_sent_length == 1 && uart_sent[0] == CLOCK_SIGNAL);
+		UNSET(settings->global_options, (1<<SEND_INTERNAL_CLOCK));
+		hal_host_uart_tx_hook = 0;
+		internal_clock_pending = 0;
+		printf("success\n");
+		printf("\ttempo set by CC ");
+		midimessage_t m;
+		m.byte[0] = CONTROL_CHANGE(midi_channel);
+		m.byte[1] = INTERNAL_CLOCK_TEMPO_CC;
+		m.byte[2] = 0;
+		midi_handler_function(&m);
+		assert(internal_clock_period == INTERNAL_CLOCK_PERIOD(INTERNAL_CLOCK_MIN_BPM));
+		m.byte[2] = 127;
+		midi_handler_function(&m);
+		assert(internal_clock_period == INTERNAL_CLOCK_PERIOD(INTERNAL_CLOCK_MIN_BPM+127));
+		m.byte[2] = INTERNAL_CLOCK_DEFAULT_BPM-INTERNAL_CLOCK_MIN_BPM;
+		midi_handler_function(&m);
+		assert(internal_clock_period == INTERNAL_CLOCK_PERIOD(INTERNAL_CLOCK_DEFAULT_BPM));
+		printf("success\n");
+		printf("\ta learned CC wins over the tempo CC ");
+		settings->cc_message[2] = INTERNAL_CLOCK_TEMPO_CC;
+		m.byte[2] = 0;
+		assert(midi_handler_function(&m) == true);
+		assert(cc_value[2] == 0 && internal_clock_period == INTERNAL_CLOCK_PERIOD(INTERNAL_CLOCK_DEFAULT_BPM));
+		// the same for the aux routing CCs
+		settings->cc_message[2] = AUX_ROUTE_CC0;
+		aux_route[0] = AUX_SOURCE_LFO0;
+		m.byte[1] = AUX_ROUTE_CC0;
+		m.byte[2] = 33;
+		assert(midi_handler_function(&m) == true);
+		assert(cc_value[2] == 33 && aux_route[0] == AUX_SOURCE_LFO0);
+		settings->cc_message[2] = 18;
+		printf("success\n");
+		printf("\tMIDI clock takes over and hands back when it stops ");
+		// a MIDI clock at 150 bpm - 16.7ms
+		start = hal_host_time + 1000;
+		for(k=0; k<4; k++) {
+			receive_clock(start + k*33333UL);
+		}
+		assert(external_clock_seen);
+		assert(external_clock_timeout == 2*33333UL);
+		// the internal clock keeps quiet while the MIDI clock is there...
+		counter = midiclock_counter;
+		for(k=0; k<4; k++) {
+			hal_host_time = internal_clock_next;
+			TIMER1_COMPB_vect();
+			assert(internal_clock_pending == 0);
+			receive_clock(start + (4+k)*33333UL);
+		}
+		assert(midiclock_counter == counter+4);
+		// ...and starts in phase with the last MIDI clock two clocks after it
+		t = last_external_clock_time;
+		assert(internal_clock_next == t + (internal_clock_period>>8));
+		while(internal_clock_pending == 0) {
+			hal_host_time = internal_clock_next;
+			TIMER1_COMPB_vect();
+		}
+		assert(!external_clock_seen);
+		assert(hal_host_time - t > 2*33333UL && hal_host_time - t <= 2*33333UL + (internal_clock_period>>8) + 1);
+		assert((hal_host_time - t) % (internal_clock_period>>8) <= 2);
+		clock_task();
+		// counting goes on without a jump
+		assert(midiclock_counter == counter+5);
+		// a MIDI clock showing up again silences the internal one right away
+		receive_clock(hal_host_time + 1000);
+		assert(external_clock_seen && midiclock_counter == counter+6);
+		hal_host_time = internal_clock_next;
+		TIMER1_COMPB_vect();
+		assert(internal_clock_pending == 0);
+		printf("success\n");
+		printf("\tMIDI clock measured from the time it came in ");
+		init_variables();
+		start = hal_host_time + 1000;
+		receive_clock(start);
+		// the MIDI task gets to the next clocks late and both at once
+		hal_host_time = start + 20000;
+		hal_host_uart_rx = CLOCK_SIGNAL;
+		USART_RXC_vect();
+		hal_host_time = start + 40000;
+		hal_host_uart_rx = CLOCK_SIGNAL;
+		USART_RXC_vect();
+		hal_host_time = start + 45000;
+		while(!ringbuffer_empty(&midi_buffer.buffer)) {
+			midi_task();
+		}
+		assert(last_midiclock_time == start + 20000 && current_midiclock_time == start + 40000);
+		assert(last_external_clock_time == start + 40000);
+		// clocks within a SysEx are dropped and their stamps skipped
+		hal_host_uart_rx = SYSEX_BEGIN;
+		USART_RXC_vect();
+		hal_host_uart_rx = CLOCK_SIGNAL;
+		USART_RXC_vect();
+		hal_host_uart_rx = SYSEX_END;
+		USART_RXC_vect();
+		hal_host_time = start + 60000;
+		hal_host_uart_rx = CLOCK_SIGNAL;
+		USART_RXC_vect();
+		hal_host_time = start + 61000;
+		while(!ringbuffer_empty(&midi_buffer.buffer)) {
+			midi_task();
+		}
+		assert(current_midiclock_time == start + 60000);
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing stack monitor {\n");
+	{
+		uint8_t k=0;
+		printf("\tCC 103 sends the RAM usage to MIDI OUT ");
+		init_variables();
+		init_tasks();
+		// 300 bytes of variables, 200 never touched, 500 free right now
+		hal_host_set_stack(300, 200, 500);
+		hal_host_uart_tx_hook = record_uart;
+		uart_sent_length = 0;
+		hal_host_uart_rx = CONTROL_CHANGE(midi_channel);
+		USART_RXC_vect();
+		hal_host_uart_rx = STACK_MONITOR_CC;
+		USART_RXC_vect();
+		hal_host_uart_rx = 0;
+		USART_RXC_vect();
+		while(scheduler_run_next());
+		hal_host_uart_tx_hook = 0;
+		assert(uart_sent_length == STACK_MONITOR_SYSEX_LENGTH);
+		assert(uart_sent[0] == 0xf0 && uart_sent[1] == STACK_MONITOR_SYSEX_ID);
+		assert(uart_sent[2] == STACK_MONITOR_SYSEX_TYPE);
+		assert(uart_sent[STACK_MONITOR_SYSEX_LENGTH-1] == 0xf7);
+		for(k=1; k<STACK_MONITOR_SYSEX_LENGTH-1; k++) {
+			assert(uart_sent[k] < 0x80);
+		}
+		// each value as its upper 2, middle 7 and lower 7 bits
+		assert(uart_sent[3] == 0 && uart_sent[4] == (300>>7) && uart_sent[5] == (300&0x7f));
+		// the stack got as deep as all of the RAM but the variables and the paint
+		assert(uart_sent[6] == 0 && uart_sent[7] == (524>>7) && uart_sent[8] == (524&0x7f));
+		assert(uart_sent[9] == 0 && uart_sent[10] == (200>>7) && uart_sent[11] == (200&0x7f));
+		assert(uart_sent[12] == 0 && uart_sent[13] == (500>>7) && uart_sent[14] == (500&0x7f));
+		printf("success\n");
+		printf("\tthe upper 2 bits go first ");
+		uint8_t message[3];
+		assert(sysex_put16(message, 0xabcd) == message+3);
+		assert(message[0] == 0x02 && message[1] == 0x57 && message[2] == 0x4d);
+		printf("success\n");
+	}
+	printf("} success\n");
+	printf("testing eeprom store {\n");
+	{
+		uint8_t a[STORE_TEST_SIZE];
+		uint8_t b[STORE_TEST_SIZE];
+		uint8_t out[STORE_TEST_SIZE];
+		uint8_t sequences = 0;
+		uint16_t j;
+		uint8_t k;
+		for(j=0; j<STORE_TEST_SIZE; j++) {
+			a[j] = j;
+			b[j] = 0xff-j;
+		}
+		printf("\tnothing in an empty EEPROM ");
+		hal_host_eeprom_clear();
+		assert(eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put) == 5);
+		memset(out, 0x55, sizeof(out));
+		assert(!eeprom_store_load(0, out));
+		assert(out[0] == 0x55 && out[STORE_TEST_SIZE-1] == 0x55);
+		printf("success\n");
+		printf("\tsaves in the background ");
+		eeprom_store_save(0, a);
+		assert(eeprom_store_busy());
+		hal_host_eeprom_finish();
+		assert(!eeprom_store_busy());
+		assert(eeprom_store_load(0, out) && memcmp(out, a, sizeof(a)) == 0);
+		assert(!eeprom_store_load(1, out));
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		memset(out, 0, sizeof(out));
+		assert(eeprom_store_load(0, out) && memcmp(out, a, sizeof(a)) == 0);
+		printf("success\n");
+		printf("\trejects records with a broken crc or another version ");
+		eeprom_store_init(2, STORE_TEST_SIZE, store_get, store_put);
+		assert(!eeprom_store_load(0, out));
+		// the first save went into the first slot
+		hal_host_eeprom[EEPROM_STORE_HEADER_SIZE+10] ^= 0x04;
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		assert(!eeprom_store_load(0, out));
+		hal_host_eeprom[EEPROM_STORE_HEADER_SIZE+10] ^= 0x04;
+		hal_host_eeprom[STORE_TEST_RECORD-1] ^= 0x80;
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		assert(!eeprom_store_load(0, out));
+		hal_host_eeprom[STORE_TEST_RECORD-1] ^= 0x80;
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		assert(eeprom_store_load(0, out));
+		printf("success\n");
+		printf("\tsaves rotate over all slots ");
+		hal_host_eeprom_clear();
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		for(k=0; k<20; k++) {
+			a[0] = k;
+			eeprom_store_save(k%2, a);
+			hal_host_eeprom_finish();
+		}
+		// the last 5 saves are in the 5 slots
+		for(k=0; k<5; k++) {
+			assert(store_sequence(k) > 15 && store_sequence(k) <= 20);
+			sequences |= 1<<(store_sequence(k)-16);
+		}
+		assert(sequences == 0x1f);
+		assert(eeprom_store_load(0, out) && out[0] == 18);
+		assert(eeprom_store_load(1, out) && out[0] == 19);
+		printf("success\n");
+		printf("\tthe newest record wins across power cycles ");
+		for(j=0; j<300; j++) {
+			a[0] = j;
+			a[1] = j>>8;
+			eeprom_store_save(j%2, a);
+			hal_host_eeprom_finish();
+			if(j%37 == 0) {
+				// a power cycle now and then
+				eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+			}
+			assert(eeprom_store_load(j%2, out) && out[0] == (uint8_t)j && out[1] == j>>8);
+		}
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		assert(eeprom_store_load(0, out) && out[0] == (uint8_t)298 && out[1] == 298>>8);
+		assert(eeprom_store_load(1, out) && out[0] == (uint8_t)299 && out[1] == 299>>8);
+		printf("success\n");
+		printf("\tone id saved over and over while the others stay ");
+		hal_host_eeprom_clear();
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		for(k=0; k<4; k++) {
+			a[0] = 100+k;
+			eeprom_store_save(k, a);
+			hal_host_eeprom_finish();
+		}
+		for(j=0; j<200; j++) {
+			a[0] = j;
+			eeprom_store_save(1, a);
+			hal_host_eeprom_finish();
+		}
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		for(k=0; k<4; k++) {
+			assert(eeprom_store_load(k, out) && out[0] == (k == 1 ? 199 : 100+k));
+		}
+		// and once more after saving the others
+		for(k=0; k<4; k++) {
+			a[0] = 50+k;
+			eeprom_store_save(k, a);
+			hal_host_eeprom_finish();
+		}
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		for(k=0; k<4; k++) {
+			assert(eeprom_store_load(k, out) && out[0] == 50+k);
+		}
+		printf("success\n");
+		printf("\ta torn save keeps the last good record ");
+		hal_host_eeprom_clear();
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		a[0] = a[1] = 0;
+		eeprom_store_save(0, a);
+		eeprom_store_save(1, b);
+		hal_host_eeprom_finish();
+		for(j=1; j<STORE_TEST_RECORD; j++) {
+			b[0] = j;
+			eeprom_store_save(0, b);
+			for(k=0; k<j; k++) {
+				EE_RDY_vect();
+			}
+			// power lost half way through the record
+			EECR = 0;
+			eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+			assert(eeprom_store_load(0, out) && memcmp(out, a, sizeof(a)) == 0);
+			assert(eeprom_store_load(1, out) && out[1] == 0xfe);
+		}
+		eeprom_store_save(0, b);
+		hal_host_eeprom_finish();
+		eeprom_store_init(1, STORE_TEST_SIZE, store_get, store_put);
+		assert(eeprom_store_load(0, out) && memcmp(out, b, sizeof(b)) == 0);
+		printf("success\n");
+		// back to the settings of the firmware
+		hal_host_eeprom_clear();
+		eeprom_store_init(SETTINGS_VERSION, SETTINGS_RECORD_SIZE, settings_get, settings_put);
+	}
+	printf("} success\n");
+	printf("testing presets {\n");
+	{
+		midimessage_t m;
+		uint16_t j;
+		hal_host_eeprom_clear();
+		eeprom_store_init(SETTINGS_VERSION, SETTINGS_RECORD_SIZE, settings_get, settings_put);
+		init_tasks();
+		program_mode = NORMAL_MODE;
+		preset = next_preset = 0;
+		read_settings();
+		m.byte[0] = PROGRAM_CHANGE(midi_channel);
+		printf("\tan empty preset starts with the defaults ");
+		saved_settings->cc_message[0] = 99;
+		m.byte[1] = 1;
+		midi_handler_function(&m);
+		preset_task();
+		assert(preset == 1 && settings == saved_settings);
+		assert(settings->cc_message[0] == 16 && settings->global_options == 0);
+		printf("success\n");
+		printf("\tProgram Change recalls a saved preset ");
+		edit_settings();
+		settings->cc_message[0] = 70;
+		settings->global_options = (1<<SEND_INTERNAL_CLOCK);
+		save_settings();
+		hal_host_eeprom_finish();
+		m.byte[1] = 0;
+		midi_handler_function(&m);
+		preset_task();
+		assert(preset == 0 && settings->cc_message[0] == 16 && settings->global_options == 0);
+		m.byte[1] = 1;
+		midi_handler_function(&m);
+		preset_task();
+		assert(preset == 1 && settings == saved_settings);
+		assert(settings->cc_message[0] == 70 && settings->global_options == (1<<SEND_INTERNAL_CLOCK));
+		printf("success\n");
+		printf("\twaits for a running save ");
+		edit_settings();
+		settings->cc_message[1] = 71;
+		save_settings();
+		m.byte[1] = 0;
+		midi_handler_function(&m);
+		task[TASK_PRESET].pending = false;
+		preset_task();
+		assert(preset == 1 && task[TASK_PRESET].pending);
+		hal_host_eeprom_finish();
+		preset_task();
+		assert(preset == 0 && settings->cc_message[1] == 17);
+		m.byte[1] = 1;
+		midi_handler_function(&m);
+		preset_task();
+		assert(preset == 1 && settings->cc_message[0] == 70 && settings->cc_message[1] == 71);
+		printf("success\n");
+		printf("\tignores presets out of range ");
+		m.byte[1] = NUM_PRESETS;
+		midi_handler_function(&m);
+		preset_task();
+		assert(preset == 1 && next_preset == 1);
+		printf("success\n");
+		printf("\ta corrupt preset starts with the defaults ");
+		m.byte[1] = 0;
+		midi_handler_function(&m);
+		preset_task();
+		// every record of preset 1 gets a bit flipped
+		for(j=0; j+EEPROM_STORE_RECORD_SIZE(SETTINGS_RECORD_SIZE)<=E2END+1; j+=EEPROM_STORE_RECORD_SIZE(SETTINGS_RECORD_SIZE)) {
+			if(hal_host_eeprom[j+EEPROM_STORE_HEADER_SIZE-1] == 1) {
+				hal_host_eeprom[j+EEPROM_STORE_HEADER_SIZE+CALIBRATION_PACKED_SIZE] ^= 0x01;
+			}
+		}
+		m.byte[1] = 1;
+		midi_handler_function(&m);
+		preset_task();
+		assert(preset == 1 && settings->cc_message[0] == 16 && settings->global_options == 0);
+		printf("success\n");
+		hal_host_eeprom_clear();
+		eeprom_store_init(SETTINGS_VERSION, SETTINGS_RECORD_SIZE, settings_get, settings_put);
+		preset = next_preset = 0;
+		read_settings();
+	}
+	printf("} success\n");
+	printf("testing latency measurement {\n");
+	{
+		uint8_t k=0;
+		uint8_t note_on[3] = {NOTE_ON(midi_channel), 0x40, 0x64};
+		printf("\ttwo buckets per octave ");
+		assert(latency_bucket(0) == 0);
+		assert(latency_bucket(255) == 0);
+		assert(latency_bucket(256) == 1);
+		assert(latency_bucket(384) == 2);
+		assert(latency_bucket(512) == 3);
+		assert(latency_bucket(0xffff) == NUM_LATENCY_BUCKETS-1);
+		for(k=0; k<NUM_LATENCY_BUCKETS; k++) {
+			assert(latency_bucket(latency_bucket_start(k)) == k);
+		}
+		printf("success\n");
+		printf("\tfrom the last byte received to the DAC written ");
+		init_variables();
+		init_tasks();
+		latency_init();
+		for(k=0; k<3; k++) {
+			hal_host_time = 1000+k*640;
+			hal_host_uart_rx = note_on[k];
+			USART_RXC_vect();
+		}
+		hal_host_time = 3000;
+		midi_task();
+		assert(latency[LATENCY_NOTE_ON].stats.count == 0);
+		hal_host_time = 3100;
+		update_dac();
+		assert(latency[LATENCY_NOTE_ON].stats.count == 1);
+		assert(latency[LATENCY_NOTE_ON].stats.min == 3100-2280);
+		assert(latency[LATENCY_NOTE_OFF].stats.count == 0);
+		printf("success\n");
+		printf("\tnote off and clock get their own class ");
+		// running status - velocity 0
+		hal_host_time = 4000;
+		hal_host_uart_rx = 0x40;
+		USART_RXC_vect();
+		hal_host_uart_rx = 0x00;
+		USART_RXC_vect();
+		hal_host_uart_rx = CLOCK_SIGNAL;
+		USART_RXC_vect();
+		hal_host_time = 4500;
+		midi_task();
+		midi_task();
+		clock_task();
+		assert(latency[LATENCY_CLOCK].stats.count == 1);
+		assert(latency[LATENCY_CLOCK].stats.max == 500);
+		assert(latency[LATENCY_NOTE_OFF].stats.count == 0);
+		hal_host_time = 5000;
+		update_dac();
+		assert(latency[LATENCY_NOTE_OFF].stats.count == 1);
+		assert(latency[LATENCY_NOTE_ON].stats.count == 1);
+		printf("success\n");
+	}
+	printf("} success\n");
 	return 0;
 }